@@ -0,0 +1,131 @@
+# Script run after each build of a test executable registered with
+# snapcatch2_add_tests() (see SnapCatch2Config.cmake)
+#
+# It asks the executable to split its test cases in shards of about the
+# same duration (--list-shards) and then saves the list of test cases of
+# each shard in a file and one add_test() per shard in ${CTEST_FILE}.
+#
+# License:
+#
+# Copyright (c) 2013-2022  Made to Order Software Corp.  All Rights Reserved
+#
+# https://snapwebsites.org/project/snapcatch2
+# contact@m2osw.com
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+if(NOT EXISTS "${TEST_EXECUTABLE}")
+    message(FATAL_ERROR "SnapCatch2: test executable \"${TEST_EXECUTABLE}\" not found.")
+endif()
+
+# the listing gets its own temporary directory since the executable
+# deletes it on startup and a shard may be running in the other ones
+#
+execute_process(
+    COMMAND
+        "${TEST_EXECUTABLE}"
+            ${TEST_SPEC}
+            ${TEST_EXTRA_ARGS}
+            --list-shards ${TEST_SHARDS}
+            --tmp-dir "${TEST_TMP_DIR}/list"
+            --history "${TEST_HISTORY}"
+
+    WORKING_DIRECTORY
+        "${TEST_WORKING_DIR}"
+
+    OUTPUT_VARIABLE
+        output
+
+    RESULT_VARIABLE
+        result
+)
+
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR
+        "SnapCatch2: \"${TEST_EXECUTABLE} --list-shards ${TEST_SHARDS}\" failed:\n"
+        "  Result: ${result}\n"
+        "  Output: ${output}\n")
+endif()
+
+# a test case name may include a semicolon, escape it before we
+# transform the output in a list of lines
+#
+string(REPLACE ";" "\\;" output "${output}")
+string(REPLACE "\n" ";" output "${output}")
+
+math(EXPR last_shard "${TEST_SHARDS} - 1")
+foreach(shard RANGE ${last_shard})
+    set(shard_${shard} "")
+    set(count_${shard} 0)
+endforeach()
+
+set(known 0)
+set(total 0)
+foreach(line ${output})
+    if(line MATCHES "^history ([0-9]+) ([0-9]+)$")
+        set(known ${CMAKE_MATCH_1})
+        set(total ${CMAKE_MATCH_2})
+    elseif(line MATCHES "^shard ([0-9]+) (.*)$")
+        set(shard ${CMAKE_MATCH_1})
+        string(APPEND shard_${shard} "${CMAKE_MATCH_2}\n")
+        math(EXPR count_${shard} "${count_${shard}} + 1")
+    endif()
+endforeach()
+
+# the durations are looked up by test case name whatever the build which
+# saved them; if a history exists and none of the test cases were found
+# in it, the shards are not balanced by duration and the user should know
+#
+if(EXISTS "${TEST_HISTORY}" AND known EQUAL 0 AND total GREATER 0)
+    message(WARNING
+        "SnapCatch2: none of the ${total} test cases of \"${TEST_EXECUTABLE}\""
+        " were found in \"${TEST_HISTORY}\"; the shards are balanced by count,"
+        " not duration.")
+endif()
+
+set(script "# Generated by SnapCatch2AddTests.cmake -- do not edit\n")
+string(APPEND script "# ${known} of ${total} test cases found in the history\n\n")
+foreach(shard RANGE ${last_shard})
+    set(shard_file "${TEST_SHARD_PREFIX}${shard}.txt")
+    if(count_${shard} EQUAL 0)
+        file(REMOVE "${shard_file}")
+        continue()
+    endif()
+    file(WRITE "${shard_file}" "${shard_${shard}}")
+
+    set(test_name "${TEST_PREFIX}shard-${shard}")
+    set(args "")
+    foreach(arg ${TEST_EXTRA_ARGS})
+        string(APPEND args " [==[${arg}]==]")
+    endforeach()
+    if(NOT "${TEST_SEED}" STREQUAL "")
+        string(APPEND args " --seed [==[${TEST_SEED}]==]")
+    endif()
+    string(APPEND script
+        "# ${count_${shard}} test cases\n"
+        "add_test([==[${test_name}]==] [==[${TEST_EXECUTABLE}]==]${args}"
+            " --input-file [==[${shard_file}]==]"
+            " --tmp-dir [==[${TEST_TMP_DIR}/shard-${shard}]==]"
+            " --history [==[${TEST_HISTORY}]==])\n"
+        "set_tests_properties([==[${test_name}]==] PROPERTIES WORKING_DIRECTORY [==[${TEST_WORKING_DIR}]==]")
+    foreach(property ${TEST_PROPERTIES})
+        string(APPEND script " [==[${property}]==]")
+    endforeach()
+    string(APPEND script ")\n\n")
+endforeach()
+
+file(WRITE "${CTEST_FILE}" "${script}")
+
+# vim: ts=4 sw=4 et
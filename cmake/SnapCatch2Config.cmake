@@ -4,6 +4,48 @@
 #
 # SNAPCATCH2_FOUND        - System has SnapCatch2
 # SNAPCATCH2_INCLUDE_DIRS - The SnapCatch2 include directories
+# SNAPCATCH2_LIBRARIES    - The prebuilt runner library (libsnapcatch2.a)
+# SnapCatch2::SnapCatch2  - An imported target for the prebuilt runner
+#
+# and the following functions:
+#
+# SnapCatch2PrecompileHeaders(<target> [SKIP <source> ...])
+#
+#     Precompile the catch2 and snapcatch2 headers for <target>. The SKIP
+#     sources do not use the precompiled header; this is required for the
+#     file which defines CATCH_CONFIG_RUNNER, if any. This is a no-op with
+#     cmake older than 3.16.
+#
+# snapcatch2_add_tests(<target>
+#                      [SHARDS <count>]
+#                      [TEST_SPEC <spec> ...]
+#                      [EXTRA_ARGS <arg> ...]
+#                      [TMP_DIR <path>]
+#                      [HISTORY <file>]
+#                      [SEED <seed>]
+#                      [TEST_PREFIX <prefix>]
+#                      [WORKING_DIRECTORY <dir>]
+#                      [PROPERTIES <name> <value> ...])
+#
+#     Register the test cases of <target> as <count> CTest tests (shards)
+#     so `ctest -j` runs them in parallel. After each build of <target>,
+#     the executable gets run with `--list-shards <count>` which lists
+#     the test cases matching TEST_SPEC (all but the hidden ones by
+#     default), split in shards of about the same duration according to
+#     the durations saved in the HISTORY file. The new binary has a new
+#     build ID, so the most recent duration of each test case gets used
+#     whatever the build which saved it. It does not run the tests.
+#
+#     Each shard runs with its own `--tmp-dir <TMP_DIR>/shard-<index>`,
+#     the shared `--history <HISTORY>` and, when SEED is defined, the
+#     same `--seed` so a test case gets the same random numbers whatever
+#     its shard. The tests are named `<TEST_PREFIX>shard-<index>`.
+#
+#     SHARDS defaults to the number of processors, TMP_DIR to
+#     `${CMAKE_CURRENT_BINARY_DIR}/<target>-tmp`, HISTORY to
+#     `<TMP_DIR>.history`, TEST_PREFIX to `<target>:` and
+#     WORKING_DIRECTORY to `${CMAKE_CURRENT_BINARY_DIR}`. The PROPERTIES
+#     are added to each test with set_tests_properties().
 #
 # License:
 #
@@ -34,11 +76,132 @@ find_path(
         ENV SNAPCATCH2_INCLUDE_DIR
 )
 
+find_library(
+    SNAPCATCH2_LIBRARY
+        snapcatch2
+
+    PATHS
+        ENV SNAPCATCH2_LIBRARY
+)
+
 mark_as_advanced(
     SNAPCATCH2_INCLUDE_DIR
+    SNAPCATCH2_LIBRARY
 )
 
 set(SNAPCATCH2_INCLUDE_DIRS ${SNAPCATCH2_INCLUDE_DIR})
+set(SNAPCATCH2_LIBRARIES ${SNAPCATCH2_LIBRARY})
+
+if(SNAPCATCH2_INCLUDE_DIR AND SNAPCATCH2_LIBRARY AND NOT TARGET SnapCatch2::SnapCatch2)
+    find_package(Threads REQUIRED)
+
+    add_library(SnapCatch2::SnapCatch2 STATIC IMPORTED)
+    set_target_properties(SnapCatch2::SnapCatch2
+        PROPERTIES
+            IMPORTED_LOCATION "${SNAPCATCH2_LIBRARY}"
+            INTERFACE_INCLUDE_DIRECTORIES "${SNAPCATCH2_INCLUDE_DIR}"
+            INTERFACE_COMPILE_DEFINITIONS "SNAP_CATCH2_USE_LIBRARY"
+            INTERFACE_LINK_LIBRARIES "Threads::Threads;${CMAKE_DL_LIBS}"
+    )
+endif()
+
+set(_SNAPCATCH2_ADD_TESTS_SCRIPT ${CMAKE_CURRENT_LIST_DIR}/SnapCatch2AddTests.cmake)
+
+function(SnapCatch2PrecompileHeaders TARGET)
+    cmake_parse_arguments(PARSE_ARGV 1 SNAPCATCH2_PCH "" "" "SKIP")
+
+    if(CMAKE_VERSION VERSION_LESS 3.16)
+        message(STATUS "SnapCatch2: cmake ${CMAKE_VERSION} does not support precompiled headers.")
+        return()
+    endif()
+
+    target_precompile_headers(${TARGET}
+        PRIVATE
+            <catch2/snapcatch2.hpp>
+    )
+
+    if(SNAPCATCH2_PCH_SKIP)
+        set_source_files_properties(${SNAPCATCH2_PCH_SKIP}
+            PROPERTIES
+                SKIP_PRECOMPILE_HEADERS ON
+        )
+    endif()
+endfunction()
+
+function(snapcatch2_add_tests TARGET)
+    cmake_parse_arguments(PARSE_ARGV 1 SNAPCATCH2_TESTS
+        ""
+        "SHARDS;TMP_DIR;HISTORY;SEED;TEST_PREFIX;WORKING_DIRECTORY"
+        "TEST_SPEC;EXTRA_ARGS;PROPERTIES"
+    )
+
+    if(NOT SNAPCATCH2_TESTS_SHARDS)
+        include(ProcessorCount)
+        ProcessorCount(SNAPCATCH2_TESTS_SHARDS)
+        if(SNAPCATCH2_TESTS_SHARDS EQUAL 0)
+            set(SNAPCATCH2_TESTS_SHARDS 1)
+        endif()
+    endif()
+    if(NOT SNAPCATCH2_TESTS_TMP_DIR)
+        set(SNAPCATCH2_TESTS_TMP_DIR ${CMAKE_CURRENT_BINARY_DIR}/${TARGET}-tmp)
+    endif()
+    if(NOT SNAPCATCH2_TESTS_HISTORY)
+        set(SNAPCATCH2_TESTS_HISTORY ${SNAPCATCH2_TESTS_TMP_DIR}.history)
+    endif()
+    if(NOT DEFINED SNAPCATCH2_TESTS_TEST_PREFIX)
+        set(SNAPCATCH2_TESTS_TEST_PREFIX "${TARGET}:")
+    endif()
+    if(NOT SNAPCATCH2_TESTS_WORKING_DIRECTORY)
+        set(SNAPCATCH2_TESTS_WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR})
+    endif()
+
+    # lists are passed with $<SEMICOLON> so they do not get split in
+    # several arguments of the command
+    #
+    string(REPLACE ";" "$<SEMICOLON>" test_spec "${SNAPCATCH2_TESTS_TEST_SPEC}")
+    string(REPLACE ";" "$<SEMICOLON>" extra_args "${SNAPCATCH2_TESTS_EXTRA_ARGS}")
+    string(REPLACE ";" "$<SEMICOLON>" properties "${SNAPCATCH2_TESTS_PROPERTIES}")
+
+    set(ctest_include_file "${CMAKE_CURRENT_BINARY_DIR}/${TARGET}_include.cmake")
+    set(ctest_tests_file "${CMAKE_CURRENT_BINARY_DIR}/${TARGET}_shards.cmake")
+
+    add_custom_command(
+        TARGET ${TARGET} POST_BUILD
+        BYPRODUCTS "${ctest_tests_file}"
+        COMMAND "${CMAKE_COMMAND}"
+            -D "TEST_EXECUTABLE=$<TARGET_FILE:${TARGET}>"
+            -D "TEST_SHARDS=${SNAPCATCH2_TESTS_SHARDS}"
+            -D "TEST_SPEC=${test_spec}"
+            -D "TEST_EXTRA_ARGS=${extra_args}"
+            -D "TEST_TMP_DIR=${SNAPCATCH2_TESTS_TMP_DIR}"
+            -D "TEST_HISTORY=${SNAPCATCH2_TESTS_HISTORY}"
+            -D "TEST_SEED=${SNAPCATCH2_TESTS_SEED}"
+            -D "TEST_PREFIX=${SNAPCATCH2_TESTS_TEST_PREFIX}"
+            -D "TEST_WORKING_DIR=${SNAPCATCH2_TESTS_WORKING_DIRECTORY}"
+            -D "TEST_PROPERTIES=${properties}"
+            -D "TEST_SHARD_PREFIX=${CMAKE_CURRENT_BINARY_DIR}/${TARGET}-shard-"
+            -D "CTEST_FILE=${ctest_tests_file}"
+            -P "${_SNAPCATCH2_ADD_TESTS_SCRIPT}"
+        VERBATIM
+    )
+
+    # the shards are only known once the target was built
+    #
+    file(WRITE "${ctest_include_file}"
+        "if(EXISTS \"${ctest_tests_file}\")\n"
+        "    include(\"${ctest_tests_file}\")\n"
+        "else()\n"
+        "    add_test(${TARGET}_NOT_BUILT ${TARGET}_NOT_BUILT)\n"
+        "endif()\n"
+    )
+
+    set_property(
+        DIRECTORY
+        APPEND
+        PROPERTY
+            TEST_INCLUDE_FILES "${ctest_include_file}"
+    )
+endfunction()
 
 include(FindPackageHandleStandardArgs)
 
@@ -0,0 +1,38 @@
+// Copyright (c) 2019-2022  Made to Order Software Corp.  All Rights Reserved.
+//
+// https://snapwebsites.org/project/snapcatch2
+// contact@m2osw.com
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+/** \file
+ * \brief The prebuilt snapcatch2 runner.
+ *
+ * This file compiles the catch2 implementation and the snapcatch2 runner
+ * (i.e. snap_catch2_main()) once, in libsnapcatch2.a. A test which links
+ * against that library defines SNAP_CATCH2_USE_LIBRARY instead of
+ * CATCH_CONFIG_RUNNER in its main.cpp file. The SnapCatch2::SnapCatch2
+ * imported target does that for you.
+ */
+
+#define CATCH_CONFIG_RUNNER
+#ifndef CATCH_CONFIG_PREFIX_ALL
+#define CATCH_CONFIG_PREFIX_ALL
+#endif
+#define SNAP_CATCH2_BUILDING_LIBRARY
+#include    "snapcatch2.hpp"
+
+
+// vim: ts=4 sw=4 et
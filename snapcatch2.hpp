@@ -18,16 +18,103 @@
 // 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 #pragma once
 
+// benchmarking is always on: the library (snapcatch2.cpp) is compiled
+// with it and all the translation units of a test must see the same
+// catch2 classes, so it has to be turned on before catch.hpp gets included
+//
+#if defined(TWOBLUECUBES_SINGLE_INCLUDE_CATCH_HPP_INCLUDED) \
+ && !defined(CATCH_CONFIG_ENABLE_BENCHMARKING)
+#error "include snapcatch2.hpp before catch.hpp (CATCH_CONFIG_ENABLE_BENCHMARKING is required)."
+#endif
+#ifndef CATCH_CONFIG_ENABLE_BENCHMARKING
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#endif
+
 #include <catch2/catch.hpp>
 
 // C++ lib
 //
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cxxabi.h>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
 
 // C lib
 //
+#include <ctype.h>
+#include <dirent.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <linux/fs.h>
+#include <linux/magic.h>
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <poll.h>
+#include <pthread.h>
+#include <regex.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/vfs.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+#if defined(SNAP_CATCH2_USE_LIBRARY) && !defined(CATCH_CONFIG_RUNNER)
+// the catch2 session and command line parser are only defined along
+// the implementation (i.e. in libsnapcatch2.a)
+//
+namespace Catch
+{
+class Session;
+namespace clara
+{
+namespace detail
+{
+struct Parser;
+}
+using detail::Parser;
+}
+}
+#endif
 
 
 /** \brief Namespace declaration.
@@ -111,632 +198,11523 @@ inline std::string & g_tmp_dir()
 }
 
 
-namespace detail
+/** \brief How restore_fixture() copies the files of a fixture.
+ */
+enum class fixture_copy_t
 {
+    FIXTURE_COPY_AUTO,          // reflink if possible, copy otherwise
+    FIXTURE_COPY_HARDLINK,      // hard link (files must not be modified)
+    FIXTURE_COPY_COPY,          // always copy the data
+};
+
 
-inline void init_tmp_dir(std::string const & project_name)
+namespace detail
 {
-    std::string & path(g_tmp_dir());
 
-    // make sure it's not just "/tmp" since we're about to delete it
-    // with `rm -rf ...`
-    //
-    if(path == "/tmp")
+
+/** \brief Delete the files of a directory tree in parallel.
+ *
+ * This class removes all the files found in a directory tree. The
+ * directories are handed to a set of threads so sub-directories get
+ * cleaned up in parallel. The directories themselves are removed once
+ * all the threads are done, deepest first.
+ *
+ * The class only uses the `*at()` functions (openat(), unlinkat(),
+ * fdopendir()) relative to a file descriptor of the top directory
+ * so it does not follow symbolic links and does not need to rebuild
+ * full paths on each call.
+ */
+class tree_remover
+{
+public:
+    tree_remover(int root_fd)
+        : m_root_fd(root_fd)
     {
-        std::cerr
-            << "fatal error: temporary directory cannot be \"/tmp\"."
-              " It needs to include a sub-directory (\"/tmp/"
-            << project_name
-            << "\", for example)."
-            << std::endl;
-        exit(1);
     }
 
-    // default to /tmp/<project-name> if not defined
-    //
-    if(path.empty())
+    /** \brief Remove everything found in the root directory.
+     *
+     * On return, the root directory is empty (unless an error occurred).
+     * It is not itself removed.
+     *
+     * \return true if all the files and directories were removed.
+     */
+    bool run()
     {
-        // TODO: make sure "project_name" is "clean" (spaces -> '_', slashes?)
+        m_pending.push_back(".");
+        m_pending_count = 1;
+
+        std::size_t count(std::thread::hardware_concurrency());
+        count = std::max(static_cast<std::size_t>(1), std::min(count, static_cast<std::size_t>(16)));
+        std::vector<std::thread> threads;
+        for(std::size_t idx(1); idx < count; ++idx)
+        {
+            threads.emplace_back(&tree_remover::worker, this);
+        }
+        worker();
+        for(auto & t : threads)
+        {
+            t.join();
+        }
+
+        // a sub-directory is always found after its parent so going
+        // backward removes the deepest directories first
         //
-        path = "/tmp/" + project_name;
+        for(auto it(m_directories.rbegin()); it != m_directories.rend(); ++it)
+        {
+            if(unlinkat(m_root_fd, it->c_str(), AT_REMOVEDIR) != 0
+            && errno != ENOENT)
+            {
+                m_success = false;
+            }
+        }
+
+        return m_success;
     }
 
-    // delete the directory if it exists
-    //
-    // this ensure an equivalent state each time we run the tests
+private:
+    void worker()
     {
-        std::stringstream ss;
-        ss << "rm -rf \"" << path << "\"";
-        if(system(ss.str().c_str()) != 0)
+        for(;;)
         {
-            std::cerr
-                << "fatal error: could not delete temporary directory \""
-                << path
-                << "\".";
-            exit(1);
+            std::string dir;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]() { return !m_pending.empty() || m_pending_count == 0; });
+                if(m_pending.empty())
+                {
+                    return;
+                }
+                dir = std::move(m_pending.back());
+                m_pending.pop_back();
+            }
+
+            std::vector<std::string> subdirs;
+            if(!clear_directory(dir, subdirs))
+            {
+                m_success = false;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                for(auto & s : subdirs)
+                {
+                    m_directories.push_back(s);
+                    m_pending.push_back(std::move(s));
+                }
+                m_pending_count += subdirs.size();
+                --m_pending_count;
+            }
+            m_cond.notify_all();
         }
     }
 
-    // create the directory
+    bool clear_directory(std::string const & dir, std::vector<std::string> & subdirs)
     {
-        std::stringstream ss;
-        ss << "mkdir -p \"" << path << "\"";
-        if(system(ss.str().c_str()) != 0)
+        int const fd(openat(m_root_fd, dir.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+        if(fd < 0)
+        {
+            return errno == ENOENT;
+        }
+        DIR * d(fdopendir(fd));
+        if(d == nullptr)
+        {
+            close(fd);
+            return false;
+        }
+
+        bool success(true);
+        for(;;)
         {
-            std::cerr
-                << "fatal error: could not create temporary directory \""
-                << path
-                << "\".";
-            exit(1);
+            struct dirent * e(readdir(d));
+            if(e == nullptr)
+            {
+                break;
+            }
+            if(strcmp(e->d_name, ".") == 0
+            || strcmp(e->d_name, "..") == 0)
+            {
+                continue;
+            }
+
+            bool is_dir(e->d_type == DT_DIR);
+            if(e->d_type == DT_UNKNOWN)
+            {
+                struct stat st = {};
+                if(fstatat(fd, e->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+                {
+                    is_dir = S_ISDIR(st.st_mode);
+                }
+            }
+            if(is_dir)
+            {
+                subdirs.push_back(dir + "/" + e->d_name);
+            }
+            else if(unlinkat(fd, e->d_name, 0) != 0
+                 && errno != ENOENT)
+            {
+                success = false;
+            }
         }
+        closedir(d);
+
+        return success;
     }
-}
 
-} // detail namespace
+    int                         m_root_fd = -1;
+    std::mutex                  m_mutex = {};
+    std::condition_variable     m_cond = {};
+    std::vector<std::string>    m_pending = std::vector<std::string>();
+    std::size_t                 m_pending_count = 0;
+    std::vector<std::string>    m_directories = std::vector<std::string>();
+    std::atomic<bool>           m_success = { true };
+};
 
 
-/** \brief Print out information to let programmers know what tests are doing.
+/** \brief Delete a file or a directory tree.
  *
- * This flag is used whenever useful information could be outputted. The
- * flag let the test know whether to print that information or not.
+ * This function is the native equivalent of `rm -rf <path>`. If the
+ * path does not exist, the function returns true. If it is not a
+ * directory (i.e. a file or a symbolic link), it gets unlinked.
  *
- * You are welcome to use the parameter in your own code. Just make sure
- * to use the parenthesis:
+ * \param[in] path  The path to delete.
  *
- * \code
- *     if(g_verbose())
- *     {
- *         std::cout << "More info about this test!" << std::endl;
- *     }
- * \endcode
+ * \return true if the path does not exist anymore.
+ */
+inline bool remove_tree(std::string const & path)
+{
+    int const fd(open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+    if(fd < 0)
+    {
+        if(errno == ENOENT)
+        {
+            return true;
+        }
+        if(errno == ENOTDIR
+        || errno == ELOOP)
+        {
+            return unlink(path.c_str()) == 0 || errno == ENOENT;
+        }
+        return false;
+    }
+
+    bool const success(tree_remover(fd).run());
+    close(fd);
+
+    return success
+        && (rmdir(path.c_str()) == 0 || errno == ENOENT);
+}
+
+
+/** \brief Create a directory and its parents.
  *
- * \return A read-write reference to the `verbose` parameter.
+ * This function is the native equivalent of `mkdir -p <path>`.
+ *
+ * \param[in] path  The path of the directory to create.
+ *
+ * \return true if the directory exists on return.
  */
-inline bool & g_verbose()
+inline bool make_directories(std::string const & path)
 {
-    static bool verbose = false;
+    std::string::size_type pos(0);
+    for(;;)
+    {
+        pos = path.find('/', pos + 1);
+        std::string const segment(path.substr(0, pos));
+        if(mkdir(segment.c_str(), 0777) != 0
+        && errno != EEXIST)
+        {
+            return false;
+        }
+        if(pos == std::string::npos)
+        {
+            break;
+        }
+    }
 
-    return verbose;
+    struct stat st = {};
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
 }
 
 
-#ifdef CATCH_CONFIG_RUNNER
-/** \brief The main function to initialize and run the unit tests.
+/** \brief Copy a directory tree.
  *
- * This inline function initializes and runs the snapcatch2 tests.
+ * The directories and symbolic links are created first, then the files
+ * get copied by a set of threads. Each file is cloned with the FICLONE
+ * ioctl() when the file system supports reflinks (btrfs, xfs...), so
+ * the copy is instantaneous and the blocks get shared until modified.
+ * Otherwise the data is copied with copy_file_range(), or read() and
+ * write() as a last resort.
  *
- * The \p init_callback parameter is used to initialize your test before
- * we parse the command line. Use the \p callback function to do further
- * initialization after the command line is parsed and basic functions
- * run (i.e. the `--version` command line option will run and the
- * function exit before \p callback gets called. So when the user uses
- * that command line option, you do not get \p callback called, however,
- * \p init_callback will always be called.)
+ * With FIXTURE_COPY_HARDLINK, the files are hard linked instead. This
+ * is the fastest but the test must not modify the files in place.
+ */
+class tree_copier
+{
+public:
+    tree_copier(fixture_copy_t mode)
+        : m_mode(mode)
+    {
+    }
+
+    bool run(std::string const & source, std::string const & destination)
+    {
+        if(!walk(source, destination))
+        {
+            return false;
+        }
+
+        std::size_t count(std::min<std::size_t>(
+                      std::max(1U, std::thread::hardware_concurrency())
+                    , m_files.size() / 16 + 1));
+        std::vector<std::thread> threads;
+        for(std::size_t idx(1); idx < count; ++idx)
+        {
+            threads.emplace_back(&tree_copier::copy_files, this);
+        }
+        copy_files();
+        for(auto & t : threads)
+        {
+            t.join();
+        }
+
+        return m_success;
+    }
+
+private:
+    struct file_t
+    {
+        std::string     m_source = std::string();
+        std::string     m_destination = std::string();
+        mode_t          m_mode = 0;
+    };
+
+    bool walk(std::string const & source, std::string const & destination)
+    {
+        struct stat st = {};
+        if(stat(source.c_str(), &st) != 0
+        || (mkdir(destination.c_str(), st.st_mode & 07777) != 0 && errno != EEXIST))
+        {
+            return false;
+        }
+
+        DIR * d(opendir(source.c_str()));
+        if(d == nullptr)
+        {
+            return false;
+        }
+        bool success(true);
+        for(;;)
+        {
+            struct dirent * e(readdir(d));
+            if(e == nullptr)
+            {
+                break;
+            }
+            if(strcmp(e->d_name, ".") == 0
+            || strcmp(e->d_name, "..") == 0)
+            {
+                continue;
+            }
+            std::string const src(source + '/' + e->d_name);
+            std::string const dst(destination + '/' + e->d_name);
+            if(lstat(src.c_str(), &st) != 0)
+            {
+                success = false;
+                break;
+            }
+            if(S_ISDIR(st.st_mode))
+            {
+                success = walk(src, dst);
+            }
+            else if(S_ISLNK(st.st_mode))
+            {
+                std::vector<char> target(static_cast<std::size_t>(st.st_size) + 1);
+                ssize_t const l(readlink(src.c_str(), target.data(), target.size()));
+                success = l >= 0
+                       && symlink(std::string(target.data(), static_cast<std::size_t>(l)).c_str(), dst.c_str()) == 0;
+            }
+            else if(S_ISREG(st.st_mode))
+            {
+                m_files.push_back(file_t{ src, dst, static_cast<mode_t>(st.st_mode & 07777) });
+            }
+            if(!success)
+            {
+                break;
+            }
+        }
+        closedir(d);
+
+        return success;
+    }
+
+    void copy_files()
+    {
+        for(;;)
+        {
+            std::size_t const idx(m_next.fetch_add(1));
+            if(idx >= m_files.size()
+            || !m_success)
+            {
+                return;
+            }
+            if(!copy_file(m_files[idx]))
+            {
+                m_success = false;
+            }
+        }
+    }
+
+    bool copy_file(file_t const & f)
+    {
+        if(m_mode == fixture_copy_t::FIXTURE_COPY_HARDLINK
+        && link(f.m_source.c_str(), f.m_destination.c_str()) == 0)
+        {
+            return true;
+        }
+
+        int const in(open(f.m_source.c_str(), O_RDONLY | O_CLOEXEC));
+        if(in < 0)
+        {
+            return false;
+        }
+        int const out(open(f.m_destination.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, f.m_mode));
+        if(out < 0)
+        {
+            close(in);
+            return false;
+        }
+
+        bool success(false);
+        if(m_mode == fixture_copy_t::FIXTURE_COPY_AUTO
+        && m_reflink)
+        {
+            success = ioctl(out, FICLONE, in) == 0;
+            if(!success)
+            {
+                // EOPNOTSUPP, EXDEV, EINVAL... do not try again
+                //
+                m_reflink = false;
+            }
+        }
+        if(!success)
+        {
+            success = copy_data(in, out);
+        }
+
+        close(in);
+        return close(out) == 0 && success;
+    }
+
+    bool copy_data(int in, int out)
+    {
+        if(m_copy_file_range)
+        {
+            for(;;)
+            {
+                ssize_t const r(copy_file_range(in, nullptr, out, nullptr, 1024 * 1024 * 1024, 0));
+                if(r == 0)
+                {
+                    return true;
+                }
+                if(r < 0)
+                {
+                    if(errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if(errno != ENOSYS
+                    && errno != EXDEV
+                    && errno != EINVAL
+                    && errno != EOPNOTSUPP)
+                    {
+                        return false;
+                    }
+                    m_copy_file_range = false;
+                    break;
+                }
+            }
+        }
+
+        std::vector<char> buffer(64 * 1024);
+        for(;;)
+        {
+            ssize_t const r(read(in, buffer.data(), buffer.size()));
+            if(r == 0)
+            {
+                return true;
+            }
+            if(r < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            for(ssize_t pos(0); pos < r; )
+            {
+                ssize_t const w(write(out, buffer.data() + pos, static_cast<std::size_t>(r - pos)));
+                if(w < 0)
+                {
+                    if(errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return false;
+                }
+                pos += w;
+            }
+        }
+    }
+
+    fixture_copy_t              m_mode = fixture_copy_t::FIXTURE_COPY_AUTO;
+    std::vector<file_t>         m_files = std::vector<file_t>();
+    std::atomic<std::size_t>    m_next = { 0 };
+    std::atomic<bool>           m_success = { true };
+    std::atomic<bool>           m_reflink = { true };
+    std::atomic<bool>           m_copy_file_range = { true };
+};
+
+
+/** \brief The thread deleting old temporary directories.
  *
- * We do it this way because the function will try/catch std::exception
- * so if an exception occurs in your \p init_callback, it will always
- * be captured and a message printed out before the application
- * exits cleanly with an error code (i.e. `exit(1)`).
+ * When the `--tmp-dir-async-cleanup` command line option is used, the
+ * old temporary directory gets renamed and this thread deletes it while
+ * the tests run. The destructor waits for the thread to be done.
+ */
+struct background_remover
+{
+    ~background_remover()
+    {
+        if(m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    std::thread     m_thread = std::thread();
+};
+
+
+inline background_remover & g_background_remover()
+{
+    static background_remover remover;
+
+    return remover;
+}
+
+
+/** \brief Rename the temporary directory and delete it in the background.
  *
- * The \p init_callback can be set to a nullptr if you do not need to
- * initialize anything futher early on.
+ * The directory gets renamed to `<path>.deleting-<pid>` and a thread is
+ * started to delete it. This function also picks up any such directory
+ * left behind by a previous run which was interrupted before the
+ * background thread was done.
  *
- * One thing we use the \p init_callback for is to prevent our
- * libexcept exceptions from generating a stack trace because that's
- * very slow and in a test which generate thousands if not million
- * of exception cases, it makes it really very slow.
+ * \param[in] path  The temporary directory to delete.
+ *
+ * \return true if the directory does not exist anymore under \p path.
+ */
+inline bool remove_tree_in_background(std::string const & path)
+{
+    std::string::size_type const slash(path.rfind('/'));
+    std::string const parent(slash == std::string::npos
+                                ? std::string(".")
+                                : (slash == 0 ? std::string("/") : path.substr(0, slash)));
+    std::string const prefix((slash == std::string::npos ? path : path.substr(slash + 1)) + ".deleting-");
+
+    std::string const aside(path + ".deleting-" + std::to_string(getpid()));
+    if(rename(path.c_str(), aside.c_str()) != 0
+    && errno != ENOENT)
+    {
+        return false;
+    }
+
+    std::vector<std::string> old_trees;
+    DIR * d(opendir(parent.c_str()));
+    if(d != nullptr)
+    {
+        for(;;)
+        {
+            struct dirent * e(readdir(d));
+            if(e == nullptr)
+            {
+                break;
+            }
+            if(strncmp(e->d_name, prefix.c_str(), prefix.length()) == 0)
+            {
+                old_trees.push_back(parent + "/" + e->d_name);
+            }
+        }
+        closedir(d);
+    }
+
+    if(!old_trees.empty())
+    {
+        background_remover & remover(g_background_remover());
+        if(remover.m_thread.joinable())
+        {
+            remover.m_thread.join();
+        }
+        remover.m_thread = std::thread([old_trees]()
+            {
+                for(auto const & t : old_trees)
+                {
+                    remove_tree(t);
+                }
+            });
+    }
+
+    return true;
+}
+
+
+/** \brief Check whether a directory is on a tmpfs file system.
+ *
+ * \param[in] path  The directory to check.
+ *
+ * \return true if \p path is a writable directory in memory.
+ */
+inline bool is_tmpfs(std::string const & path)
+{
+    struct statfs st = {};
+    return statfs(path.c_str(), &st) == 0
+        && st.f_type == TMPFS_MAGIC
+        && access(path.c_str(), W_OK) == 0;
+}
+
+
+inline void init_tmp_dir(
+      std::string const & project_name
+    , bool async_cleanup = false
+    , bool in_memory = false)
+{
+    std::string & path(g_tmp_dir());
+
+    // make sure it's not just "/tmp" since we're about to delete it
+    // recursively (i.e. `rm -rf ...`)
+    //
+    if(path == "/tmp")
+    {
+        std::cerr
+            << "fatal error: temporary directory cannot be \"/tmp\"."
+              " It needs to include a sub-directory (\"/tmp/"
+            << project_name
+            << "\", for example)."
+            << std::endl;
+        exit(1);
+    }
+
+    // default to /tmp/<project-name> if not defined
+    // or /dev/shm/<project-name> with --tmp-dir-in-memory
+    //
+    if(path.empty())
+    {
+        // TODO: make sure "project_name" is "clean" (spaces -> '_', slashes?)
+        //
+        path = (in_memory && is_tmpfs("/dev/shm") ? "/dev/shm/" : "/tmp/") + project_name;
+    }
+
+    // delete the directory if it exists
+    //
+    // this ensure an equivalent state each time we run the tests
+    if(!(async_cleanup
+            ? remove_tree_in_background(path)
+            : remove_tree(path)))
+    {
+        std::cerr
+            << "fatal error: could not delete temporary directory \""
+            << path
+            << "\".";
+        exit(1);
+    }
+
+    // create the directory
+    if(!make_directories(path))
+    {
+        std::cerr
+            << "fatal error: could not create temporary directory \""
+            << path
+            << "\".";
+        exit(1);
+    }
+}
+
+} // detail namespace
+
+
+namespace detail
+{
+
+
+/** \brief The state of the temporary directory of the current test case.
+ *
+ * The listener saves the name of the test case when it starts and
+ * g_test_tmp_dir() creates the directory the first time it gets called.
+ */
+struct test_tmp_dir_state
+{
+    std::string     m_test_case = std::string();
+    std::string     m_path = std::string();
+};
+
+
+inline test_tmp_dir_state & g_test_tmp_dir_state()
+{
+    static test_tmp_dir_state state;
+
+    return state;
+}
+
+
+inline void start_test_tmp_dir(std::string const & test_case)
+{
+    test_tmp_dir_state & state(g_test_tmp_dir_state());
+    state.m_test_case = test_case;
+    state.m_path.clear();
+}
+
+
+} // detail namespace
+
+
+/** \brief Retrieve the temporary directory of the current test case.
+ *
+ * Each test case gets its own sub-directory under g_tmp_dir(), named
+ * after the test case (characters other than letters, digits, '.', '-'
+ * and '_' are replaced by '_'). The directory is created the first time
+ * this function gets called by that test case so test cases which do not
+ * use it do not cost anything.
+ *
+ * The directory is shared by all the sections of the test case. Use
+ * restore_fixture() to reset its content.
+ *
+ * \return The path to the temporary directory of the current test case.
+ */
+inline std::string const & g_test_tmp_dir()
+{
+    detail::test_tmp_dir_state & state(detail::g_test_tmp_dir_state());
+    if(state.m_path.empty())
+    {
+        std::string name(state.m_test_case.empty() ? std::string("no-test-case") : state.m_test_case);
+        for(auto & c : name)
+        {
+            if(!isalnum(static_cast<unsigned char>(c))
+            && c != '.'
+            && c != '-'
+            && c != '_')
+            {
+                c = '_';
+            }
+        }
+        std::string const parent(g_tmp_dir() + "/test-cases");
+        if(!detail::make_directories(parent))
+        {
+            throw std::runtime_error("could not create directory \"" + parent + "\".");
+        }
+
+        // two names may end up the same once cleaned up
+        //
+        std::string path(parent + '/' + name);
+        for(int idx(2); mkdir(path.c_str(), 0777) != 0; ++idx)
+        {
+            if(errno != EEXIST)
+            {
+                throw std::runtime_error("could not create directory \"" + path + "\".");
+            }
+            path = parent + '/' + name + '-' + std::to_string(idx);
+        }
+        state.m_path = path;
+    }
+
+    return state.m_path;
+}
+
+
+/** \brief Restore a fixture tree in the test case temporary directory.
+ *
+ * The first time a fixture gets restored, the \p create function is
+ * called with the path of an empty directory (under
+ * `<tmp-dir>/fixtures/`) where it creates the fixture tree. That tree is
+ * the snapshot.
+ *
+ * Each call then replaces `g_test_tmp_dir()/<name>` with a copy of that
+ * snapshot. By default, files are cloned with reflinks when the file
+ * system supports them, or copied in parallel otherwise. With
+ * FIXTURE_COPY_HARDLINK, the files are hard linked, which is only valid
+ * if the test does not modify them in place.
  *
  * \code
- *     snap_catch2_main(
- *           "libutf8"
- *         , "1.2.3"
- *         , argc
- *         , argv
- *         , []() { libexcept::set_collect_stack(libexcept::collect_stack_t::COLLECT_STACK_NO); }
- *     );
+ *     std::string const root(SNAP_CATCH2_NAMESPACE::restore_fixture(
+ *               "website"
+ *             , [](std::string const & path)
+ *               {
+ *                   ...create files under path...
+ *               }));
  * \endcode
  *
- * The \p add_user_options parameter is a pointer to a function which
- * adds command line options supported by your test. This pointer can
- * be set to nullptr, For example, if you wanted to support a path to
- * a temporary directory, you would write:
+ * \exception std::runtime_error
+ * The fixture could not be created or restored.
+ *
+ * \param[in] name  The name of the fixture.
+ * \param[in] create  The function creating the fixture tree.
+ * \param[in] mode  How the files get copied.
+ *
+ * \return The path to the restored tree.
+ */
+inline std::string restore_fixture(
+      std::string const & name
+    , std::function<void(std::string const & path)> const & create
+    , fixture_copy_t mode = fixture_copy_t::FIXTURE_COPY_AUTO)
+{
+    std::string const snapshot(g_tmp_dir() + "/fixtures/" + name);
+    struct stat st = {};
+    if(stat(snapshot.c_str(), &st) != 0)
+    {
+        // create it under a temporary name so a failed create() does not
+        // leave a partial snapshot behind
+        //
+        std::string const tmp(snapshot + ".creating");
+        if(!detail::remove_tree(tmp)
+        || !detail::make_directories(tmp))
+        {
+            throw std::runtime_error("could not create fixture directory \"" + tmp + "\".");
+        }
+        create(tmp);
+        if(rename(tmp.c_str(), snapshot.c_str()) != 0)
+        {
+            throw std::runtime_error("could not rename fixture directory \"" + tmp + "\".");
+        }
+    }
+
+    std::string const path(g_test_tmp_dir() + '/' + name);
+    if(!detail::remove_tree(path)
+    || !detail::tree_copier(mode).run(snapshot, path))
+    {
+        throw std::runtime_error("could not restore fixture \"" + name + "\" to \"" + path + "\".");
+    }
+
+    return path;
+}
+
+
+/** \brief Number of lines of context shown around differences.
+ *
+ * When CATCH_REQUIRE_LONG_STRING() finds differences, it shows this
+ * many lines before and after each group of changes. The default is 3,
+ * like `diff -u`. CATCH_REQUIRE_LONG_BUFFER() shows that many lines of
+ * its hexdump. It can be changed with the `--diff-context` command
+ * line option.
+ *
+ * \return A read-write reference to the `diff_context` parameter.
+ */
+inline std::size_t & g_diff_context()
+{
+    static std::size_t diff_context = 3;
+
+    return diff_context;
+}
+
+
+/** \brief The directory of the golden files.
+ *
+ * The CATCH_REQUIRE_MATCHES_GOLDEN() macro searches the golden files in
+ * this directory. It defaults to SNAP_CATCH2_GOLDEN_DIR when defined
+ * (i.e. a path in your source tree defined in your CMakeLists.txt) or
+ * the current directory. It can be changed with the `--golden-dir`
+ * command line option.
+ *
+ * \return A read-write reference to the golden directory.
+ */
+inline std::string & g_golden_dir()
+{
+#ifdef SNAP_CATCH2_GOLDEN_DIR
+    static std::string golden_dir = SNAP_CATCH2_GOLDEN_DIR;
+#else
+    static std::string golden_dir = std::string();
+#endif
+
+    return golden_dir;
+}
+
+
+/** \brief Whether the golden files get updated.
+ *
+ * With the `--update-golden` command line option, the golden files
+ * which do not match are replaced by the new data instead of failing.
+ *
+ * \return A read-write reference to the `update_golden` flag.
+ */
+inline bool & g_update_golden()
+{
+    static bool update_golden = false;
+
+    return update_golden;
+}
+
+
+/** \brief Print out information to let programmers know what tests are doing.
+ *
+ * This flag is used whenever useful information could be outputted. The
+ * flag let the test know whether to print that information or not.
+ *
+ * You are welcome to use the parameter in your own code. Just make sure
+ * to use the parenthesis:
  *
  * \code
- *     namespace SNAP_CATCH2_NAMESPACE
+ *     if(g_verbose())
  *     {
+ *         std::cout << "More info about this test!" << std::endl;
+ *     }
+ * \endcode
  *
- *     std::string g_tmpdir= std::string("/tmp");
+ * \return A read-write reference to the `verbose` parameter.
+ */
+inline bool & g_verbose()
+{
+    static bool verbose = false;
+
+    return verbose;
+}
+
+
+/** \brief The workload scale of the heavy tests.
  *
- *     Catch::clara::Parser add_command_line_options(Catch::clara::Parser const & cli)
+ * Tests running loops with a hard-coded number of iterations can pass
+ * that number through scaled() so it can be adjusted with the `--scale`
+ * command line option. Without that option, the scale is 1.0 unless the
+ * tests run under valgrind or were compiled with a sanitizer, in which
+ * case it gets lowered automatically (see detail::detect_scale()).
+ *
+ * \code
+ *     for(std::size_t idx(0); idx < SNAP_CATCH2_NAMESPACE::scaled(1000000); ++idx)
  *     {
- *         return cli
- *              | Catch::clara::Opt(g_tmpdir, "tmpdir")
- *                   ["--tmpdir"]
- *                   ("a path to a temporary directory used by the test.");
+ *         ...
  *     }
+ * \endcode
  *
- *     }
+ * \return A read-write reference to the `scale` parameter.
+ */
+inline double & g_scale()
+{
+    static double scale = 1.0;
+
+    return scale;
+}
+
+
+/** \brief Scale a number of iterations.
  *
- *     ...snip...
+ * \param[in] iterations  The number of iterations at scale 1.0.
+ *
+ * \return \p iterations multiplied by g_scale(), at least 1 unless
+ * \p iterations is 0.
+ */
+inline std::size_t scaled(std::size_t iterations)
+{
+    if(iterations == 0)
+    {
+        return 0;
+    }
+    double const result(static_cast<double>(iterations) * g_scale());
+    return result < 1.0 ? 1 : static_cast<std::size_t>(result);
+}
+
+
+namespace detail
+{
+
+
+/** \brief Escape a string so it can be saved in a JSON file.
+ *
+ * \param[in] s  The string to escape.
+ *
+ * \return The string with quotes.
+ */
+inline std::string json_string(std::string const & s)
+{
+    std::string result("\"");
+    for(char const c : s)
+    {
+        switch(c)
+        {
+        case '"':
+            result += "\\\"";
+            break;
+
+        case '\\':
+            result += "\\\\";
+            break;
+
+        case '\n':
+            result += "\\n";
+            break;
+
+        case '\r':
+            result += "\\r";
+            break;
+
+        case '\t':
+            result += "\\t";
+            break;
+
+        default:
+            if(static_cast<unsigned char>(c) < 0x20)
+            {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                result += buf;
+            }
+            else
+            {
+                result += c;
+            }
+            break;
+
+        }
+    }
+    result += '"';
+    return result;
+}
+
+
+/** \brief A value read from a JSON file.
+ *
+ * This is a very small JSON parser used to read back the files we
+ * generate (i.e. benchmark baselines). It supports the entire JSON
+ * syntax, but it is not optimized for large files.
+ */
+struct json_value
+{
+    enum class type_t
+    {
+        JSON_NULL,
+        JSON_BOOLEAN,
+        JSON_NUMBER,
+        JSON_STRING,
+        JSON_ARRAY,
+        JSON_OBJECT,
+    };
+
+    json_value const * member(std::string const & name) const
+    {
+        for(auto const & m : m_members)
+        {
+            if(m.first == name)
+            {
+                return &m.second;
+            }
+        }
+        return nullptr;
+    }
+
+    double number(std::string const & name, double default_value = 0.0) const
+    {
+        json_value const * v(member(name));
+        return v == nullptr || v->m_type != type_t::JSON_NUMBER ? default_value : v->m_number;
+    }
+
+    std::string string(std::string const & name) const
+    {
+        json_value const * v(member(name));
+        return v == nullptr || v->m_type != type_t::JSON_STRING ? std::string() : v->m_string;
+    }
+
+    type_t                                          m_type = type_t::JSON_NULL;
+    bool                                            m_boolean = false;
+    double                                          m_number = 0.0;
+    std::string                                     m_string = std::string();
+    std::vector<json_value>                         m_items = std::vector<json_value>();
+    std::vector<std::pair<std::string, json_value>> m_members = std::vector<std::pair<std::string, json_value>>();
+};
+
+
+class json_parser
+{
+public:
+    json_parser(std::string const & input)
+        : m_input(input)
+    {
+    }
+
+    json_value parse()
+    {
+        json_value const result(value());
+        skip_spaces();
+        if(m_pos != m_input.length())
+        {
+            error("unexpected data after the JSON value");
+        }
+        return result;
+    }
+
+private:
+    [[noreturn]] void error(char const * message)
+    {
+        throw std::runtime_error(
+                  std::string("invalid JSON: ")
+                + message
+                + " at offset "
+                + std::to_string(m_pos)
+                + ".");
+    }
+
+    void skip_spaces()
+    {
+        while(m_pos < m_input.length() && isspace(static_cast<unsigned char>(m_input[m_pos])))
+        {
+            ++m_pos;
+        }
+    }
+
+    bool accept(char c)
+    {
+        skip_spaces();
+        if(m_pos < m_input.length() && m_input[m_pos] == c)
+        {
+            ++m_pos;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c)
+    {
+        if(!accept(c))
+        {
+            error("unexpected character");
+        }
+    }
+
+    bool keyword(char const * word)
+    {
+        std::size_t const len(strlen(word));
+        if(m_input.compare(m_pos, len, word) == 0)
+        {
+            m_pos += len;
+            return true;
+        }
+        return false;
+    }
+
+    std::string string()
+    {
+        expect('"');
+        std::string result;
+        for(;;)
+        {
+            if(m_pos >= m_input.length())
+            {
+                error("unterminated string");
+            }
+            char c(m_input[m_pos++]);
+            if(c == '"')
+            {
+                return result;
+            }
+            if(c == '\\')
+            {
+                if(m_pos >= m_input.length())
+                {
+                    error("unterminated string");
+                }
+                c = m_input[m_pos++];
+                switch(c)
+                {
+                case 'b':
+                    c = '\b';
+                    break;
+
+                case 'f':
+                    c = '\f';
+                    break;
+
+                case 'n':
+                    c = '\n';
+                    break;
+
+                case 'r':
+                    c = '\r';
+                    break;
+
+                case 't':
+                    c = '\t';
+                    break;
+
+                case 'u':
+                    {
+                        if(m_pos + 4 > m_input.length())
+                        {
+                            error("invalid \\u escape");
+                        }
+                        unsigned long const code(std::stoul(m_input.substr(m_pos, 4), nullptr, 16));
+                        m_pos += 4;
+                        if(code < 0x80)
+                        {
+                            c = static_cast<char>(code);
+                        }
+                        else if(code < 0x800)
+                        {
+                            result += static_cast<char>(0xC0 | (code >> 6));
+                            c = static_cast<char>(0x80 | (code & 0x3F));
+                        }
+                        else
+                        {
+                            result += static_cast<char>(0xE0 | (code >> 12));
+                            result += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                            c = static_cast<char>(0x80 | (code & 0x3F));
+                        }
+                    }
+                    break;
+
+                default:
+                    // '"', '\\', '/'
+                    break;
+
+                }
+            }
+            result += c;
+        }
+    }
+
+    json_value value()
+    {
+        json_value result;
+        skip_spaces();
+        if(m_pos >= m_input.length())
+        {
+            error("missing value");
+        }
+        char const c(m_input[m_pos]);
+        if(c == '{')
+        {
+            ++m_pos;
+            result.m_type = json_value::type_t::JSON_OBJECT;
+            if(!accept('}'))
+            {
+                do
+                {
+                    skip_spaces();
+                    std::string name(string());
+                    expect(':');
+                    result.m_members.emplace_back(std::move(name), value());
+                }
+                while(accept(','));
+                expect('}');
+            }
+        }
+        else if(c == '[')
+        {
+            ++m_pos;
+            result.m_type = json_value::type_t::JSON_ARRAY;
+            if(!accept(']'))
+            {
+                do
+                {
+                    result.m_items.push_back(value());
+                }
+                while(accept(','));
+                expect(']');
+            }
+        }
+        else if(c == '"')
+        {
+            result.m_type = json_value::type_t::JSON_STRING;
+            result.m_string = string();
+        }
+        else if(keyword("true"))
+        {
+            result.m_type = json_value::type_t::JSON_BOOLEAN;
+            result.m_boolean = true;
+        }
+        else if(keyword("false"))
+        {
+            result.m_type = json_value::type_t::JSON_BOOLEAN;
+        }
+        else if(keyword("null"))
+        {
+            // m_type defaults to JSON_NULL
+        }
+        else
+        {
+            char const * start(m_input.c_str() + m_pos);
+            char * end(nullptr);
+            result.m_type = json_value::type_t::JSON_NUMBER;
+            result.m_number = strtod(start, &end);
+            if(end == start)
+            {
+                error("unexpected character");
+            }
+            m_pos += static_cast<std::size_t>(end - start);
+        }
+        return result;
+    }
+
+    std::string const & m_input;
+    std::size_t         m_pos = 0;
+};
+
+
+/** \brief Load a JSON file.
+ *
+ * \exception std::runtime_error
+ * The function throws if the file cannot be read or is not valid JSON.
+ *
+ * \param[in] filename  The name of the file to load.
+ *
+ * \return The root value of the file.
+ */
+inline json_value load_json(std::string const & filename)
+{
+    std::ifstream in(filename);
+    if(!in)
+    {
+        throw std::runtime_error("could not open \"" + filename + "\".");
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string const content(ss.str());
+    return json_parser(content).parse();
+}
+
+
+} // detail namespace
+
+
+namespace detail
+{
+
+
+/** \brief The allocation counters of one thread.
+ *
+ * When the allocation tracking is compiled in (see
+ * SNAP_CATCH2_TRACK_ALLOCATIONS), the global operator new and operator
+ * delete update these counters. Each thread has its own set so the
+ * counters do not need to be atomic and a test does not see the
+ * allocations of other threads.
+ *
+ * All the byte counts are the usable size of the blocks as returned by
+ * malloc_usable_size(), which can be a little more than the size
+ * requested from operator new. That way the bytes allocated and the
+ * live bytes are comparable and a block allocated and freed leaves the
+ * live bytes unchanged.
+ */
+struct allocation_counters
+{
+    std::uint64_t       m_allocations = 0;
+    std::uint64_t       m_deallocations = 0;
+    std::uint64_t       m_bytes = 0;
+    std::uint64_t       m_live_bytes = 0;
+    std::uint64_t       m_peak_live_bytes = 0;
+};
+
+
+inline allocation_counters & thread_allocation_counters()
+{
+    static thread_local allocation_counters counters;
+
+    return counters;
+}
+
+
+/** \brief Whether the allocation tracking operators are installed.
+ *
+ * This flag is set to true on startup by the translation unit which
+ * defines the replacement operators.
+ *
+ * \return A read-write reference to the flag.
+ */
+inline bool & g_allocation_tracking()
+{
+    static bool tracking = false;
+
+    return tracking;
+}
+
+
+} // detail namespace
+
+
+/** \brief Count the allocations made by the current thread in a scope.
+ *
+ * Create an allocation_guard at the start of the code you want to
+ * check and query it at the end:
+ *
+ * \code
+ *     {
+ *         SNAP_CATCH2_NAMESPACE::allocation_guard guard;
+ *         my_hot_path();
+ *         CATCH_REQUIRE(guard.allocations() == 0);
+ *     }
+ * \endcode
+ *
+ * The counts are only available when the replacement operators are
+ * compiled in (define SNAP_CATCH2_TRACK_ALLOCATIONS before including
+ * snapcatch2.hpp in the file calling snap_catch2_main()); otherwise
+ * they are always zero and tracking() returns false.
+ */
+class allocation_guard
+{
+public:
+    allocation_guard()
+        : m_start(detail::thread_allocation_counters())
+    {
+        // the peak is measured from the start of the guard
+        //
+        detail::allocation_counters & counters(detail::thread_allocation_counters());
+        counters.m_peak_live_bytes = counters.m_live_bytes;
+    }
+
+    allocation_guard(allocation_guard const &) = delete;
+    allocation_guard & operator = (allocation_guard const &) = delete;
+
+    ~allocation_guard()
+    {
+        // restore the peak of an outer guard
+        //
+        detail::allocation_counters & counters(detail::thread_allocation_counters());
+        counters.m_peak_live_bytes = std::max(counters.m_peak_live_bytes, m_start.m_peak_live_bytes);
+    }
+
+    static bool tracking()
+    {
+        return detail::g_allocation_tracking();
+    }
+
+    std::uint64_t allocations() const
+    {
+        return detail::thread_allocation_counters().m_allocations - m_start.m_allocations;
+    }
+
+    std::uint64_t deallocations() const
+    {
+        return detail::thread_allocation_counters().m_deallocations - m_start.m_deallocations;
+    }
+
+    std::uint64_t bytes() const
+    {
+        return detail::thread_allocation_counters().m_bytes - m_start.m_bytes;
+    }
+
+    std::uint64_t peak_live_bytes() const
+    {
+        detail::allocation_counters const & counters(detail::thread_allocation_counters());
+        return counters.m_peak_live_bytes > m_start.m_live_bytes
+                    ? counters.m_peak_live_bytes - m_start.m_live_bytes
+                    : 0;
+    }
+
+private:
+    detail::allocation_counters const   m_start;
+};
+
+
+namespace detail
+{
+
+
+/** \brief Report the result of an allocation assertion.
+ *
+ * This function is used by the CATCH_REQUIRE_MAX_ALLOCATIONS() macro.
+ *
+ * \param[in] handler  The catch2 assertion handler.
+ * \param[in] guard  The guard which counted the allocations.
+ * \param[in] max_allocations  The maximum number of allocations accepted.
+ */
+inline void report_allocations(
+      Catch::AssertionHandler & handler
+    , allocation_guard const & guard
+    , std::uint64_t max_allocations)
+{
+    std::uint64_t const allocations(guard.allocations());
+    std::uint64_t const bytes(guard.bytes());
+    std::uint64_t const peak(guard.peak_live_bytes());
+    if(!allocation_guard::tracking())
+    {
+        handler.handleMessage(
+                  Catch::ResultWas::ExplicitFailure
+                , "allocation tracking is not available; define SNAP_CATCH2_TRACK_ALLOCATIONS"
+                  " in the file calling snap_catch2_main().");
+        return;
+    }
+
+    std::stringstream ss;
+    ss << allocations
+       << " allocation"
+       << (allocations == 1 ? "" : "s")
+       << " of "
+       << bytes
+       << " bytes (peak: "
+       << peak
+       << " bytes); expected at most "
+       << max_allocations
+       << ".";
+    handler.handleMessage(
+              allocations <= max_allocations
+                    ? Catch::ResultWas::Ok
+                    : Catch::ResultWas::ExplicitFailure
+            , ss.str());
+}
+
+
+} // detail namespace
+
+
+/** \brief Maximum number of failures kept by a CATCH_REQUIRE_ALL() scope.
+ *
+ * The bulk checks keep the details of the first failures only. The
+ * others are counted. The default is 10. It can be changed with the
+ * `--bulk-failures` command line option.
+ *
+ * \return A read-write reference to the `bulk_failures` parameter.
+ */
+inline std::size_t & g_bulk_failures()
+{
+    static std::size_t bulk_failures = 10;
+
+    return bulk_failures;
+}
+
+
+namespace detail
+{
+
+
+/** \brief The details of a failed check.
+ *
+ * The checks which do not go through catch2 right away (i.e.
+ * CATCH_CHECK_FAST() and CATCH_THREAD_CHECK()) save their failures in
+ * this structure until they get reported.
+ */
+struct check_failure
+{
+    Catch::StringRef        m_macro = Catch::StringRef();
+    Catch::SourceLineInfo   m_line;
+    Catch::StringRef        m_expression = Catch::StringRef();
+    std::string             m_expansion = std::string();
+};
+
+
+inline check_failure make_check_failure(
+      Catch::StringRef const & macro
+    , Catch::ITransientExpression const & expr
+    , Catch::StringRef const & expression
+    , Catch::SourceLineInfo const & line
+    , std::string const & where)
+{
+    std::stringstream ss;
+    expr.streamReconstructedExpression(ss);
+    ss << " (" << where << ")";
+    return check_failure{ macro, line, expression, ss.str() };
+}
+
+
+inline void report_check_failure(check_failure const & f)
+{
+    Catch::AssertionHandler handler(
+              f.m_macro
+            , f.m_line
+            , f.m_expression
+            , Catch::ResultDisposition::ContinueOnFailure);
+    handler.handleMessage(Catch::ResultWas::ExpressionFailed, f.m_expansion);
+    handler.complete();
+}
+
+
+inline std::string hidden_failures(std::uint64_t hidden)
+{
+    if(hidden == 0)
+    {
+        return std::string();
+    }
+    return " ("
+         + std::to_string(hidden)
+         + " more failure"
+         + (hidden == 1 ? "" : "s")
+         + " not shown; see --bulk-failures)";
+}
+
+
+} // detail namespace
+
+
+/** \brief Run many checks and report them to catch2 once.
+ *
+ * An object of this class is created by CATCH_REQUIRE_ALL(). Each
+ * CATCH_CHECK_FAST() in that scope only increments a counter when the
+ * check passes. When it fails, the expression and its values are saved
+ * (up to g_bulk_failures() of them). The CATCH_END_REQUIRE_ALL() macro
+ * then reports the failures and one summary assertion to catch2. If
+ * any check failed, the summary fails and the test case stops like with
+ * a CATCH_REQUIRE().
+ *
+ * If an exception leaves the scope, the checks are still reported, but
+ * without stopping the test case since it is already being aborted.
+ */
+class bulk_checker
+{
+public:
+    bulk_checker(Catch::StringRef const & name, Catch::SourceLineInfo const & line)
+        : m_name(name)
+        , m_line(line)
+    {
+    }
+
+    bulk_checker(bulk_checker const &) = delete;
+    bulk_checker & operator = (bulk_checker const &) = delete;
+
+    ~bulk_checker()
+    {
+        if(!m_reported)
+        {
+            report(Catch::ResultDisposition::ContinueOnFailure);
+        }
+    }
+
+    template<typename T>
+    void check(
+          Catch::ExprLhs<T> const & expr
+        , Catch::StringRef const & expression
+        , Catch::SourceLineInfo const & line)
+    {
+        check(expr.makeUnaryExpr(), expression, line);
+    }
+
+    void check(
+          Catch::ITransientExpression const & expr
+        , Catch::StringRef const & expression
+        , Catch::SourceLineInfo const & line)
+    {
+        if(expr.getResult())
+        {
+            ++m_passed;
+        }
+        else
+        {
+            failed(expr, expression, line);
+        }
+    }
+
+    void report(Catch::ResultDisposition::Flags disposition = Catch::ResultDisposition::Normal)
+    {
+        m_reported = true;
+
+        for(auto const & f : m_failures)
+        {
+            detail::report_check_failure(f);
+        }
+
+        std::stringstream ss;
+        ss << m_passed
+           << " of "
+           << m_passed + m_failed
+           << " checks passed"
+           << detail::hidden_failures(m_failed - m_failures.size())
+           << '.';
+        Catch::AssertionHandler handler(
+                  "CATCH_REQUIRE_ALL"_catch_sr
+                , m_line
+                , m_name
+                , disposition);
+        handler.handleMessage(
+                  m_failed == 0
+                        ? Catch::ResultWas::Ok
+                        : Catch::ResultWas::ExplicitFailure
+                , ss.str());
+        handler.complete();
+    }
+
+private:
+    void failed(
+          Catch::ITransientExpression const & expr
+        , Catch::StringRef const & expression
+        , Catch::SourceLineInfo const & line)
+    {
+        ++m_failed;
+        if(m_failures.size() < g_bulk_failures())
+        {
+            m_failures.push_back(detail::make_check_failure(
+                      "CATCH_CHECK_FAST"_catch_sr
+                    , expr
+                    , expression
+                    , line
+                    , "check #" + std::to_string(m_passed + m_failed)));
+        }
+    }
+
+    Catch::StringRef const      m_name;
+    Catch::SourceLineInfo const m_line;
+    std::uint64_t               m_passed = 0;
+    std::uint64_t               m_failed = 0;
+    std::vector<detail::check_failure>
+                                m_failures = std::vector<detail::check_failure>();
+    bool                        m_reported = false;
+};
+
+
+/** \brief Collect the checks made by several threads.
+ *
+ * Catch2 assertions are not thread safe. Create a thread_checker in
+ * your test and use CATCH_THREAD_CHECK() in the threads instead. Each
+ * thread gets its own buffer, added to a lock-free list the first time
+ * it uses the checker, so the threads never wait on each other. A check
+ * which passes only increments a counter of that buffer.
+ *
+ * Once the threads were joined, CATCH_REQUIRE_THREAD_CHECKS() replays
+ * the failures through catch2, from the main thread, and reports one
+ * summary assertion which stops the test case if any check failed.
+ *
+ * \code
+ *     SNAP_CATCH2_NAMESPACE::thread_checker checker;
+ *     std::vector<std::thread> threads;
+ *     for(int idx(0); idx < 16; ++idx)
+ *     {
+ *         threads.emplace_back([&checker, &queue]()
+ *             {
+ *                 for(int count(0); count < 100000; ++count)
+ *                 {
+ *                     CATCH_THREAD_CHECK(checker, queue.push(count));
+ *                 }
+ *             });
+ *     }
+ *     for(auto & t : threads)
+ *     {
+ *         t.join();
+ *     }
+ *     CATCH_REQUIRE_THREAD_CHECKS(checker);
+ * \endcode
+ *
+ * \warning
+ * The buffers are not synchronized; replay() must only be called once
+ * all the threads which used the checker were joined.
+ */
+class thread_checker
+{
+public:
+    thread_checker()
+        : m_id(++g_next_id())
+    {
+    }
+
+    thread_checker(thread_checker const &) = delete;
+    thread_checker & operator = (thread_checker const &) = delete;
+
+    ~thread_checker()
+    {
+        if(!m_replayed)
+        {
+            replay(
+                  Catch::SourceLineInfo(__FILE__, static_cast<std::size_t>(__LINE__))
+                , "thread_checker"_catch_sr
+                , Catch::ResultDisposition::ContinueOnFailure);
+        }
+
+        buffer * b(m_head.load());
+        while(b != nullptr)
+        {
+            buffer * next(b->m_next);
+            delete b;
+            b = next;
+        }
+    }
+
+    template<typename T>
+    void check(
+          Catch::ExprLhs<T> const & expr
+        , Catch::StringRef const & expression
+        , Catch::SourceLineInfo const & line)
+    {
+        check(expr.makeUnaryExpr(), expression, line);
+    }
+
+    void check(
+          Catch::ITransientExpression const & expr
+        , Catch::StringRef const & expression
+        , Catch::SourceLineInfo const & line)
+    {
+        buffer & b(thread_buffer());
+        if(expr.getResult())
+        {
+            ++b.m_passed;
+        }
+        else
+        {
+            ++b.m_failed;
+            if(b.m_failures.size() < g_bulk_failures())
+            {
+                b.m_failures.push_back(detail::make_check_failure(
+                          "CATCH_THREAD_CHECK"_catch_sr
+                        , expr
+                        , expression
+                        , line
+                        , "thread #" + std::to_string(b.m_index)));
+            }
+        }
+    }
+
+    void replay(
+          Catch::SourceLineInfo const & line
+        , Catch::StringRef const & name = Catch::StringRef()
+        , Catch::ResultDisposition::Flags disposition = Catch::ResultDisposition::Normal)
+    {
+        m_replayed = true;
+
+        // the list is in reverse order of creation
+        //
+        std::vector<buffer const *> buffers;
+        for(buffer const * b(m_head.load()); b != nullptr; b = b->m_next)
+        {
+            buffers.push_back(b);
+        }
+        std::uint64_t passed(0);
+        std::uint64_t failed(0);
+        std::uint64_t hidden(0);
+        for(auto it(buffers.rbegin()); it != buffers.rend(); ++it)
+        {
+            for(auto const & f : (*it)->m_failures)
+            {
+                detail::report_check_failure(f);
+            }
+            passed += (*it)->m_passed;
+            failed += (*it)->m_failed;
+            hidden += (*it)->m_failed - (*it)->m_failures.size();
+        }
+
+        std::stringstream ss;
+        ss << passed
+           << " of "
+           << passed + failed
+           << " checks passed in "
+           << buffers.size()
+           << " thread"
+           << (buffers.size() == 1 ? "" : "s")
+           << detail::hidden_failures(hidden)
+           << '.';
+        Catch::AssertionHandler handler(
+                  "CATCH_REQUIRE_THREAD_CHECKS"_catch_sr
+                , line
+                , name
+                , disposition);
+        handler.handleMessage(
+                  failed == 0
+                        ? Catch::ResultWas::Ok
+                        : Catch::ResultWas::ExplicitFailure
+                , ss.str());
+        handler.complete();
+    }
+
+private:
+    struct buffer
+    {
+        std::uint64_t                       m_passed = 0;
+        std::uint64_t                       m_failed = 0;
+        std::uint32_t                       m_index = 0;
+        std::vector<detail::check_failure>  m_failures = std::vector<detail::check_failure>();
+        std::thread::id                     m_thread = std::thread::id();
+        buffer *                            m_next = nullptr;
+    };
+
+    /** \brief The buffers of the last few checkers used by a thread.
+     *
+     * A thread alternating between several checkers finds its buffers
+     * here without searching the lists of the checkers.
+     */
+    struct thread_cache
+    {
+        struct entry
+        {
+            std::uint64_t       m_id = 0;
+            buffer *            m_buffer = nullptr;
+        };
+
+        std::array<entry, 8>    m_entries = {};
+        std::size_t             m_next = 0;
+    };
+
+    static std::atomic<std::uint64_t> & g_next_id()
+    {
+        static std::atomic<std::uint64_t> id = { 0 };
+
+        return id;
+    }
+
+    buffer & thread_buffer()
+    {
+        // the id (rather than `this`) makes sure a checker created at the
+        // same address as an old one does not reuse its buffers
+        //
+        static thread_local thread_cache cache;
+        for(auto const & e : cache.m_entries)
+        {
+            if(e.m_id == m_id)
+            {
+                return *e.m_buffer;
+            }
+        }
+
+        // the cache is too small for the number of checkers in use, the
+        // buffer of this thread may already exist; the buffers are never
+        // removed from the list before the checker gets destroyed so it
+        // is safe to walk it
+        //
+        std::thread::id const thread(std::this_thread::get_id());
+        buffer * b(m_head.load());
+        while(b != nullptr
+           && b->m_thread != thread)
+        {
+            b = b->m_next;
+        }
+        if(b == nullptr)
+        {
+            b = new buffer;
+            b->m_index = m_next_index++;
+            b->m_thread = thread;
+            b->m_next = m_head.load(std::memory_order_relaxed);
+            while(!m_head.compare_exchange_weak(b->m_next, b))
+            {
+            }
+        }
+
+        thread_cache::entry & e(cache.m_entries[cache.m_next]);
+        cache.m_next = (cache.m_next + 1) % cache.m_entries.size();
+        e.m_id = m_id;
+        e.m_buffer = b;
+        return *b;
+    }
+
+    std::uint64_t const             m_id;
+    std::atomic<buffer *>           m_head = { nullptr };
+    std::atomic<std::uint32_t>      m_next_index = { 0 };
+    bool                            m_replayed = false;
+};
+
+
+/** \brief The seed used by the random generators.
+ *
+ * This is the `--seed` value. Each test case derives its own stream
+ * from this seed and its name (see rng()).
+ *
+ * \return A read-write reference to the seed.
+ */
+inline std::uint64_t & g_random_seed()
+{
+    static std::uint64_t seed = 0;
+
+    return seed;
+}
+
+
+/** \brief A fast pseudo-random number generator.
+ *
+ * This is xoshiro256++ by David Blackman and Sebastiano Vigna. It is
+ * much faster than rand(), has a period of 2^256 - 1 and passes all
+ * the usual statistical tests. It is not cryptographically secure.
+ *
+ * The class satisfies the UniformRandomBitGenerator requirements so it
+ * can be used with the `std::..._distribution` classes and
+ * `std::shuffle()`. It also offers bulk functions to fill buffers,
+ * strings and arrays of integers.
+ *
+ * You usually do not create these yourself. Instead, use the
+ * SNAP_CATCH2_NAMESPACE::rng() function which returns the stream
+ * of the current test case and thread.
+ */
+class random_generator
+{
+public:
+    typedef std::uint64_t       result_type;
+
+    /** \brief Initialize the generator from a seed.
+     *
+     * The 256 bits of state are generated from \p seed with splitmix64
+     * as recommended by the authors.
+     *
+     * \param[in] seed  The seed.
+     */
+    explicit random_generator(std::uint64_t seed = 0)
+    {
+        this->seed(seed);
+    }
+
+    void seed(std::uint64_t seed)
+    {
+        for(auto & s : m_state)
+        {
+            s = splitmix64(seed);
+        }
+    }
+
+    static constexpr result_type min()
+    {
+        return 0;
+    }
+
+    static constexpr result_type max()
+    {
+        return ~static_cast<result_type>(0);
+    }
+
+    result_type operator () ()
+    {
+        result_type const result(rotl(m_state[0] + m_state[3], 23) + m_state[0]);
+        result_type const t(m_state[1] << 17);
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl(m_state[3], 45);
+        return result;
+    }
+
+    /** \brief Advance the generator by 2^128 numbers.
+     *
+     * This is used to create non-overlapping streams, one per thread.
+     */
+    void jump()
+    {
+        static result_type const jump_table[] = {
+            0x180ec6d33cfd0abaULL,
+            0xd5a61266f0c9392cULL,
+            0xa9582618e03fc9aaULL,
+            0x39abdc4529b1661cULL,
+        };
+        result_type s[4] = { 0, 0, 0, 0 };
+        for(auto j : jump_table)
+        {
+            for(int b(0); b < 64; ++b)
+            {
+                if((j & (1ULL << b)) != 0)
+                {
+                    for(int i(0); i < 4; ++i)
+                    {
+                        s[i] ^= m_state[i];
+                    }
+                }
+                (*this)();
+            }
+        }
+        std::copy(s, s + 4, m_state);
+    }
+
+    /** \brief Get a number in [low, high].
+     *
+     * The number is uniformly distributed (Lemire's multiply and
+     * reject method, which rarely needs a division).
+     *
+     * \param[in] low  The smallest possible number.
+     * \param[in] high  The largest possible number.
+     *
+     * \return A number between low and high inclusive.
+     */
+    template<typename T>
+    T uniform(T low, T high)
+    {
+        static_assert(std::is_integral<T>::value, "uniform() expects an integral type");
+        typedef typename std::make_unsigned<T>::type unsigned_t;
+        std::uint64_t const range(static_cast<std::uint64_t>(static_cast<unsigned_t>(high) - static_cast<unsigned_t>(low)));
+        return static_cast<T>(static_cast<unsigned_t>(low) + static_cast<unsigned_t>(bounded(range)));
+    }
+
+    /** \brief Fill a buffer with random bytes.
+     *
+     * \param[out] buffer  The buffer to fill.
+     * \param[in] size  The size of the buffer in bytes.
+     */
+    void fill(void * buffer, std::size_t size)
+    {
+        unsigned char * ptr(static_cast<unsigned char *>(buffer));
+        for(; size >= sizeof(result_type); size -= sizeof(result_type), ptr += sizeof(result_type))
+        {
+            result_type const value((*this)());
+            memcpy(ptr, &value, sizeof(value));
+        }
+        if(size > 0)
+        {
+            result_type const value((*this)());
+            memcpy(ptr, &value, size);
+        }
+    }
+
+    /** \brief Fill an array with integers in [low, high].
+     *
+     * \param[out] out  The array to fill.
+     * \param[in] count  The number of items in \p out.
+     * \param[in] low  The smallest possible number.
+     * \param[in] high  The largest possible number.
+     */
+    template<typename T>
+    void fill(T * out, std::size_t count, T low, T high)
+    {
+        for(std::size_t idx(0); idx < count; ++idx)
+        {
+            out[idx] = uniform(low, high);
+        }
+    }
+
+    /** \brief Generate a string of random characters.
+     *
+     * The characters are taken from \p charset, by default the printable
+     * ASCII characters.
+     *
+     * \param[in] size  The number of characters.
+     * \param[in] charset  The characters to choose from; must not be empty.
+     *
+     * \return The random string.
+     */
+    std::string string(
+          std::size_t size
+        , std::string const & charset = std::string(
+                  " !\"#$%&'()*+,-./0123456789:;<=>?@"
+                  "ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`"
+                  "abcdefghijklmnopqrstuvwxyz{|}~"))
+    {
+        std::string result(size, '\0');
+        std::uint64_t const range(charset.length() - 1);
+        for(auto & c : result)
+        {
+            c = charset[bounded(range)];
+        }
+        return result;
+    }
+
+private:
+    static result_type rotl(result_type x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    static std::uint64_t splitmix64(std::uint64_t & state)
+    {
+        std::uint64_t z(state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    /** \brief Compute the 128 bit product of \p a and \p b.
+     *
+     * \param[in] a  The first number.
+     * \param[in] b  The second number.
+     * \param[out] high  The upper 64 bits of the product.
+     *
+     * \return The lower 64 bits of the product.
+     */
+    static std::uint64_t multiply(std::uint64_t a, std::uint64_t b, std::uint64_t & high)
+    {
+#ifdef __SIZEOF_INT128__
+        __extension__ typedef unsigned __int128     uint128_t;
+
+        uint128_t const m(static_cast<uint128_t>(a) * b);
+        high = static_cast<std::uint64_t>(m >> 64);
+        return static_cast<std::uint64_t>(m);
+#else
+        // 32 bit targets (i.e. i386, armhf) do not have __int128
+        //
+        std::uint64_t const a_lo(a & 0xFFFFFFFFULL);
+        std::uint64_t const a_hi(a >> 32);
+        std::uint64_t const b_lo(b & 0xFFFFFFFFULL);
+        std::uint64_t const b_hi(b >> 32);
+        std::uint64_t const lo_lo(a_lo * b_lo);
+        std::uint64_t const hi_lo(a_hi * b_lo);
+        std::uint64_t const lo_hi(a_lo * b_hi);
+        std::uint64_t const middle((lo_lo >> 32) + (hi_lo & 0xFFFFFFFFULL) + lo_hi);
+        high = a_hi * b_hi + (hi_lo >> 32) + (middle >> 32);
+        return (middle << 32) | (lo_lo & 0xFFFFFFFFULL);
+#endif
+    }
+
+    std::uint64_t bounded(std::uint64_t range)
+    {
+        if(range == max())
+        {
+            return (*this)();
+        }
+        std::uint64_t const s(range + 1);
+        std::uint64_t high(0);
+        std::uint64_t l(multiply((*this)(), s, high));
+        if(l < s)
+        {
+            std::uint64_t const t((0 - s) % s);
+            while(l < t)
+            {
+                l = multiply((*this)(), s, high);
+            }
+        }
+        return high;
+    }
+
+    result_type         m_state[4] = { 0, 0, 0, 0 };
+};
+
+
+namespace detail
+{
+
+
+/** \brief The random stream state shared by all the threads.
+ *
+ * Each time a test case starts, the generation is incremented and the
+ * seed of the test case gets computed. The thread streams are re-seeded
+ * the first time they get used in a new generation.
+ */
+struct random_streams
+{
+    std::atomic<std::uint64_t>      m_generation = { 1 };
+    std::atomic<std::uint64_t>      m_test_seed = { 0 };
+    std::atomic<std::uint32_t>      m_next_thread = { 1 };
+};
+
+
+inline random_streams & g_random_streams()
+{
+    static random_streams streams;
+
+    return streams;
+}
+
+
+struct thread_random_stream
+{
+    std::uint64_t       m_generation = 0;
+    random_generator    m_generator = random_generator();
+};
+
+
+inline thread_random_stream & g_thread_random_stream()
+{
+    static thread_local thread_random_stream stream;
+
+    return stream;
+}
+
+
+/** \brief Compute the seed of a test case.
+ *
+ * The seed only depends on `--seed` and the name of the test so running
+ * a single test case with the same `--seed` reproduces the same numbers,
+ * whatever the other tests do (and also in a `--jobs` worker).
+ *
+ * \param[in] name  The name of the test case.
+ */
+inline void start_random_stream(std::string const & name)
+{
+    std::uint64_t hash(14695981039346656037ULL);     // FNV-1a
+    for(auto c : name)
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+
+    random_streams & streams(g_random_streams());
+    streams.m_test_seed = g_random_seed() ^ hash;
+    streams.m_next_thread = 1;
+    ++streams.m_generation;
+
+    // the thread starting the test always gets the first stream
+    //
+    thread_random_stream & stream(g_thread_random_stream());
+    stream.m_generation = streams.m_generation;
+    stream.m_generator.seed(streams.m_test_seed);
+}
+
+
+} // detail namespace
+
+
+/** \brief Get the random generator of the current test and thread.
+ *
+ * The thread running the test case gets a stream seeded from `--seed`
+ * and the name of the test case. Other threads get the same stream
+ * advanced by 2^128 numbers times the order in which they first called
+ * this function during that test, so the streams never overlap.
+ *
+ * \code
+ *     std::vector<std::uint8_t> buffer(1024 * 1024);
+ *     SNAP_CATCH2_NAMESPACE::rng().fill(buffer.data(), buffer.size());
+ *     int const value(SNAP_CATCH2_NAMESPACE::rng().uniform(-10, 10));
+ * \endcode
+ *
+ * \return A reference to the generator of this thread.
+ */
+inline random_generator & rng()
+{
+    detail::random_streams & streams(detail::g_random_streams());
+    detail::thread_random_stream & stream(detail::g_thread_random_stream());
+    if(stream.m_generation != streams.m_generation)
+    {
+        stream.m_generation = streams.m_generation;
+        stream.m_generator.seed(streams.m_test_seed);
+        for(std::uint32_t idx(streams.m_next_thread++); idx > 0; --idx)
+        {
+            stream.m_generator.jump();
+        }
+    }
+    return stream.m_generator;
+}
+
+
+/** \brief Number of sections listed in the timings report.
+ *
+ * When the `--timings <N>` command line option is used, each section
+ * started with CATCH_START_SECTION() gets timed and the N slowest
+ * sections are listed once all the tests ran.
+ *
+ * When this value is 0 and no `--timings-json` file was specified,
+ * the sections are not timed at all.
+ *
+ * \return A read-write reference to the `timings` parameter.
+ */
+inline std::size_t & g_timings()
+{
+    static std::size_t timings = 0;
+
+    return timings;
+}
+
+
+namespace detail
+{
+
+
+/** \brief Whether the section timer is active.
+ *
+ * This flag is true when `--timings` or `--timings-json` were used.
+ * It is checked by the section_guard class so the overhead of the
+ * timer is one test when off.
+ *
+ * \return A read-write reference to the flag.
+ */
+inline bool & g_section_timing_enabled()
+{
+    static bool enabled = false;
+
+    return enabled;
+}
+
+
+/** \brief Whether the performance counters are collected.
+ *
+ * This flag is true when `--perf-counters` was used. The counters are
+ * then collected along the section timings.
+ *
+ * \return A read-write reference to the flag.
+ */
+inline bool & g_perf_counters()
+{
+    static bool enabled = false;
+
+    return enabled;
+}
+
+
+/** \brief The performance counters we collect.
+ */
+enum class perf_counter_t
+{
+    PERF_COUNTER_CYCLES,
+    PERF_COUNTER_INSTRUCTIONS,
+    PERF_COUNTER_BRANCH_MISSES,
+    PERF_COUNTER_CACHE_MISSES,
+    PERF_COUNTER_PAGE_FAULTS,
+    PERF_COUNTER_CONTEXT_SWITCHES,
+
+    PERF_COUNTER_MAX
+};
+
+
+/** \brief The name of a counter as used in the JSON output.
+ *
+ * \param[in] counter  The counter.
+ *
+ * \return The name of the counter.
+ */
+inline char const * perf_counter_name(perf_counter_t counter)
+{
+    switch(counter)
+    {
+    case perf_counter_t::PERF_COUNTER_CYCLES:
+        return "cycles";
+
+    case perf_counter_t::PERF_COUNTER_INSTRUCTIONS:
+        return "instructions";
+
+    case perf_counter_t::PERF_COUNTER_BRANCH_MISSES:
+        return "branch_misses";
+
+    case perf_counter_t::PERF_COUNTER_CACHE_MISSES:
+        return "cache_misses";
+
+    case perf_counter_t::PERF_COUNTER_PAGE_FAULTS:
+        return "page_faults";
+
+    case perf_counter_t::PERF_COUNTER_CONTEXT_SWITCHES:
+        return "context_switches";
+
+    default:
+        return "unknown";
+
+    }
+}
+
+
+/** \brief A set of counter values.
+ *
+ * Some counters may not be available (i.e. the hardware counters in a
+ * virtual machine or when `/proc/sys/kernel/perf_event_paranoid` does
+ * not allow them), in which case m_available is false for that counter.
+ */
+struct perf_values
+{
+    static constexpr std::size_t COUNT = static_cast<std::size_t>(perf_counter_t::PERF_COUNTER_MAX);
+
+    double & operator [] (perf_counter_t counter)
+    {
+        return m_values[static_cast<std::size_t>(counter)];
+    }
+
+    double operator [] (perf_counter_t counter) const
+    {
+        return m_values[static_cast<std::size_t>(counter)];
+    }
+
+    bool available(perf_counter_t counter) const
+    {
+        return m_available[static_cast<std::size_t>(counter)];
+    }
+
+    bool empty() const
+    {
+        return std::find(m_available.begin(), m_available.end(), true) == m_available.end();
+    }
+
+    perf_values & operator += (perf_values const & rhs)
+    {
+        for(std::size_t idx(0); idx < COUNT; ++idx)
+        {
+            m_values[idx] += rhs.m_values[idx];
+            m_available[idx] = m_available[idx] || rhs.m_available[idx];
+        }
+        return *this;
+    }
+
+    perf_values operator - (perf_values const & rhs) const
+    {
+        perf_values result(*this);
+        for(std::size_t idx(0); idx < COUNT; ++idx)
+        {
+            result.m_values[idx] -= rhs.m_values[idx];
+        }
+        return result;
+    }
+
+    std::array<double, COUNT>   m_values = {};
+    std::array<bool, COUNT>     m_available = {};
+};
+
+
+/** \brief Read the performance counters of the calling thread.
+ *
+ * The counters get opened with perf_event_open() the first time a
+ * thread reads them. The hardware counters (cycles, instructions, branch
+ * and cache misses) count the user space only, which is allowed with the
+ * default `perf_event_paranoid` setting of 2. When the system call is not
+ * allowed at all, the page faults and context switches come from
+ * getrusage(RUSAGE_THREAD) instead.
+ *
+ * Each counter is opened separately (not in a group) so one counter which
+ * is not supported does not prevent the others from working.
+ */
+class perf_counters
+{
+public:
+    perf_counters()
+    {
+        struct counter_definition
+        {
+            std::uint32_t   m_type = 0;
+            std::uint64_t   m_config = 0;
+        };
+        counter_definition const definitions[perf_values::COUNT] =
+        {
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+            { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+            { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+        };
+        for(std::size_t idx(0); idx < perf_values::COUNT; ++idx)
+        {
+            perf_event_attr attr = {};
+            attr.size = sizeof(attr);
+            attr.type = definitions[idx].m_type;
+            attr.config = definitions[idx].m_config;
+            attr.exclude_kernel = attr.type == PERF_TYPE_HARDWARE ? 1 : 0;
+            attr.exclude_hv = 1;
+            m_fds[idx] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+            if(m_fds[idx] < 0
+            && attr.exclude_kernel == 0)
+            {
+                // the software counters with exclude_kernel are allowed
+                // with more restrictive settings
+                //
+                attr.exclude_kernel = 1;
+                m_fds[idx] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+            }
+        }
+    }
+
+    perf_counters(perf_counters const &) = delete;
+    perf_counters & operator = (perf_counters const &) = delete;
+
+    ~perf_counters()
+    {
+        for(auto const fd : m_fds)
+        {
+            if(fd >= 0)
+            {
+                close(fd);
+            }
+        }
+    }
+
+    perf_values read_values() const
+    {
+        perf_values result;
+        for(std::size_t idx(0); idx < perf_values::COUNT; ++idx)
+        {
+            std::uint64_t value(0);
+            if(m_fds[idx] >= 0
+            && read(m_fds[idx], &value, sizeof(value)) == sizeof(value))
+            {
+                result.m_values[idx] = static_cast<double>(value);
+                result.m_available[idx] = true;
+            }
+        }
+
+        // fallback on getrusage() for the software counters
+        //
+        std::size_t const faults(static_cast<std::size_t>(perf_counter_t::PERF_COUNTER_PAGE_FAULTS));
+        std::size_t const switches(static_cast<std::size_t>(perf_counter_t::PERF_COUNTER_CONTEXT_SWITCHES));
+        if(!result.m_available[faults]
+        || !result.m_available[switches])
+        {
+            rusage usage = {};
+            if(getrusage(RUSAGE_THREAD, &usage) == 0)
+            {
+                if(!result.m_available[faults])
+                {
+                    result.m_values[faults] = static_cast<double>(usage.ru_minflt + usage.ru_majflt);
+                    result.m_available[faults] = true;
+                }
+                if(!result.m_available[switches])
+                {
+                    result.m_values[switches] = static_cast<double>(usage.ru_nvcsw + usage.ru_nivcsw);
+                    result.m_available[switches] = true;
+                }
+            }
+        }
+
+        return result;
+    }
+
+private:
+    std::array<int, perf_values::COUNT>     m_fds = {};
+};
+
+
+/** \brief Read the performance counters of the calling thread.
+ *
+ * \return The current value of the counters.
+ */
+inline perf_values read_perf_counters()
+{
+    thread_local perf_counters counters;
+
+    return counters.read_values();
+}
+
+
+/** \brief Format a counter value in a short string.
+ *
+ * Large numbers get a k, M or G suffix so they fit in a column.
+ *
+ * \param[in] value  The value to format.
+ *
+ * \return The formatted value.
+ */
+inline std::string format_count(double value)
+{
+    char buf[32];
+    if(value >= 1.0e10)
+    {
+        snprintf(buf, sizeof(buf), "%.1fG", value / 1.0e9);
+    }
+    else if(value >= 1.0e7)
+    {
+        snprintf(buf, sizeof(buf), "%.1fM", value / 1.0e6);
+    }
+    else if(value >= 1.0e4)
+    {
+        snprintf(buf, sizeof(buf), "%.1fk", value / 1.0e3);
+    }
+    else if(value >= 100.0 || value == std::floor(value))
+    {
+        snprintf(buf, sizeof(buf), "%.0f", value);
+    }
+    else
+    {
+        snprintf(buf, sizeof(buf), "%.2f", value);
+    }
+    return buf;
+}
+
+
+/** \brief Write the available counters as a JSON object.
+ *
+ * \param[in] out  The output stream.
+ * \param[in] values  The counters to write.
+ */
+inline void write_perf_values(std::ostream & out, perf_values const & values)
+{
+    out << '{';
+    char const * sep("");
+    for(std::size_t idx(0); idx < perf_values::COUNT; ++idx)
+    {
+        if(values.m_available[idx])
+        {
+            out << sep
+                << '"' << perf_counter_name(static_cast<perf_counter_t>(idx)) << "\": "
+                << values.m_values[idx];
+            sep = ", ";
+        }
+    }
+    out << '}';
+}
+
+
+/** \brief Read the counters written by write_perf_values().
+ *
+ * \param[in] object  The JSON object, may be nullptr.
+ *
+ * \return The counters found in \p object.
+ */
+inline perf_values read_perf_values(json_value const * object)
+{
+    perf_values result;
+    if(object != nullptr)
+    {
+        for(std::size_t idx(0); idx < perf_values::COUNT; ++idx)
+        {
+            json_value const * v(object->member(perf_counter_name(static_cast<perf_counter_t>(idx))));
+            if(v != nullptr)
+            {
+                result.m_values[idx] = v->m_number;
+                result.m_available[idx] = true;
+            }
+        }
+    }
+    return result;
+}
+
+
+/** \brief The timing data of one section.
+ *
+ * A section can run more than once (i.e. when it has sub-sections,
+ * catch2 re-runs it once per sub-section) so we keep the number of
+ * times it ran and the totals.
+ */
+struct section_timing
+{
+    std::string         m_test_case = std::string();
+    std::string         m_section = std::string();
+    std::size_t         m_count = 0;
+    double              m_wall = 0.0;           // in seconds
+    double              m_cpu = 0.0;            // in seconds
+    double              m_max_wall = 0.0;       // in seconds
+    perf_values         m_counters = perf_values();
+};
+
+
+inline std::map<std::string, section_timing> & g_section_timings()
+{
+    static std::map<std::string, section_timing> timings;
+
+    return timings;
+}
+
+
+/** \brief The path of the sections currently running.
+ *
+ * The section_guard pushes the name of its section on construction
+ * and pops it on destruction. The resulting path is used as the key
+ * to the timing data.
+ */
+inline std::vector<std::string> & g_section_path()
+{
+    static std::vector<std::string> path;
+
+    return path;
+}
+
+
+inline double process_cpu_time()
+{
+    timespec ts = {};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1.0e9;
+}
+
+
+/** \brief The events sent to the asynchronous progress reporter.
+ */
+enum class progress_event_t
+{
+    PROGRESS_EVENT_TEST_STARTED,
+    PROGRESS_EVENT_SECTION_STARTED,
+    PROGRESS_EVENT_TEST_ENDED,
+};
+
+
+/** \brief Report the progress from a background thread.
+ *
+ * With `--progress-async`, the sections and test cases send events to
+ * this object instead of writing a line each. The events go through a
+ * bounded lock-free ring (multiple producers, one consumer) so sending
+ * one costs a few atomic operations and a copy of the name.
+ *
+ * A background thread drains the ring and shows the progress at a bounded
+ * rate: on a TTY, one status line gets redrawn up to 10 times per second;
+ * otherwise, one line gets written every few seconds, if anything changed.
+ * When the history of a previous run is available, the expected duration
+ * of the tests is used to show an ETA.
+ *
+ * A section event gets dropped if the ring is full. Test case events
+ * wait for room since they are used to count the progress.
+ */
+class progress_reporter
+{
+public:
+    static constexpr std::size_t    RING_SIZE = 1024;
+    static constexpr std::size_t    NAME_SIZE = 240;
+
+    progress_reporter()
+    {
+        for(std::size_t idx(0); idx < RING_SIZE; ++idx)
+        {
+            m_ring[idx].m_sequence.store(idx, std::memory_order_relaxed);
+        }
+    }
+
+    progress_reporter(progress_reporter const &) = delete;
+    progress_reporter & operator = (progress_reporter const &) = delete;
+
+    ~progress_reporter()
+    {
+        stop();
+    }
+
+    bool active() const
+    {
+        return m_active.load(std::memory_order_relaxed);
+    }
+
+    /** \brief Start the background thread.
+     *
+     * \param[in] expected  The expected duration of each test case in
+     * seconds, by name; may be empty.
+     * \param[in] total  The total number of test cases to run.
+     */
+    void start(std::map<std::string, double> const & expected, std::size_t total)
+    {
+        if(m_thread.joinable())
+        {
+            return;
+        }
+        m_expected = expected;
+        m_total = total;
+        for(auto const & e : m_expected)
+        {
+            m_expected_total += e.second;
+        }
+        m_tty = isatty(STDOUT_FILENO) != 0;
+        m_started = std::chrono::steady_clock::now();
+        m_stop = false;
+        m_active = true;
+        m_thread = std::thread(&progress_reporter::run, this);
+    }
+
+    void stop()
+    {
+        if(!m_thread.joinable())
+        {
+            return;
+        }
+        m_active = false;
+        m_stop = true;
+        m_thread.join();
+    }
+
+    /** \brief Forget about the thread in a forked child.
+     *
+     * After a fork(), the child does not have the background thread.
+     */
+    void detach_after_fork()
+    {
+        if(m_thread.joinable())
+        {
+            m_thread.detach();
+        }
+        m_active = false;
+    }
+
+    bool post(progress_event_t type, Catch::StringRef const & name)
+    {
+        if(!active())
+        {
+            return false;
+        }
+
+        std::size_t pos(m_head.load(std::memory_order_relaxed));
+        for(;;)
+        {
+            slot & s(m_ring[pos & (RING_SIZE - 1)]);
+            std::size_t const sequence(s.m_sequence.load(std::memory_order_acquire));
+            std::ptrdiff_t const diff(static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos));
+            if(diff == 0)
+            {
+                if(m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    s.m_type = type;
+                    // no std::min(), it would ODR-use NAME_SIZE
+                    //
+                    s.m_size = name.size() < NAME_SIZE ? name.size() : NAME_SIZE;
+                    memcpy(s.m_name, name.data(), s.m_size);
+                    s.m_sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0)
+            {
+                // the ring is full
+                //
+                if(type == progress_event_t::PROGRESS_EVENT_SECTION_STARTED)
+                {
+                    return true;
+                }
+                std::this_thread::yield();
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+            else
+            {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct slot
+    {
+        std::atomic<std::size_t>    m_sequence = { 0 };
+        progress_event_t            m_type = progress_event_t::PROGRESS_EVENT_SECTION_STARTED;
+        std::size_t                 m_size = 0;
+        char                        m_name[NAME_SIZE] = {};
+    };
+
+    void run()
+    {
+        std::chrono::steady_clock::duration const interval(m_tty
+                        ? std::chrono::milliseconds(100)
+                        : std::chrono::milliseconds(5000));
+        std::chrono::steady_clock::time_point last_draw(std::chrono::steady_clock::now());
+        bool changed(false);
+        for(;;)
+        {
+            bool const stopping(m_stop);
+            changed = drain() || changed;
+            std::chrono::steady_clock::time_point const now(std::chrono::steady_clock::now());
+            if(changed
+            && (now - last_draw >= interval || stopping))
+            {
+                draw(now);
+                last_draw = now;
+                changed = false;
+            }
+            if(stopping)
+            {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        if(m_tty)
+        {
+            write_status("\r\033[K");
+        }
+    }
+
+    bool drain()
+    {
+        bool changed(false);
+        for(;;)
+        {
+            slot & s(m_ring[m_tail & (RING_SIZE - 1)]);
+            if(s.m_sequence.load(std::memory_order_acquire) != m_tail + 1)
+            {
+                return changed;
+            }
+            std::string const name(s.m_name, s.m_size);
+            switch(s.m_type)
+            {
+            case progress_event_t::PROGRESS_EVENT_TEST_STARTED:
+                m_test = name;
+                m_section.clear();
+                break;
+
+            case progress_event_t::PROGRESS_EVENT_SECTION_STARTED:
+                m_section = name;
+                break;
+
+            case progress_event_t::PROGRESS_EVENT_TEST_ENDED:
+                {
+                    ++m_done;
+                    auto const it(m_expected.find(name));
+                    if(it != m_expected.end())
+                    {
+                        m_expected_done += it->second;
+                    }
+                }
+                break;
+
+            default:
+                break;
+
+            }
+            s.m_sequence.store(m_tail + RING_SIZE, std::memory_order_release);
+            ++m_tail;
+            changed = true;
+        }
+    }
+
+    void draw(std::chrono::steady_clock::time_point now)
+    {
+        std::stringstream ss;
+        ss << '['
+           << m_done
+           << '/'
+           << m_total
+           << "] "
+           << m_test;
+        if(!m_section.empty())
+        {
+            ss << ": " << m_section;
+        }
+
+        // the ETA assumes the remaining tests run at the same speed,
+        // relative to the history, as the ones which already ran
+        //
+        double const elapsed(std::chrono::duration<double>(now - m_started).count());
+        if(m_expected_done > 0.0
+        && m_expected_total > m_expected_done)
+        {
+            long const eta(static_cast<long>((m_expected_total - m_expected_done) * elapsed / m_expected_done));
+            ss << " -- ETA "
+               << eta / 60
+               << 'm'
+               << (eta % 60 < 10 ? "0" : "")
+               << eta % 60
+               << 's';
+        }
+
+        std::string line(ss.str());
+        if(m_tty)
+        {
+            winsize ws = {};
+            std::size_t width(80);
+            if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0
+            && ws.ws_col > 1)
+            {
+                width = ws.ws_col;
+            }
+            if(line.length() >= width)
+            {
+                line.resize(width - 1);
+            }
+            write_status("\r\033[K" + line);
+        }
+        else
+        {
+            write_status("progress: " + line + '\n');
+        }
+    }
+
+    static void write_status(std::string const & status)
+    {
+        // bypass std::cout which is not thread safe
+        //
+        char const * ptr(status.data());
+        std::size_t size(status.length());
+        while(size > 0)
+        {
+            ssize_t const r(write(STDOUT_FILENO, ptr, size));
+            if(r < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                return;
+            }
+            ptr += r;
+            size -= static_cast<std::size_t>(r);
+        }
+    }
+
+    slot                                    m_ring[RING_SIZE] = {};
+    std::atomic<std::size_t>                m_head = { 0 };
+    std::size_t                             m_tail = 0;
+    std::atomic<bool>                       m_active = { false };
+    std::atomic<bool>                       m_stop = { false };
+    std::thread                             m_thread = std::thread();
+    bool                                    m_tty = false;
+    std::chrono::steady_clock::time_point   m_started = std::chrono::steady_clock::time_point();
+    std::map<std::string, double>           m_expected = std::map<std::string, double>();
+    double                                  m_expected_total = 0.0;
+    double                                  m_expected_done = 0.0;
+    std::size_t                             m_total = 0;
+    std::size_t                             m_done = 0;
+    std::string                             m_test = std::string();
+    std::string                             m_section = std::string();
+};
+
+
+inline progress_reporter & g_progress_reporter()
+{
+    static progress_reporter reporter;
+
+    return reporter;
+}
+
+
+/** \brief Convert a duration such as "200ms" to microseconds.
+ *
+ * The supported units are "us", "ms", "s" and "m". A number without
+ * a unit is in seconds.
+ *
+ * \exception std::invalid_argument
+ * The string is not a valid duration.
+ *
+ * \param[in] duration  The duration to parse.
+ *
+ * \return The duration in microseconds.
+ */
+inline std::chrono::microseconds parse_duration(std::string const & duration)
+{
+    std::size_t end(0);
+    double value(0.0);
+    try
+    {
+        value = std::stod(duration, &end);
+    }
+    catch(std::logic_error const &)
+    {
+        end = 0;
+    }
+    std::string const unit(duration.substr(end));
+    double multiplier(0.0);
+    if(unit == "us")
+    {
+        multiplier = 1.0;
+    }
+    else if(unit == "ms")
+    {
+        multiplier = 1.0e3;
+    }
+    else if(unit == "s" || unit.empty())
+    {
+        multiplier = 1.0e6;
+    }
+    else if(unit == "m")
+    {
+        multiplier = 60.0e6;
+    }
+    if(end == 0
+    || multiplier == 0.0
+    || value < 0.0)
+    {
+        throw std::invalid_argument("invalid duration \"" + duration + "\"; expected a number followed by us, ms, s or m.");
+    }
+    return std::chrono::microseconds(static_cast<std::chrono::microseconds::rep>(value * multiplier));
+}
+
+
+/** \brief A test case which went over its time budget.
+ */
+struct budget_overrun
+{
+    std::string                 m_test_case = std::string();
+    std::chrono::microseconds   m_duration = std::chrono::microseconds();
+    std::chrono::microseconds   m_budget = std::chrono::microseconds();
+};
+
+
+/** \brief Watch the duration of the test cases.
+ *
+ * A test case gets a time budget from `--max-duration` or from a
+ * `[budget:<duration>]` tag. The watchdog thread wakes up when the budget
+ * of the running test case expires and reports the test case and the
+ * path of the CATCH_START_SECTION() sections which are running. This
+ * helps finding the culprit of a hung test. With `--max-duration-abort`,
+ * the process then gets aborted.
+ *
+ * The test cases which went over their budget are also listed at the end
+ * of the run and the exit code is not zero.
+ *
+ * The thread is only created when the first test case with a budget
+ * starts. The section path is only tracked from that point on.
+ */
+class watchdog
+{
+public:
+    watchdog() = default;
+    watchdog(watchdog const &) = delete;
+    watchdog & operator = (watchdog const &) = delete;
+
+    ~watchdog()
+    {
+        stop();
+    }
+
+    bool enabled() const
+    {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    bool & abort_on_overrun()
+    {
+        return m_abort;
+    }
+
+    void test_started(std::string const & name, std::chrono::microseconds budget)
+    {
+        if(budget.count() <= 0
+        && !enabled())
+        {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if(!m_thread.joinable())
+        {
+            m_enabled = true;
+            m_thread = std::thread(&watchdog::run, this);
+        }
+        m_test_case = name;
+        m_path.clear();
+        m_budget = budget;
+        m_started = std::chrono::steady_clock::now();
+        m_running = budget.count() > 0;
+        m_reported = false;
+        m_cond.notify_all();
+    }
+
+    void test_ended()
+    {
+        if(!enabled())
+        {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if(m_running)
+        {
+            std::chrono::microseconds const duration(std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - m_started));
+            if(duration > m_budget)
+            {
+                m_overruns.push_back(budget_overrun{ m_test_case, duration, m_budget });
+            }
+        }
+        m_running = false;
+        m_cond.notify_all();
+    }
+
+    void section_started(Catch::StringRef const & name)
+    {
+        if(enabled())
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_path.push_back(static_cast<std::string>(name));
+        }
+    }
+
+    void section_ended()
+    {
+        if(enabled())
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if(!m_path.empty())
+            {
+                m_path.pop_back();
+            }
+        }
+    }
+
+    std::vector<budget_overrun> & overruns()
+    {
+        return m_overruns;
+    }
+
+    void stop()
+    {
+        if(m_thread.joinable())
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_stop = true;
+                m_cond.notify_all();
+            }
+            m_thread.join();
+        }
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while(!m_stop)
+        {
+            if(!m_running
+            || m_reported)
+            {
+                m_cond.wait(lock);
+                continue;
+            }
+            std::chrono::steady_clock::time_point const deadline(m_started + m_budget);
+            if(std::chrono::steady_clock::now() < deadline)
+            {
+                m_cond.wait_until(lock, deadline);
+                continue;
+            }
+
+            m_reported = true;
+            std::stringstream ss;
+            ss << "error: watchdog: test case \""
+               << m_test_case
+               << "\" is still running after its budget of "
+               << m_budget.count() / 1000
+               << "ms";
+            if(!m_path.empty())
+            {
+                ss << "; section:";
+                char const * sep(" ");
+                for(auto const & p : m_path)
+                {
+                    ss << sep << '"' << p << '"';
+                    sep = " / ";
+                }
+            }
+            ss << ".\n";
+            std::string const msg(ss.str());
+
+            // catch2 handles SIGABRT by ending the test case which calls
+            // test_ended() so we must not hold the lock here
+            //
+            lock.unlock();
+
+            // bypass std::cerr, the test thread may be using it
+            //
+            if(write(STDERR_FILENO, msg.c_str(), msg.length()) < 0)
+            {
+                // ignore errors
+            }
+            if(m_abort)
+            {
+                abort();
+            }
+
+            lock.lock();
+        }
+    }
+
+    std::mutex                              m_mutex = {};
+    std::condition_variable                 m_cond = {};
+    std::thread                             m_thread = std::thread();
+    std::atomic<bool>                       m_enabled = { false };
+    bool                                    m_abort = false;
+    bool                                    m_stop = false;
+    bool                                    m_running = false;
+    bool                                    m_reported = false;
+    std::string                             m_test_case = std::string();
+    std::vector<std::string>                m_path = std::vector<std::string>();
+    std::chrono::microseconds               m_budget = std::chrono::microseconds();
+    std::chrono::steady_clock::time_point   m_started = std::chrono::steady_clock::time_point();
+    std::vector<budget_overrun>             m_overruns = std::vector<budget_overrun>();
+};
+
+
+inline watchdog & g_watchdog()
+{
+    static watchdog w;
+
+    return w;
+}
+
+
+/** \brief Save the budget overruns of a `--jobs` worker.
+ *
+ * Each line has the duration and budget in microseconds followed by the
+ * name of the test case.
+ *
+ * \param[in] filename  The name of the output file.
+ */
+inline void save_budget_overruns(std::string const & filename)
+{
+    std::ofstream out(filename);
+    for(auto const & o : g_watchdog().overruns())
+    {
+        out << o.m_duration.count()
+            << ' '
+            << o.m_budget.count()
+            << ' '
+            << o.m_test_case
+            << '\n';
+    }
+    if(!out)
+    {
+        throw std::runtime_error("could not write budget overruns to \"" + filename + "\".");
+    }
+}
+
+
+/** \brief Load the budget overruns of a `--jobs` worker.
+ *
+ * \param[in] filename  The name of the file saved by save_budget_overruns().
+ */
+inline void load_budget_overruns(std::string const & filename)
+{
+    std::ifstream in(filename);
+    budget_overrun o;
+    std::int64_t duration(0);
+    std::int64_t budget(0);
+    while(in >> duration >> budget)
+    {
+        in.get();
+        if(!std::getline(in, o.m_test_case))
+        {
+            break;
+        }
+        o.m_duration = std::chrono::microseconds(duration);
+        o.m_budget = std::chrono::microseconds(budget);
+        g_watchdog().overruns().push_back(o);
+    }
+}
+
+
+/** \brief The `--max-duration` of all the test cases.
+ *
+ * Zero means no limit. A `[budget:<duration>]` tag overrides this
+ * value for one test case.
+ */
+inline std::chrono::microseconds & g_max_duration()
+{
+    static std::chrono::microseconds max_duration = std::chrono::microseconds();
+
+    return max_duration;
+}
+
+
+/** \brief Get a `[<name>:<duration>]` tag of a test case.
+ *
+ * \param[in] info  The test case information.
+ * \param[in] name  The name of the tag including the colon (i.e. "budget:").
+ *
+ * \return The duration from the tag or zero if the test case has no such tag.
+ */
+inline std::chrono::microseconds tag_duration(
+      Catch::TestCaseInfo const & info
+    , std::string const & name)
+{
+    for(auto const & tag : info.tags)
+    {
+        if(tag.compare(0, name.length(), name) == 0)
+        {
+            return parse_duration(tag.substr(name.length()));
+        }
+    }
+    return std::chrono::microseconds();
+}
+
+
+/** \brief Get the `[budget:<duration>]` tag of a test case.
+ *
+ * \param[in] info  The test case information.
+ *
+ * \return The budget from the tag or zero if the test case has no such tag.
+ */
+inline std::chrono::microseconds tag_budget(Catch::TestCaseInfo const & info)
+{
+    return tag_duration(info, "budget:");
+}
+
+
+/** \brief Get the time budget of a test case.
+ *
+ * \param[in] info  The test case information.
+ *
+ * \return The budget from the `[budget:...]` tag or g_max_duration().
+ */
+inline std::chrono::microseconds test_budget(Catch::TestCaseInfo const & info)
+{
+    std::chrono::microseconds const budget(tag_budget(info));
+    return budget.count() > 0 ? budget : g_max_duration();
+}
+
+
+/** \brief Verify the `[budget:<duration>]` and `[calibrate:<duration>]`
+ * tags of all the test cases.
+ *
+ * The tags get parsed again by the listener as each test case starts.
+ * There, an invalid duration would abort the whole run without saying
+ * which test case it comes from, so all the tags are checked once
+ * before the tests run.
+ *
+ * \param[in] err  The stream where the errors get printed.
+ *
+ * \return true if all the tags are valid.
+ */
+inline bool verify_budget_tags(std::ostream & err)
+{
+    bool valid(true);
+    for(auto const & t : Catch::getRegistryHub().getTestCaseRegistry().getAllTests())
+    {
+        for(auto const & tag : t.tags)
+        {
+            std::string::size_type const colon(tag.find(':'));
+            if(colon != std::string::npos
+            && (tag.compare(0, colon, "budget") == 0
+                || tag.compare(0, colon, "calibrate") == 0))
+            {
+                try
+                {
+                    parse_duration(tag.substr(colon + 1));
+                }
+                catch(std::invalid_argument const & e)
+                {
+                    err << "fatal error: test case \""
+                        << t.name
+                        << "\" has an invalid [" << tag << "] tag: "
+                        << e.what()
+                        << std::endl;
+                    valid = false;
+                }
+            }
+        }
+    }
+    return valid;
+}
+
+
+/** \brief The `--time-budget` of the calibrated loops.
+ *
+ * Zero means the loops are not calibrated. A `[calibrate:<duration>]` tag
+ * overrides this value for one test case. The `[budget:<duration>]` tag
+ * is the limit of the watchdog and is not used as a calibration target:
+ * filling it would make the test case go over its budget.
+ */
+inline std::chrono::microseconds & g_time_budget()
+{
+    static std::chrono::microseconds time_budget = std::chrono::microseconds();
+
+    return time_budget;
+}
+
+
+/** \brief The start time and budget of the current test case. */
+struct calibration_state
+{
+    std::chrono::steady_clock::time_point   m_started = std::chrono::steady_clock::time_point();
+    std::chrono::microseconds               m_budget = std::chrono::microseconds();
+};
+
+
+inline calibration_state & g_calibration_state()
+{
+    static calibration_state state;
+
+    return state;
+}
+
+
+inline void start_calibration(Catch::TestCaseInfo const & info)
+{
+    calibration_state & state(g_calibration_state());
+    std::chrono::microseconds const budget(tag_duration(info, "calibrate:"));
+    state.m_budget = budget.count() > 0 ? budget : g_time_budget();
+    state.m_started = std::chrono::steady_clock::now();
+}
+
+
+/** \brief Detect builds and environments which run much slower.
+ *
+ * The scale is lowered under valgrind (detected by its preloaded
+ * library) and when the tests were compiled with a sanitizer. The
+ * values are rough slowdowns of those tools.
+ *
+ * \param[out] reason  The name of the tool which was detected.
+ *
+ * \return The default scale, 1.0 if nothing was detected.
+ */
+inline double detect_scale(std::string & reason)
+{
+    char const * preload(getenv("LD_PRELOAD"));
+    if(preload != nullptr
+    && (strstr(preload, "vgpreload") != nullptr
+        || strstr(preload, "valgrind") != nullptr))
+    {
+        reason = "valgrind";
+        return 0.02;
+    }
+
+#if defined(__SANITIZE_THREAD__)
+    reason = "thread sanitizer";
+    return 0.1;
+#elif defined(__SANITIZE_ADDRESS__)
+    reason = "address sanitizer";
+    return 0.5;
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+    reason = "thread sanitizer";
+    return 0.1;
+#elif __has_feature(memory_sanitizer)
+    reason = "memory sanitizer";
+    return 0.3;
+#elif __has_feature(address_sanitizer)
+    reason = "address sanitizer";
+    return 0.5;
+#else
+    return 1.0;
+#endif
+#else
+    return 1.0;
+#endif
+}
+
+
+} // detail namespace
+
+
+/** \brief The maximum number of iterations of scaled_loop().
+ *
+ * A calibrated loop never runs more than scaled(iterations) times this
+ * factor, however fast the machine.
+ */
+constexpr std::size_t SCALED_LOOP_MAX_FACTOR = 100;
+
+
+/** \brief Run a loop with a number of iterations fit to the test case.
+ *
+ * When \p iterations is 0, \p f does not get called, even with a
+ * budget.
+ *
+ * When the test case has no calibration target (see `--time-budget` and
+ * the `[calibrate:<duration>]` tag), this calls \p f with 0 to
+ * scaled(\p iterations) - 1.
+ *
+ * With a target, the first iterations are a calibration pass: they get
+ * timed until they used a tenth of the time left in the target, then
+ * the number of iterations gets chosen so the loop ends within that
+ * time. The loop runs as many iterations as the machine can do, fewer
+ * under valgrind and more on a fast release build, but never more than
+ * scaled(\p iterations) * SCALED_LOOP_MAX_FACTOR.
+ *
+ * \code
+ *     CATCH_TEST_CASE("hash_collisions", "[hash][calibrate:5s]")
+ *     {
+ *         SNAP_CATCH2_NAMESPACE::scaled_loop(1000000, [&](std::size_t idx)
+ *             {
+ *                 ...
+ *             });
+ *     }
+ * \endcode
+ *
+ * \param[in] iterations  The number of iterations at scale 1.0.
+ * \param[in] f  The body of the loop, called with the iteration number.
+ * \param[in] share  The part of the time left in the test case given to
+ * this loop, from 0.0 to 1.0, for test cases with several loops.
+ *
+ * \return The number of iterations which were run.
+ */
+template<typename F>
+std::size_t scaled_loop(std::size_t iterations, F f, double share = 1.0)
+{
+    if(iterations == 0)
+    {
+        return 0;
+    }
+
+    detail::calibration_state const & state(detail::g_calibration_state());
+    if(state.m_budget.count() <= 0)
+    {
+        std::size_t const count(scaled(iterations));
+        for(std::size_t idx(0); idx < count; ++idx)
+        {
+            f(idx);
+        }
+        return count;
+    }
+
+    std::size_t const scaled_iterations(scaled(iterations));
+    std::size_t const max_count(
+              scaled_iterations > std::numeric_limits<std::size_t>::max() / SCALED_LOOP_MAX_FACTOR
+                    ? std::numeric_limits<std::size_t>::max()
+                    : scaled_iterations * SCALED_LOOP_MAX_FACTOR);
+
+    std::chrono::steady_clock::time_point const start(std::chrono::steady_clock::now());
+    std::chrono::duration<double> const available(
+              (state.m_started + state.m_budget - start) * share);
+
+    // calibration pass
+    //
+    std::size_t idx(0);
+    std::chrono::duration<double> elapsed(0.0);
+    do
+    {
+        f(idx);
+        ++idx;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    while(elapsed < available / 10 && idx < max_count);
+
+    // keep 10% of the time as a safety margin
+    //
+    double const left((available - elapsed) * 0.9 / (elapsed / static_cast<double>(idx)));
+    std::size_t count(max_count);
+    if(left < static_cast<double>(max_count - idx))
+    {
+        count = idx + (left > 0.0 ? static_cast<std::size_t>(left) : 0);
+    }
+    for(; idx < count; ++idx)
+    {
+        f(idx);
+    }
+    return count;
+}
+
+
+namespace detail
+{
+
+
+/** \brief Report the result of a latency assertion.
+ *
+ * This function is used by the CATCH_REQUIRE_DURATION_BELOW() macro.
+ *
+ * \param[in] handler  The catch2 assertion handler.
+ * \param[in] duration  The time the expression took.
+ * \param[in] limit  The expected upper bound.
+ */
+inline void report_duration(
+      Catch::AssertionHandler & handler
+    , std::chrono::nanoseconds duration
+    , std::chrono::nanoseconds limit)
+{
+    std::stringstream ss;
+    ss << "took "
+       << static_cast<double>(duration.count()) / 1.0e6
+       << "ms; expected below "
+       << static_cast<double>(limit.count()) / 1.0e6
+       << "ms.";
+    handler.handleMessage(
+              duration < limit
+                    ? Catch::ResultWas::Ok
+                    : Catch::ResultWas::ExplicitFailure
+            , ss.str());
+}
+
+
+/** \brief Track one section.
+ *
+ * An object of this class is created by CATCH_START_SECTION(). When
+ * `--progress` is used, it prints the name of the section (or sends it
+ * to the progress_reporter with `--progress-async`). When the timings
+ * are turned on, it records the wall and CPU time spent in the section.
+ * When `--progress` is used and the allocation tracking is compiled in,
+ * it also prints the number of allocations made by the section. Since
+ * it is an RAII object, the data gets recorded even when the section
+ * exits because of an exception (i.e. a failed CATCH_REQUIRE()).
+ */
+class section_guard
+{
+public:
+    section_guard(Catch::StringRef const & name)
+        : m_name(g_progress() && allocation_guard::tracking() && !g_progress_reporter().active()
+                    ? static_cast<std::string>(name)
+                    : std::string())
+    {
+        if(g_progress()
+        && !g_progress_reporter().post(progress_event_t::PROGRESS_EVENT_SECTION_STARTED, name))
+        {
+            std::cout << "SECTION: " << name << std::endl;
+        }
+
+        g_watchdog().section_started(name);
+
+        if(g_section_timing_enabled())
+        {
+            m_active = true;
+            g_section_path().push_back(static_cast<std::string>(name));
+            if(g_perf_counters())
+            {
+                m_counters = read_perf_counters();
+            }
+            m_cpu = process_cpu_time();
+            m_wall = std::chrono::steady_clock::now();
+        }
+    }
+
+    section_guard(section_guard const &) = delete;
+    section_guard & operator = (section_guard const &) = delete;
+
+    ~section_guard()
+    {
+        g_watchdog().section_ended();
+
+        if(g_progress() && allocation_guard::tracking() && !g_progress_reporter().active())
+        {
+            std::cout
+                << "SECTION END: "
+                << m_name
+                << " -- "
+                << m_allocations.allocations()
+                << " allocations, "
+                << m_allocations.bytes()
+                << " bytes (peak: "
+                << m_allocations.peak_live_bytes()
+                << " bytes)"
+                << std::endl;
+        }
+
+        if(m_active)
+        {
+            std::chrono::duration<double> const wall(std::chrono::steady_clock::now() - m_wall);
+            double const cpu(process_cpu_time() - m_cpu);
+            perf_values const counters(g_perf_counters()
+                        ? read_perf_counters() - m_counters
+                        : perf_values());
+
+            std::vector<std::string> & path(g_section_path());
+            std::string section;
+            for(auto const & p : path)
+            {
+                if(!section.empty())
+                {
+                    section += " / ";
+                }
+                section += p;
+            }
+            path.pop_back();
+
+            std::string const test_case(Catch::getResultCapture().getCurrentTestName());
+            section_timing & t(g_section_timings()[test_case + '\n' + section]);
+            t.m_test_case = test_case;
+            t.m_section = section;
+            ++t.m_count;
+            t.m_wall += wall.count();
+            t.m_cpu += cpu;
+            t.m_max_wall = std::max(t.m_max_wall, wall.count());
+            t.m_counters += counters;
+        }
+    }
+
+private:
+    std::string const                       m_name;
+    allocation_guard const                  m_allocations = {};
+    bool                                    m_active = false;
+    double                                  m_cpu = 0.0;
+    std::chrono::steady_clock::time_point   m_wall = std::chrono::steady_clock::time_point();
+    perf_values                             m_counters = perf_values();
+};
+
+
+/** \brief Add timings to the current list of timings.
+ *
+ * This is used to merge the timings of the `--jobs` workers.
+ *
+ * \param[in] timing  The timing to add.
+ */
+inline void merge_section_timing(section_timing const & timing)
+{
+    section_timing & t(g_section_timings()[timing.m_test_case + '\n' + timing.m_section]);
+    t.m_test_case = timing.m_test_case;
+    t.m_section = timing.m_section;
+    t.m_count += timing.m_count;
+    t.m_wall += timing.m_wall;
+    t.m_cpu += timing.m_cpu;
+    t.m_max_wall = std::max(t.m_max_wall, timing.m_max_wall);
+    t.m_counters += timing.m_counters;
+}
+
+
+/** \brief Get the section timings sorted from the slowest to the fastest.
+ *
+ * \return The sorted list of timings.
+ */
+inline std::vector<section_timing> sorted_section_timings()
+{
+    std::vector<section_timing> result;
+    for(auto const & t : g_section_timings())
+    {
+        result.push_back(t.second);
+    }
+    std::stable_sort(
+          result.begin()
+        , result.end()
+        , [](section_timing const & lhs, section_timing const & rhs)
+          {
+              return lhs.m_wall > rhs.m_wall;
+          });
+    return result;
+}
+
+
+/** \brief Print the slowest sections.
+ *
+ * \param[in] count  The maximum number of sections to print.
+ * \param[in] out  The output stream.
+ */
+inline void print_section_timings(std::size_t count, std::ostream & out)
+{
+    std::vector<section_timing> const timings(sorted_section_timings());
+    count = std::min(count, timings.size());
+
+    std::stringstream ss;
+    ss << "slowest sections (" << count << " of " << timings.size() << "):\n"
+       << "   wall (ms)     cpu (ms)   runs  "
+       << (g_perf_counters() ? "  cycles   instr  br-miss  c-miss  faults  ctx-sw  " : "")
+       << "test case / section\n";
+    for(std::size_t idx(0); idx < count; ++idx)
+    {
+        section_timing const & t(timings[idx]);
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%12.3f %12.3f %6zu  ", t.m_wall * 1000.0, t.m_cpu * 1000.0, t.m_count);
+        ss << buf;
+        if(g_perf_counters())
+        {
+            int const widths[perf_values::COUNT] = { 8, 7, 8, 7, 7, 7 };
+            for(std::size_t c(0); c < perf_values::COUNT; ++c)
+            {
+                perf_counter_t const counter(static_cast<perf_counter_t>(c));
+                ss << std::setw(widths[c])
+                   << (t.m_counters.available(counter) ? format_count(t.m_counters[counter]) : std::string("-"))
+                   << ' ';
+            }
+            ss << ' ';
+        }
+        ss << t.m_test_case << " / " << t.m_section << '\n';
+    }
+    out << ss.str();
+    out.flush();
+}
+
+
+/** \brief Save the section timings in a JSON file.
+ *
+ * The durations are saved in milliseconds.
+ *
+ * \param[in] filename  The name of the output file.
+ */
+inline void save_section_timings(std::string const & filename)
+{
+    std::ofstream out(filename);
+    out << "{\n"
+        << "  \"sections\": [";
+    char const * sep("\n");
+    for(auto const & t : sorted_section_timings())
+    {
+        out << sep
+            << "    {\n"
+            << "      \"test_case\": " << json_string(t.m_test_case) << ",\n"
+            << "      \"section\": " << json_string(t.m_section) << ",\n"
+            << "      \"count\": " << t.m_count << ",\n"
+            << "      \"wall_ms\": " << t.m_wall * 1000.0 << ",\n"
+            << "      \"cpu_ms\": " << t.m_cpu * 1000.0 << ",\n"
+            << "      \"max_wall_ms\": " << t.m_max_wall * 1000.0;
+        if(!t.m_counters.empty())
+        {
+            out << ",\n"
+                << "      \"counters\": ";
+            write_perf_values(out, t.m_counters);
+        }
+        out << "\n"
+            << "    }";
+        sep = ",\n";
+    }
+    out << "\n  ]\n}\n";
+    if(!out)
+    {
+        throw std::runtime_error("could not write section timings to \"" + filename + "\".");
+    }
+}
+
+
+} // detail namespace
+
+
+/** \brief Record latencies in a histogram.
+ *
+ * This histogram works like HdrHistogram: the values (durations in
+ * nanoseconds) are counted in buckets which get wider as the values get
+ * larger so the relative precision is the same for all values. The
+ * buckets are allocated once by the constructor; record() does not
+ * allocate and runs in constant time (a few instructions).
+ *
+ * The values reported by percentile() are the largest value of their
+ * bucket, so they are at most 0.8% above the actual value.
+ *
+ * A histogram is not thread safe. Use one histogram per thread and
+ * merge() them once the threads are done:
+ *
+ * \code
+ *     std::vector<SNAP_CATCH2_NAMESPACE::latency_histogram> h(threads);
+ *     ...each thread calls h[i].measure([&]() { cache.find(key); });...
+ *     for(std::size_t i(1); i < h.size(); ++i)
+ *     {
+ *         h[0].merge(h[i]);
+ *     }
+ *     CATCH_REQUIRE_PERCENTILE_BELOW(h[0], 99.9, std::chrono::microseconds(500));
+ * \endcode
+ */
+class latency_histogram
+{
+public:
+    /** \brief The number of bits kept in each bucket.
+     *
+     * The values below 2^SIGNIFICANT_BITS are counted exactly. Above,
+     * each power of two is divided in 2^(SIGNIFICANT_BITS - 1) buckets.
+     */
+    static constexpr int SIGNIFICANT_BITS = 8;
+    static constexpr std::size_t BUCKET_COUNT =
+                  (std::size_t(1) << SIGNIFICANT_BITS)
+                + (64 - SIGNIFICANT_BITS) * (std::size_t(1) << (SIGNIFICANT_BITS - 1));
+
+    latency_histogram()
+        : m_counts(BUCKET_COUNT)
+    {
+    }
+
+    void record(std::uint64_t nanoseconds)
+    {
+        ++m_counts[bucket(nanoseconds)];
+        ++m_total;
+        m_sum += static_cast<double>(nanoseconds);
+        m_min = std::min(m_min, nanoseconds);
+        m_max = std::max(m_max, nanoseconds);
+    }
+
+    template<typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> duration)
+    {
+        std::int64_t const ns(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+        record(static_cast<std::uint64_t>(std::max(std::int64_t(0), ns)));
+    }
+
+    /** \brief Call \p f and record the time it takes.
+     *
+     * \param[in] f  The function to time.
+     */
+    template<typename F>
+    void measure(F && f)
+    {
+        std::chrono::steady_clock::time_point const start(std::chrono::steady_clock::now());
+        f();
+        record(std::chrono::steady_clock::now() - start);
+    }
+
+    void merge(latency_histogram const & rhs)
+    {
+        for(std::size_t idx(0); idx < BUCKET_COUNT; ++idx)
+        {
+            m_counts[idx] += rhs.m_counts[idx];
+        }
+        m_total += rhs.m_total;
+        m_sum += rhs.m_sum;
+        m_min = std::min(m_min, rhs.m_min);
+        m_max = std::max(m_max, rhs.m_max);
+    }
+
+    void clear()
+    {
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_total = 0;
+        m_sum = 0.0;
+        m_min = std::numeric_limits<std::uint64_t>::max();
+        m_max = 0;
+    }
+
+    std::uint64_t count() const
+    {
+        return m_total;
+    }
+
+    std::chrono::nanoseconds min() const
+    {
+        return std::chrono::nanoseconds(m_total == 0 ? 0 : m_min);
+    }
+
+    std::chrono::nanoseconds max() const
+    {
+        return std::chrono::nanoseconds(m_max);
+    }
+
+    std::chrono::nanoseconds mean() const
+    {
+        return std::chrono::nanoseconds(m_total == 0
+                    ? 0
+                    : static_cast<std::int64_t>(m_sum / static_cast<double>(m_total)));
+    }
+
+    /** \brief Get the value below which \p percent of the values are.
+     *
+     * \param[in] percent  The percentile, from 0.0 to 100.0.
+     *
+     * \return The percentile, or zero if nothing was recorded.
+     */
+    std::chrono::nanoseconds percentile(double percent) const
+    {
+        if(m_total == 0)
+        {
+            return std::chrono::nanoseconds(0);
+        }
+        double const clamped(std::min(100.0, std::max(0.0, percent)));
+        std::uint64_t const target(std::max(
+                      std::uint64_t(1)
+                    , static_cast<std::uint64_t>(std::ceil(clamped / 100.0 * static_cast<double>(m_total)))));
+        std::uint64_t seen(0);
+        for(std::size_t idx(0); idx < BUCKET_COUNT; ++idx)
+        {
+            seen += m_counts[idx];
+            if(seen >= target)
+            {
+                // the largest value of the bucket, but not above the max.
+                //
+                return std::chrono::nanoseconds(std::min(m_max, highest_value(idx)));
+            }
+        }
+        return std::chrono::nanoseconds(m_max);
+    }
+
+private:
+    static std::size_t bucket(std::uint64_t value)
+    {
+        constexpr std::uint64_t linear(std::uint64_t(1) << SIGNIFICANT_BITS);
+        if(value < linear)
+        {
+            return static_cast<std::size_t>(value);
+        }
+        int const msb(63 - __builtin_clzll(value));
+        int const shift(msb - SIGNIFICANT_BITS + 1);
+        constexpr std::uint64_t half(linear / 2);
+        return static_cast<std::size_t>(linear
+                + static_cast<std::uint64_t>(shift - 1) * half
+                + ((value >> shift) - half));
+    }
+
+    static std::uint64_t highest_value(std::size_t idx)
+    {
+        constexpr std::size_t linear(std::size_t(1) << SIGNIFICANT_BITS);
+        if(idx < linear)
+        {
+            return idx;
+        }
+        constexpr std::size_t half(linear / 2);
+        std::size_t const shift((idx - linear) / half + 1);
+        std::uint64_t const top((idx - linear) % half + half);
+        return ((top + 1) << shift) - 1;
+    }
+
+    std::vector<std::uint64_t>  m_counts;
+    std::uint64_t               m_total = 0;
+    double                      m_sum = 0.0;
+    std::uint64_t               m_min = std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t               m_max = 0;
+};
+
+
+namespace detail
+{
+
+
+/** \brief The percentiles of a histogram saved in the JSON report.
+ */
+struct histogram_summary
+{
+    std::string                 m_test_case = std::string();
+    std::string                 m_name = std::string();
+    std::uint64_t               m_count = 0;
+    double                      m_min = 0.0;            // in nanoseconds
+    double                      m_mean = 0.0;
+    double                      m_max = 0.0;
+    std::map<double, double>    m_percentiles = std::map<double, double>();
+};
+
+
+inline std::map<std::string, histogram_summary> & g_histogram_summaries()
+{
+    static std::map<std::string, histogram_summary> summaries;
+
+    return summaries;
+}
+
+
+/** \brief The file where the histograms get saved.
+ *
+ * This is the `--histograms-json` command line option. When empty, the
+ * histograms are not saved.
+ *
+ * \return A read-write reference to the filename.
+ */
+inline std::string & g_histograms_json()
+{
+    static std::string filename = std::string();
+
+    return filename;
+}
+
+
+inline void add_histogram_summary(histogram_summary const & summary)
+{
+    g_histogram_summaries()[summary.m_test_case + '\n' + summary.m_name] = summary;
+}
+
+
+/** \brief Save the histogram summaries in a JSON file.
+ *
+ * The values are in microseconds.
+ *
+ * \param[in] filename  The name of the output file.
+ */
+inline void save_histogram_summaries(std::string const & filename)
+{
+    std::ofstream out(filename);
+    out << "{\n"
+        << "  \"histograms\": [";
+    char const * sep("\n");
+    for(auto const & it : g_histogram_summaries())
+    {
+        histogram_summary const & h(it.second);
+        out << sep
+            << "    {\n"
+            << "      \"test_case\": " << json_string(h.m_test_case) << ",\n"
+            << "      \"name\": " << json_string(h.m_name) << ",\n"
+            << "      \"count\": " << h.m_count << ",\n"
+            << "      \"min_us\": " << h.m_min / 1000.0 << ",\n"
+            << "      \"mean_us\": " << h.m_mean / 1000.0 << ",\n"
+            << "      \"max_us\": " << h.m_max / 1000.0 << ",\n"
+            << "      \"percentiles_us\": {";
+        char const * psep("");
+        for(auto const & p : h.m_percentiles)
+        {
+            out << psep << "\"" << p.first << "\": " << p.second / 1000.0;
+            psep = ", ";
+        }
+        out << "}\n"
+            << "    }";
+        sep = ",\n";
+    }
+    out << "\n  ]\n}\n";
+    if(!out)
+    {
+        throw std::runtime_error("could not write histograms to \"" + filename + "\".");
+    }
+}
+
+
+/** \brief Load histogram summaries saved by save_histogram_summaries().
+ *
+ * \param[in] filename  The name of the file to load.
+ */
+inline void load_histogram_summaries(std::string const & filename)
+{
+    json_value const root(load_json(filename));
+    json_value const * histograms(root.member("histograms"));
+    if(histograms != nullptr)
+    {
+        for(auto const & item : histograms->m_items)
+        {
+            histogram_summary h;
+            h.m_test_case = item.string("test_case");
+            h.m_name = item.string("name");
+            h.m_count = static_cast<std::uint64_t>(item.number("count"));
+            h.m_min = item.number("min_us") * 1000.0;
+            h.m_mean = item.number("mean_us") * 1000.0;
+            h.m_max = item.number("max_us") * 1000.0;
+            json_value const * percentiles(item.member("percentiles_us"));
+            if(percentiles != nullptr)
+            {
+                for(auto const & p : percentiles->m_members)
+                {
+                    h.m_percentiles[std::stod(p.first)] = p.second.m_number * 1000.0;
+                }
+            }
+            add_histogram_summary(h);
+        }
+    }
+}
+
+
+/** \brief Format a duration with a unit which keeps it readable.
+ *
+ * \param[in] duration  The duration to format.
+ *
+ * \return The duration as a string such as "12.5us".
+ */
+inline std::string format_duration(std::chrono::nanoseconds duration)
+{
+    double const ns(static_cast<double>(duration.count()));
+    char buf[32];
+    if(ns >= 1.0e9)
+    {
+        snprintf(buf, sizeof(buf), "%.3gs", ns / 1.0e9);
+    }
+    else if(ns >= 1.0e6)
+    {
+        snprintf(buf, sizeof(buf), "%.3gms", ns / 1.0e6);
+    }
+    else if(ns >= 1.0e3)
+    {
+        snprintf(buf, sizeof(buf), "%.3gus", ns / 1.0e3);
+    }
+    else
+    {
+        snprintf(buf, sizeof(buf), "%.0fns", ns);
+    }
+    return buf;
+}
+
+
+} // detail namespace
+
+
+/** \brief Save the percentiles of a histogram in the JSON report.
+ *
+ * When the `--histograms-json` command line option is used, the count,
+ * minimum, mean, maximum and main percentiles (50, 90, 99, 99.9, 99.99)
+ * of \p histogram get saved in that file under \p name and the name of
+ * the current test case. Otherwise this function does nothing.
+ *
+ * The CATCH_REQUIRE_PERCENTILE_BELOW() macro calls this function with
+ * the name of the histogram variable.
+ *
+ * \param[in] name  The name of the histogram.
+ * \param[in] histogram  The histogram to report.
+ */
+inline void report_histogram(std::string const & name, latency_histogram const & histogram)
+{
+    if(detail::g_histograms_json().empty())
+    {
+        return;
+    }
+
+    detail::histogram_summary h;
+    h.m_test_case = Catch::getResultCapture().getCurrentTestName();
+    h.m_name = name;
+    h.m_count = histogram.count();
+    h.m_min = static_cast<double>(histogram.min().count());
+    h.m_mean = static_cast<double>(histogram.mean().count());
+    h.m_max = static_cast<double>(histogram.max().count());
+    for(double const p : { 50.0, 90.0, 99.0, 99.9, 99.99 })
+    {
+        h.m_percentiles[p] = static_cast<double>(histogram.percentile(p).count());
+    }
+    detail::add_histogram_summary(h);
+}
+
+
+namespace detail
+{
+
+
+/** \brief Report the result of a percentile assertion.
+ *
+ * This function is used by the CATCH_REQUIRE_PERCENTILE_BELOW() macro.
+ *
+ * \param[in] handler  The catch2 assertion handler.
+ * \param[in] name  The name of the histogram.
+ * \param[in] histogram  The histogram to check.
+ * \param[in] percent  The percentile to check.
+ * \param[in] limit  The expected upper bound.
+ */
+inline void report_percentile(
+      Catch::AssertionHandler & handler
+    , char const * name
+    , latency_histogram const & histogram
+    , double percent
+    , std::chrono::nanoseconds limit)
+{
+    report_histogram(name, histogram);
+
+    std::chrono::nanoseconds const value(histogram.percentile(percent));
+    std::stringstream ss;
+    ss << "p" << percent
+       << " of " << name
+       << " is " << format_duration(value)
+       << " (" << histogram.count() << " values, max: "
+       << format_duration(histogram.max())
+       << "); expected below " << format_duration(limit)
+       << ".";
+    handler.handleMessage(
+              histogram.count() > 0 && value < limit
+                    ? Catch::ResultWas::Ok
+                    : Catch::ResultWas::ExplicitFailure
+            , ss.str());
+}
+
+
+} // detail namespace
+
+
+namespace detail
+{
+
+
+/** \brief The stress test settings found on the command line.
+ *
+ * These are the `--stress-threads`, `--stress-duration`,
+ * `--stress-warmup` and `--stress-pin` command line options. When
+ * defined, they override the settings of all the stress_test objects
+ * so a CI job can run a longer soak test without changing the code.
+ */
+struct stress_settings
+{
+    std::vector<std::size_t>    m_threads = std::vector<std::size_t>();
+    std::chrono::microseconds   m_duration = std::chrono::microseconds(0);
+    std::chrono::microseconds   m_warmup = std::chrono::microseconds(0);
+    bool                        m_has_warmup = false;
+    bool                        m_pin = false;
+};
+
+
+inline stress_settings & g_stress_settings()
+{
+    static stress_settings settings;
+
+    return settings;
+}
+
+
+/** \brief Parse a list of thread counts.
+ *
+ * The list is a comma separated list of numbers such as "1,2,4,8". The
+ * word "max" represents the number of hardware threads.
+ *
+ * \exception std::invalid_argument
+ * The list includes something other than a positive number or "max".
+ *
+ * \param[in] counts  The list of thread counts to parse.
+ *
+ * \return The thread counts.
+ */
+inline std::vector<std::size_t> parse_thread_counts(std::string const & counts)
+{
+    std::vector<std::size_t> result;
+    std::string::size_type start(0);
+    for(;;)
+    {
+        std::string::size_type const comma(counts.find(',', start));
+        std::string const count(counts.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+        if(count == "max")
+        {
+            result.push_back(std::max(1U, std::thread::hardware_concurrency()));
+        }
+        else
+        {
+            char * end(nullptr);
+            unsigned long const value(strtoul(count.c_str(), &end, 10));
+            if(count.empty()
+            || *end != '\0'
+            || value == 0
+            || value > 4096)
+            {
+                throw std::invalid_argument("invalid thread count \"" + count + "\"; expected a number from 1 to 4096 or \"max\".");
+            }
+            result.push_back(value);
+        }
+        if(comma == std::string::npos)
+        {
+            return result;
+        }
+        start = comma + 1;
+    }
+}
+
+
+/** \brief The default list of thread counts of a stress test.
+ *
+ * The list includes the powers of two up to the number of hardware
+ * threads and that number, i.e. "1,2,4,6" on a computer with 6 threads.
+ *
+ * \return The thread counts.
+ */
+inline std::vector<std::size_t> default_thread_counts()
+{
+    std::size_t const max(std::max(1U, std::thread::hardware_concurrency()));
+    std::vector<std::size_t> result;
+    for(std::size_t count(1); count < max; count *= 2)
+    {
+        result.push_back(count);
+    }
+    result.push_back(max);
+    return result;
+}
+
+
+} // detail namespace
+
+
+/** \brief The context passed to the operations of a stress test.
+ *
+ * The context tells the operation which thread runs it. It can be used
+ * to select a per thread slot of the data being tested. The thread
+ * can also use SNAP_CATCH2_NAMESPACE::rng() to get its own random
+ * numbers.
+ */
+class stress_context
+{
+public:
+    /** \brief The index of this thread, from 0 to threads() - 1.
+     */
+    std::size_t thread() const
+    {
+        return m_thread;
+    }
+
+    /** \brief The number of threads running this round.
+     */
+    std::size_t threads() const
+    {
+        return m_threads;
+    }
+
+    /** \brief Whether the operation runs during the warmup.
+     *
+     * The operations run during the warmup are not counted.
+     */
+    bool warming_up() const
+    {
+        return m_warming_up;
+    }
+
+private:
+    friend class stress_test;
+
+    std::size_t     m_thread = 0;
+    std::size_t     m_threads = 0;
+    bool            m_warming_up = true;
+};
+
+
+/** \brief The results of one thread of a stress test round.
+ */
+struct stress_thread_result
+{
+    std::uint64_t               m_operations = 0;
+    std::chrono::nanoseconds    m_duration = std::chrono::nanoseconds(0);
+    std::uint64_t               m_stolen = 0;       // number of chunks stolen
+    int                         m_cpu = -1;         // -1 when not pinned
+
+    double ops_per_second() const
+    {
+        return m_duration.count() <= 0
+                ? 0.0
+                : static_cast<double>(m_operations) * 1.0e9 / static_cast<double>(m_duration.count());
+    }
+};
+
+
+/** \brief The results of one round of a stress test.
+ *
+ * A stress test runs one round per thread count. The duration is the
+ * time from the first thread starting its measurement to the last
+ * thread stopping.
+ */
+struct stress_result
+{
+    std::size_t                         m_threads = 0;
+    std::uint64_t                       m_operations = 0;
+    std::chrono::nanoseconds            m_duration = std::chrono::nanoseconds(0);
+    std::vector<std::uint64_t>          m_operation_counts = std::vector<std::uint64_t>();     // per operation, in order of addition
+    std::vector<stress_thread_result>   m_per_thread = std::vector<stress_thread_result>();
+
+    double ops_per_second() const
+    {
+        return m_duration.count() <= 0
+                ? 0.0
+                : static_cast<double>(m_operations) * 1.0e9 / static_cast<double>(m_duration.count());
+    }
+};
+
+
+/** \brief Run operations on many threads to stress a data structure.
+ *
+ * A stress test runs its operations on a pool of threads, once per
+ * thread count (a round), and prints the throughput of each round in a
+ * scaling table: the total number of operations per second, the number
+ * per thread (mean, minimum and maximum), the speedup compared to the
+ * first round and the efficiency (the speedup divided by the increase
+ * in threads).
+ *
+ * Each round starts with a warmup during which the operations run but
+ * are not counted. Then the operations run for the specified duration
+ * or, when set_iterations() was called, until that many operations ran.
+ * In the latter case, the iterations are cut in chunks distributed
+ * between the threads and a thread which is done with its own chunks
+ * steals half of the chunks of another thread, so a thread slowed down
+ * by contention or preemption does not make the round last longer.
+ *
+ * The operations are selected in a round robin manner following their
+ * weight. With a weight of 3 for push and 1 for pop, each thread runs
+ * three push() for each pop(). The threads start at a different place
+ * in that schedule.
+ *
+ * \code
+ *     SNAP_CATCH2_NAMESPACE::stress_test stress("fifo");
+ *     stress.add_operation("push", [&fifo](SNAP_CATCH2_NAMESPACE::stress_context & c)
+ *         {
+ *             fifo.push(c.thread());
+ *         }, 3);
+ *     stress.add_operation("pop", [&fifo](SNAP_CATCH2_NAMESPACE::stress_context &)
+ *         {
+ *             fifo.pop();     // returns false when empty
+ *         });
+ *     stress.set_before_round([&fifo](std::size_t) { fifo.clear(); });
+ *     stress.set_after_round([&fifo](SNAP_CATCH2_NAMESPACE::stress_result const & r)
+ *         {
+ *             CATCH_REQUIRE(fifo.size() <= fifo.max_size());
+ *             CATCH_REQUIRE(r.ops_per_second() > 1000.0);
+ *         });
+ *     stress.run();
+ * \endcode
+ *
+ * The catch2 assertions are not thread safe. Use a thread_checker in
+ * the operations and check the invariants in the after round callback,
+ * which runs in the thread of the test case. If an operation throws,
+ * the round stops and the exception is re-thrown by run().
+ *
+ * The `--stress-threads`, `--stress-duration`, `--stress-warmup` and
+ * `--stress-pin` command line options override the settings of all the
+ * stress tests.
+ */
+class stress_test
+{
+public:
+    typedef std::function<void(stress_context &)>   operation_t;
+    typedef std::function<void(std::size_t)>        before_round_t;
+    typedef std::function<void(stress_result const &)> after_round_t;
+
+    explicit stress_test(std::string const & name)
+        : m_name(name)
+    {
+    }
+
+    /** \brief Add an operation to the stress test.
+     *
+     * \param[in] name  The name of the operation.
+     * \param[in] op  The function to run.
+     * \param[in] weight  The number of times the operation runs compared
+     *                    to the other operations.
+     */
+    void add_operation(std::string const & name, operation_t op, unsigned weight = 1)
+    {
+        if(weight == 0)
+        {
+            throw std::invalid_argument("the weight of stress operation \"" + name + "\" must be at least 1.");
+        }
+        m_operations.push_back({ name, op, weight });
+    }
+
+    /** \brief Set the thread counts, one round per count.
+     *
+     * The rounds run in increasing order of thread count. By default,
+     * the rounds use the powers of two up to the number of hardware
+     * threads and that number.
+     *
+     * \param[in] threads  The thread counts.
+     */
+    void set_threads(std::vector<std::size_t> const & threads)
+    {
+        m_threads = threads;
+    }
+
+    template<typename Rep, typename Period>
+    void set_duration(std::chrono::duration<Rep, Period> duration)
+    {
+        m_duration = std::chrono::duration_cast<std::chrono::microseconds>(duration);
+    }
+
+    template<typename Rep, typename Period>
+    void set_warmup(std::chrono::duration<Rep, Period> warmup)
+    {
+        m_warmup = std::chrono::duration_cast<std::chrono::microseconds>(warmup);
+    }
+
+    /** \brief Run a fixed number of operations instead of a duration.
+     *
+     * \param[in] iterations  The number of operations of each round, or
+     *                        0 to run for the duration.
+     */
+    void set_iterations(std::uint64_t iterations)
+    {
+        m_iterations = iterations;
+    }
+
+    /** \brief Pin each thread to one CPU.
+     *
+     * The threads get pinned to the CPUs the process is allowed to run
+     * on, in order. With more threads than CPUs, some CPUs get more
+     * than one thread.
+     *
+     * \param[in] pin  Whether to pin the threads.
+     */
+    void set_pin(bool pin)
+    {
+        m_pin = pin;
+    }
+
+    /** \brief Set a function called before each round.
+     *
+     * The function receives the number of threads of the round.
+     */
+    void set_before_round(before_round_t f)
+    {
+        m_before_round = f;
+    }
+
+    /** \brief Set a function called after each round.
+     *
+     * This function runs in the thread of the test case once all the
+     * threads of the round were joined, so it can use the catch2
+     * assertions to verify the invariants.
+     */
+    void set_after_round(after_round_t f)
+    {
+        m_after_round = f;
+    }
+
+    /** \brief Run all the rounds and print the scaling table.
+     *
+     * \exception std::logic_error
+     * No operation was added.
+     *
+     * \param[in] out  The stream where the table gets printed.
+     *
+     * \return The results of each round.
+     */
+    std::vector<stress_result> run(std::ostream & out = std::cout)
+    {
+        if(m_operations.empty())
+        {
+            throw std::logic_error("stress test \"" + m_name + "\" has no operations.");
+        }
+
+        detail::stress_settings const & settings(detail::g_stress_settings());
+        std::vector<std::size_t> threads(!settings.m_threads.empty()
+                    ? settings.m_threads
+                    : (m_threads.empty() ? detail::default_thread_counts() : m_threads));
+        std::sort(threads.begin(), threads.end());
+        threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+        std::chrono::microseconds const duration(settings.m_duration.count() > 0
+                    ? settings.m_duration
+                    : m_duration);
+        std::chrono::microseconds const warmup(settings.m_has_warmup
+                    ? settings.m_warmup
+                    : m_warmup);
+        bool const pin(m_pin || settings.m_pin);
+
+        std::stringstream ss;
+        ss << "\nstress test \"" << m_name << "\" (";
+        if(m_iterations > 0)
+        {
+            ss << m_iterations << " operations";
+        }
+        else
+        {
+            ss << detail::format_duration(duration);
+        }
+        ss << ", warmup: " << detail::format_duration(warmup)
+           << (pin ? ", pinned" : "")
+           << "):\n"
+           << "  threads  total ops/s   ops/s per thread (min - max)   speedup  efficiency\n";
+        out << ss.str() << std::flush;
+
+        std::vector<stress_result> results;
+        for(auto const count : threads)
+        {
+            if(m_before_round)
+            {
+                m_before_round(count);
+            }
+            results.push_back(run_round(count, duration, warmup, pin));
+            print_round(results.front(), results.back(), out);
+            if(m_after_round)
+            {
+                m_after_round(results.back());
+            }
+        }
+
+        return results;
+    }
+
+private:
+    struct operation
+    {
+        std::string     m_name;
+        operation_t     m_function;
+        unsigned        m_weight;
+    };
+
+    enum class phase_t
+    {
+        PHASE_WARMUP,
+        PHASE_MEASURE,
+        PHASE_STOP
+    };
+
+    struct worker
+    {
+        std::mutex                              m_mutex = {};
+        std::deque<std::uint64_t>               m_chunks = std::deque<std::uint64_t>();
+        std::vector<std::uint64_t>              m_operation_counts = std::vector<std::uint64_t>();
+        stress_thread_result                    m_result = stress_thread_result();
+        std::chrono::steady_clock::time_point   m_start = std::chrono::steady_clock::time_point();
+        std::chrono::steady_clock::time_point   m_end = std::chrono::steady_clock::time_point();
+    };
+
+    struct round_state
+    {
+        std::vector<std::size_t>                m_schedule = std::vector<std::size_t>();
+        std::vector<std::unique_ptr<worker>>    m_workers = std::vector<std::unique_ptr<worker>>();
+        std::vector<int>                        m_cpus = std::vector<int>();
+        std::atomic<phase_t>                    m_phase = { phase_t::PHASE_WARMUP };
+        std::atomic<std::size_t>                m_ready = { 0 };
+        std::atomic<bool>                       m_go = { false };
+        std::mutex                              m_mutex = {};
+        std::exception_ptr                      m_exception = std::exception_ptr();
+    };
+
+    static std::vector<int> allowed_cpus()
+    {
+        std::vector<int> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if(sched_getaffinity(0, sizeof(set), &set) == 0)
+        {
+            for(int cpu(0); cpu < CPU_SETSIZE; ++cpu)
+            {
+                if(CPU_ISSET(cpu, &set))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        return cpus;
+    }
+
+    static bool next_chunk(round_state & state, std::size_t idx, std::uint64_t & chunk)
+    {
+        worker & w(*state.m_workers[idx]);
+        {
+            std::lock_guard<std::mutex> lock(w.m_mutex);
+            if(!w.m_chunks.empty())
+            {
+                chunk = w.m_chunks.back();
+                w.m_chunks.pop_back();
+                return true;
+            }
+        }
+
+        // our own deque is empty, steal half of the chunks of another
+        // thread, taking the oldest ones (the front of its deque)
+        //
+        std::size_t const count(state.m_workers.size());
+        for(std::size_t offset(1); offset < count; ++offset)
+        {
+            worker & victim(*state.m_workers[(idx + offset) % count]);
+            std::deque<std::uint64_t> stolen;
+            {
+                std::lock_guard<std::mutex> lock(victim.m_mutex);
+                std::size_t const half((victim.m_chunks.size() + 1) / 2);
+                stolen.assign(victim.m_chunks.begin(), victim.m_chunks.begin() + half);
+                victim.m_chunks.erase(victim.m_chunks.begin(), victim.m_chunks.begin() + half);
+            }
+            if(!stolen.empty())
+            {
+                ++w.m_result.m_stolen;
+                chunk = stolen.back();
+                stolen.pop_back();
+                std::lock_guard<std::mutex> lock(w.m_mutex);
+                w.m_chunks.insert(w.m_chunks.end(), stolen.begin(), stolen.end());
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void run_thread(round_state & state, std::size_t idx)
+    {
+        worker & w(*state.m_workers[idx]);
+        if(!state.m_cpus.empty())
+        {
+            int const cpu(state.m_cpus[idx % state.m_cpus.size()]);
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+            {
+                w.m_result.m_cpu = cpu;
+            }
+        }
+
+        stress_context context;
+        context.m_thread = idx;
+        context.m_threads = state.m_workers.size();
+        std::size_t const schedule_size(state.m_schedule.size());
+        std::size_t position(idx * schedule_size / state.m_workers.size());
+
+        ++state.m_ready;
+        while(!state.m_go.load())
+        {
+            std::this_thread::yield();
+        }
+
+        try
+        {
+            // warmup
+            //
+            while(state.m_phase.load(std::memory_order_relaxed) == phase_t::PHASE_WARMUP)
+            {
+                m_operations[state.m_schedule[position]].m_function(context);
+                position = (position + 1) % schedule_size;
+            }
+
+            context.m_warming_up = false;
+            w.m_start = std::chrono::steady_clock::now();
+            if(m_iterations > 0)
+            {
+                std::uint64_t chunk(0);
+                while(state.m_phase.load(std::memory_order_relaxed) != phase_t::PHASE_STOP
+                   && next_chunk(state, idx, chunk))
+                {
+                    for(; chunk > 0; --chunk)
+                    {
+                        std::size_t const op(state.m_schedule[position]);
+                        m_operations[op].m_function(context);
+                        ++w.m_operation_counts[op];
+                        position = (position + 1) % schedule_size;
+                    }
+                }
+            }
+            else
+            {
+                while(state.m_phase.load(std::memory_order_relaxed) != phase_t::PHASE_STOP)
+                {
+                    std::size_t const op(state.m_schedule[position]);
+                    m_operations[op].m_function(context);
+                    ++w.m_operation_counts[op];
+                    position = (position + 1) % schedule_size;
+                }
+            }
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock(state.m_mutex);
+            if(state.m_exception == nullptr)
+            {
+                state.m_exception = std::current_exception();
+            }
+            state.m_phase = phase_t::PHASE_STOP;
+        }
+        w.m_end = std::chrono::steady_clock::now();
+        if(w.m_start == std::chrono::steady_clock::time_point())
+        {
+            w.m_start = w.m_end;
+        }
+    }
+
+    stress_result run_round(
+          std::size_t count
+        , std::chrono::microseconds duration
+        , std::chrono::microseconds warmup
+        , bool pin)
+    {
+        round_state state;
+        for(std::size_t op(0); op < m_operations.size(); ++op)
+        {
+            state.m_schedule.insert(state.m_schedule.end(), m_operations[op].m_weight, op);
+        }
+        if(pin)
+        {
+            state.m_cpus = allowed_cpus();
+        }
+        for(std::size_t idx(0); idx < count; ++idx)
+        {
+            state.m_workers.emplace_back(new worker);
+            state.m_workers.back()->m_operation_counts.resize(m_operations.size());
+        }
+        if(m_iterations > 0)
+        {
+            // about 16 chunks per thread so there is something to steal
+            //
+            std::uint64_t const size(std::max(std::uint64_t(1), m_iterations / (count * 16)));
+            std::uint64_t left(m_iterations);
+            for(std::size_t idx(0); left > 0; idx = (idx + 1) % count)
+            {
+                std::uint64_t const chunk(std::min(size, left));
+                state.m_workers[idx]->m_chunks.push_back(chunk);
+                left -= chunk;
+            }
+        }
+
+        std::vector<std::thread> threads;
+        threads.reserve(count);
+        for(std::size_t idx(0); idx < count; ++idx)
+        {
+            threads.emplace_back(&stress_test::run_thread, this, std::ref(state), idx);
+        }
+        while(state.m_ready.load() < count)
+        {
+            std::this_thread::yield();
+        }
+
+        // sleep_until() on the phase deadlines, unless an operation
+        // threw in which case the phase is already PHASE_STOP
+        //
+        auto wait = [&state](std::chrono::steady_clock::time_point deadline)
+        {
+            while(state.m_phase.load() != phase_t::PHASE_STOP)
+            {
+                std::chrono::steady_clock::time_point const now(std::chrono::steady_clock::now());
+                if(now >= deadline)
+                {
+                    return;
+                }
+                std::this_thread::sleep_for(std::min(
+                          std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::milliseconds(10))
+                        , deadline - now));
+            }
+        };
+        std::chrono::steady_clock::time_point const start(std::chrono::steady_clock::now());
+        state.m_go = true;
+        wait(start + warmup);
+        phase_t expected(phase_t::PHASE_WARMUP);
+        state.m_phase.compare_exchange_strong(expected, phase_t::PHASE_MEASURE);
+        if(m_iterations == 0)
+        {
+            wait(start + warmup + duration);
+            state.m_phase = phase_t::PHASE_STOP;
+        }
+        for(auto & t : threads)
+        {
+            t.join();
+        }
+        if(state.m_exception != nullptr)
+        {
+            std::rethrow_exception(state.m_exception);
+        }
+
+        stress_result result;
+        result.m_threads = count;
+        result.m_operation_counts.resize(m_operations.size());
+        std::chrono::steady_clock::time_point first(state.m_workers[0]->m_start);
+        std::chrono::steady_clock::time_point last(state.m_workers[0]->m_end);
+        for(auto const & w : state.m_workers)
+        {
+            for(std::size_t op(0); op < m_operations.size(); ++op)
+            {
+                w->m_result.m_operations += w->m_operation_counts[op];
+                result.m_operation_counts[op] += w->m_operation_counts[op];
+            }
+            w->m_result.m_duration = std::chrono::duration_cast<std::chrono::nanoseconds>(w->m_end - w->m_start);
+            result.m_operations += w->m_result.m_operations;
+            result.m_per_thread.push_back(w->m_result);
+            first = std::min(first, w->m_start);
+            last = std::max(last, w->m_end);
+        }
+        result.m_duration = std::chrono::duration_cast<std::chrono::nanoseconds>(last - first);
+
+        return result;
+    }
+
+    void print_round(stress_result const & base, stress_result const & r, std::ostream & out) const
+    {
+        double min(std::numeric_limits<double>::max());
+        double max(0.0);
+        for(auto const & t : r.m_per_thread)
+        {
+            min = std::min(min, t.ops_per_second());
+            max = std::max(max, t.ops_per_second());
+        }
+        double const speedup(base.ops_per_second() > 0.0
+                    ? r.ops_per_second() / base.ops_per_second()
+                    : 0.0);
+        double const efficiency(speedup * static_cast<double>(base.m_threads) / static_cast<double>(r.m_threads));
+
+        std::stringstream ss;
+        char buf[128];
+        snprintf(buf, sizeof(buf), "  %7zu  %11s  %10s (%7s - %7s)     %6.2fx  %9.0f%%\n"
+                , r.m_threads
+                , detail::format_count(r.ops_per_second()).c_str()
+                , detail::format_count(r.ops_per_second() / static_cast<double>(r.m_threads)).c_str()
+                , detail::format_count(min).c_str()
+                , detail::format_count(max).c_str()
+                , speedup
+                , efficiency * 100.0);
+        ss << buf;
+        if(g_verbose())
+        {
+            for(std::size_t idx(0); idx < r.m_per_thread.size(); ++idx)
+            {
+                stress_thread_result const & t(r.m_per_thread[idx]);
+                ss << "           thread " << idx;
+                if(t.m_cpu >= 0)
+                {
+                    ss << " (cpu " << t.m_cpu << ")";
+                }
+                ss << ": " << detail::format_count(t.ops_per_second()) << " ops/s";
+                if(t.m_stolen > 0)
+                {
+                    ss << ", " << t.m_stolen << " steals";
+                }
+                ss << '\n';
+            }
+            for(std::size_t op(0); op < m_operations.size(); ++op)
+            {
+                double const seconds(static_cast<double>(r.m_duration.count()) / 1.0e9);
+                ss << "           \"" << m_operations[op].m_name << "\": "
+                   << detail::format_count(seconds > 0.0 ? static_cast<double>(r.m_operation_counts[op]) / seconds : 0.0)
+                   << " ops/s\n";
+            }
+        }
+        out << ss.str() << std::flush;
+    }
+
+    std::string                 m_name;
+    std::vector<operation>      m_operations = std::vector<operation>();
+    std::vector<std::size_t>    m_threads = std::vector<std::size_t>();
+    std::chrono::microseconds   m_duration = std::chrono::microseconds(250000);
+    std::chrono::microseconds   m_warmup = std::chrono::microseconds(50000);
+    std::uint64_t               m_iterations = 0;
+    bool                        m_pin = false;
+    before_round_t              m_before_round = before_round_t();
+    after_round_t               m_after_round = after_round_t();
+};
+
+
+/** \brief The number of examples tried by each property.
+ *
+ * This is the `--property-examples` command line option. Each
+ * CATCH_PROPERTY() runs its body with that many random inputs unless
+ * one of them fails first.
+ *
+ * \return A read-write reference to the number of examples.
+ */
+inline std::size_t & g_property_examples()
+{
+    static std::size_t examples = 100;
+
+    return examples;
+}
+
+
+/** \brief The number of threads used to shrink a failing example.
+ *
+ * This is the `--property-threads` command line option. The default, 0,
+ * uses one thread per CPU. Use 1 if your properties are not thread safe.
+ *
+ * \return A read-write reference to the number of threads.
+ */
+inline std::size_t & g_property_threads()
+{
+    static std::size_t threads = 0;
+
+    return threads;
+}
+
+
+namespace detail
+{
+
+
+/** \brief The input replayed by all the properties.
+ *
+ * This is the `--property-input` command line option, the name of a
+ * file saved by a failing property or found by libFuzzer.
+ *
+ * \return A read-write reference to the filename.
+ */
+inline std::string & g_property_input()
+{
+    static std::string filename;
+
+    return filename;
+}
+
+
+/** \brief The maximum number of random bytes used by one example.
+ *
+ * Once an example read that many bytes, the generators only get zeroes,
+ * which means the smallest values they can produce.
+ */
+constexpr std::size_t PROPERTY_MAX_INPUT_SIZE = 8 * 1024;
+
+
+/** \brief Exception raised by CATCH_PROPERTY_CHECK().
+ *
+ * It does not derive from std::exception so a property catching
+ * std::exception does not hide a failure. It does not allocate either.
+ */
+struct property_failure
+{
+    char const *        m_file = nullptr;
+    int                 m_line = 0;
+    char const *        m_expression = nullptr;
+};
+
+
+/** \brief Exception raised by CATCH_PROPERTY_ASSUME().
+ *
+ * The example gets discarded instead of failing.
+ */
+struct property_reject
+{
+};
+
+
+inline std::string demangle(char const * name)
+{
+    int status(0);
+    std::unique_ptr<char, void (*)(void *)> demangled(
+              abi::__cxa_demangle(name, nullptr, nullptr, &status)
+            , &free);
+    return status == 0 && demangled != nullptr
+                ? std::string(demangled.get())
+                : std::string(name);
+}
+
+
+} // detail namespace
+
+
+template<typename T>
+class generator;
+
+
+/** \brief The source of the values drawn by a property.
+ *
+ * A property does not get random numbers directly. Instead, its
+ * generators read bytes from this object and turn them into values.
+ * In a unit test the bytes come from rng(); once an example fails, the
+ * shrinker replays smaller and smaller byte sequences until it finds
+ * the smallest one which still fails. Under libFuzzer, the bytes are
+ * the fuzzer input.
+ *
+ * The generators are written so smaller bytes give simpler values and
+ * missing bytes read as zeroes: integers move toward 0, containers get
+ * shorter, etc. This is what makes the shrinking work with any
+ * generator, including your own composed ones.
+ */
+class property_input
+{
+public:
+    /** \brief Replay a sequence of bytes.
+     *
+     * The \p data buffer must stay valid while the object exists.
+     *
+     * \param[in] data  The bytes to read.
+     * \param[in] size  The number of bytes in \p data.
+     */
+    property_input(std::uint8_t const * data, std::size_t size)
+        : m_data(data)
+        , m_size(size)
+    {
+    }
+
+    /** \brief Generate random bytes as they get read.
+     *
+     * The bytes are saved so the example can be replayed.
+     *
+     * \param[in] generator  The random generator.
+     * \param[in] max_size  The maximum number of bytes to generate.
+     */
+    property_input(random_generator & generator, std::size_t max_size)
+        : m_generator(&generator)
+        , m_size(max_size)
+    {
+    }
+
+    property_input(property_input const &) = delete;
+    property_input & operator = (property_input const &) = delete;
+
+    /** \brief Draw a value from a generator.
+     *
+     * When the failing example gets replayed, the values drawn with
+     * this function are listed in the failure message.
+     *
+     * \param[in] g  The generator.
+     *
+     * \return The value.
+     */
+    template<typename T>
+    T draw(generator<T> const & g)
+    {
+        T value(g(*this));
+#ifndef SNAP_CATCH2_FUZZER
+        if(m_notes != nullptr)
+        {
+            m_notes->push_back(Catch::Detail::stringify(value));
+        }
+#endif
+        return value;
+    }
+
+    std::uint8_t byte()
+    {
+        std::size_t const pos(m_pos++);
+        if(m_generator == nullptr)
+        {
+            return pos < m_size ? m_data[pos] : 0;
+        }
+        if(pos >= m_size)
+        {
+            return 0;
+        }
+        if(m_random_bytes == 0)
+        {
+            m_random = (*m_generator)();
+            m_random_bytes = sizeof(m_random);
+        }
+        std::uint8_t const result(static_cast<std::uint8_t>(m_random));
+        m_random >>= 8;
+        --m_random_bytes;
+        m_generated.push_back(result);
+        return result;
+    }
+
+    /** \brief Read \p count bits, from 1 to 64.
+     *
+     * The first byte is the most significant so a smaller sequence of
+     * bytes means a smaller number.
+     */
+    std::uint64_t bits(int count)
+    {
+        std::uint64_t result(0);
+        for(int b(0); b < count; b += 8)
+        {
+            result = (result << 8) | byte();
+        }
+        return count < 64 ? result & ((1ULL << count) - 1) : result;
+    }
+
+    /** \brief Read a number in [0, range]. */
+    std::uint64_t bounded(std::uint64_t range)
+    {
+        if(range == 0)
+        {
+            return 0;
+        }
+        int const count(64 - __builtin_clzll(range));
+        std::uint64_t result(bits(count));
+        if(result > range)
+        {
+            // result < 2 * (range + 1) so one subtraction is enough
+            //
+            result -= range + 1;
+        }
+        return result;
+    }
+
+    /** \brief Read an integer in [low, high].
+     *
+     * The integer shrinks toward the value of the range closest to 0:
+     * 0 when the range includes it, \p high when all the values are
+     * negative and \p low otherwise.
+     */
+    template<typename T>
+    T integer(T low, T high)
+    {
+        static_assert(std::is_integral<T>::value, "integer() expects an integral type");
+        typedef typename std::make_unsigned<T>::type unsigned_t;
+        if(low > high)
+        {
+            throw std::invalid_argument("integer() called with low > high.");
+        }
+        if(is_negative(high, std::is_signed<T>()))
+        {
+            // [low, high] with high < 0, shrink toward high
+            //
+            return static_cast<T>(static_cast<unsigned_t>(high)
+                    - static_cast<unsigned_t>(bounded(static_cast<unsigned_t>(static_cast<unsigned_t>(high) - static_cast<unsigned_t>(low)))));
+        }
+        if(is_negative(low, std::is_signed<T>()))
+        {
+            if((byte() & 1) != 0)
+            {
+                // [low, -1]
+                //
+                unsigned_t const magnitude(static_cast<unsigned_t>(bounded(static_cast<unsigned_t>(-(low + 1)))));
+                return static_cast<T>(-static_cast<T>(magnitude) - 1);
+            }
+            return static_cast<T>(bounded(static_cast<std::uint64_t>(high)));
+        }
+        return static_cast<T>(static_cast<unsigned_t>(low)
+                + static_cast<unsigned_t>(bounded(static_cast<unsigned_t>(static_cast<unsigned_t>(high) - static_cast<unsigned_t>(low)))));
+    }
+
+    /** \brief Read a number in [low, high). */
+    double real(double low, double high)
+    {
+        return low + static_cast<double>(bits(53)) / 9007199254740992.0 * (high - low);
+    }
+
+    bool boolean()
+    {
+        return (byte() & 1) != 0;
+    }
+
+    /** \brief Check whether a container gets one more item.
+     *
+     * Each item is preceded by one byte, so the shrinker removes an item
+     * by deleting its bytes. A zero byte ends the container.
+     *
+     * \param[in] average  The average number of items.
+     */
+    bool more(std::size_t average)
+    {
+        return byte() >= 256 / (average + 1);
+    }
+
+    /** \brief The number of bytes read so far.
+     *
+     * This does not include the zeroes read past the end of the input.
+     */
+    std::size_t consumed() const
+    {
+        return std::min(m_pos, m_size);
+    }
+
+    /** \brief The bytes generated by a random input. */
+    std::vector<std::uint8_t> const & generated() const
+    {
+        return m_generated;
+    }
+
+    /** \brief Save the values returned by draw() in \p notes. */
+    void record(std::vector<std::string> * notes)
+    {
+        m_notes = notes;
+    }
+
+private:
+    template<typename T>
+    static bool is_negative(T value, std::true_type)
+    {
+        return value < static_cast<T>(0);
+    }
+
+    template<typename T>
+    static bool is_negative(T, std::false_type)
+    {
+        return false;
+    }
+
+    std::uint8_t const *        m_data = nullptr;
+    random_generator *          m_generator = nullptr;
+    std::size_t                 m_size = 0;
+    std::size_t                 m_pos = 0;
+    std::uint64_t               m_random = 0;
+    std::size_t                 m_random_bytes = 0;
+    std::vector<std::uint8_t>   m_generated = std::vector<std::uint8_t>();
+    std::vector<std::string> *  m_notes = nullptr;
+};
+
+
+/** \brief A generator of values for a property.
+ *
+ * A generator is a function reading a property_input and returning a
+ * value. The functions in the SNAP_CATCH2_NAMESPACE::gen namespace
+ * create the basic ones and compose them:
+ *
+ * \code
+ *     auto const even(SNAP_CATCH2_NAMESPACE::gen::integer(0, 1000)
+ *             .map([](int v) { return v * 2; }));
+ *     auto const names(SNAP_CATCH2_NAMESPACE::gen::vector_of(
+ *               SNAP_CATCH2_NAMESPACE::gen::string(16, "abc")
+ *             , 10));
+ * \endcode
+ *
+ * \tparam T  The type of the generated values.
+ */
+template<typename T>
+class generator
+{
+public:
+    typedef T                                       value_type;
+    typedef std::function<T(property_input &)>      function_t;
+
+    explicit generator(function_t f)
+        : m_function(std::move(f))
+    {
+    }
+
+    T operator () (property_input & input) const
+    {
+        return m_function(input);
+    }
+
+    /** \brief Transform the generated values with \p f. */
+    template<typename F>
+    generator<typename std::decay<decltype(std::declval<F>()(std::declval<T>()))>::type> map(F f) const
+    {
+        typedef typename std::decay<decltype(std::declval<F>()(std::declval<T>()))>::type result_t;
+        function_t const g(m_function);
+        return generator<result_t>([g, f](property_input & input)
+            {
+                return f(g(input));
+            });
+    }
+
+    /** \brief Only keep the values accepted by \p predicate.
+     *
+     * After \p tries values get refused, the example gets rejected as
+     * with CATCH_PROPERTY_ASSUME().
+     */
+    template<typename P>
+    generator<T> filter(P predicate, std::size_t tries = 100) const
+    {
+        function_t const g(m_function);
+        return generator<T>([g, predicate, tries](property_input & input)
+            {
+                for(std::size_t idx(0); idx < tries; ++idx)
+                {
+                    T value(g(input));
+                    if(predicate(value))
+                    {
+                        return value;
+                    }
+                }
+                throw detail::property_reject();
+            });
+    }
+
+private:
+    function_t          m_function;
+};
+
+
+/** \brief The basic generators and their combinators. */
+namespace gen
+{
+
+
+template<typename T>
+generator<T> integer(
+      T low = std::numeric_limits<T>::min()
+    , T high = std::numeric_limits<T>::max())
+{
+    return generator<T>([low, high](property_input & input)
+        {
+            return input.integer(low, high);
+        });
+}
+
+
+inline generator<bool> boolean()
+{
+    return generator<bool>([](property_input & input)
+        {
+            return input.boolean();
+        });
+}
+
+
+inline generator<double> real(double low, double high)
+{
+    return generator<double>([low, high](property_input & input)
+        {
+            return input.real(low, high);
+        });
+}
+
+
+template<typename T>
+generator<T> just(T value)
+{
+    return generator<T>([value](property_input &)
+        {
+            return value;
+        });
+}
+
+
+/** \brief Pick one of \p values, shrinking toward the first one. */
+template<typename T>
+generator<T> element_of(std::vector<T> values)
+{
+    if(values.empty())
+    {
+        throw std::invalid_argument("element_of() called with an empty vector.");
+    }
+    return generator<T>([values](property_input & input)
+        {
+            return values[input.bounded(values.size() - 1)];
+        });
+}
+
+
+/** \brief Use one of the generators, shrinking toward the first one. */
+template<typename T, typename ...G>
+generator<T> one_of(generator<T> first, G ...others)
+{
+    std::vector<generator<T>> const generators{ first, others... };
+    return generator<T>([generators](property_input & input)
+        {
+            return generators[input.bounded(generators.size() - 1)](input);
+        });
+}
+
+
+/** \brief Generate a vector of \p min_size to \p max_size items. */
+template<typename T>
+generator<std::vector<T>> vector_of(
+      generator<T> g
+    , std::size_t max_size
+    , std::size_t min_size = 0)
+{
+    std::size_t const average(std::min(max_size, min_size + 10));
+    return generator<std::vector<T>>([g, min_size, max_size, average](property_input & input)
+        {
+            std::vector<T> result;
+            while(result.size() < max_size)
+            {
+                if(!input.more(average)
+                && result.size() >= min_size)
+                {
+                    break;
+                }
+                result.push_back(g(input));
+            }
+            return result;
+        });
+}
+
+
+/** \brief Generate a string of up to \p max_size characters.
+ *
+ * The characters are taken from \p charset, by default the printable
+ * ASCII characters. They shrink toward the first one.
+ */
+inline generator<std::string> string(
+      std::size_t max_size
+    , std::string const & charset = std::string(
+              " !\"#$%&'()*+,-./0123456789:;<=>?@"
+              "ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`"
+              "abcdefghijklmnopqrstuvwxyz{|}~"))
+{
+    if(charset.empty())
+    {
+        throw std::invalid_argument("string() called with an empty charset.");
+    }
+    std::size_t const average(std::min<std::size_t>(max_size, 10));
+    return generator<std::string>([charset, max_size, average](property_input & input)
+        {
+            std::string result;
+            while(result.length() < max_size
+               && input.more(average))
+            {
+                result += charset[input.bounded(charset.length() - 1)];
+            }
+            return result;
+        });
+}
+
+
+/** \brief Generate a buffer of up to \p max_size bytes. */
+inline generator<std::vector<std::uint8_t>> bytes(std::size_t max_size)
+{
+    return vector_of(integer<std::uint8_t>(), max_size);
+}
+
+
+/** \brief Generate a tuple with one value of each generator. */
+template<typename ...T>
+generator<std::tuple<T...>> tuple_of(generator<T> ...g)
+{
+    return generator<std::tuple<T...>>([g...](property_input & input)
+        {
+            // a braced list evaluates its items in order
+            //
+            return std::tuple<T...>{ g(input)... };
+        });
+}
+
+
+} // gen namespace
+
+
+namespace detail
+{
+
+
+enum class property_status_t
+{
+    PROPERTY_PASSED,
+    PROPERTY_REJECTED,
+    PROPERTY_FAILED
+};
+
+
+typedef void (*property_t)(property_input & input);
+
+
+struct property_outcome
+{
+    property_status_t       m_status = property_status_t::PROPERTY_PASSED;
+    std::string             m_key = std::string();
+    std::string             m_message = std::string();
+    std::size_t             m_consumed = 0;
+};
+
+
+/** \brief Run a property once.
+ *
+ * The key of a failure is the location of the CATCH_PROPERTY_CHECK()
+ * or the type of the exception. The shrinker only keeps inputs failing
+ * with the same key so it does not switch to another bug.
+ *
+ * Other exceptions, such as the one raised by a failed CATCH_REQUIRE(),
+ * are not caught.
+ *
+ * \param[in] body  The property.
+ * \param[in] input  The input of the property.
+ *
+ * \return The outcome of the run.
+ */
+inline property_outcome run_property(property_t body, property_input & input)
+{
+    property_outcome result;
+    try
+    {
+        body(input);
+    }
+    catch(property_reject const &)
+    {
+        result.m_status = property_status_t::PROPERTY_REJECTED;
+    }
+    catch(property_failure const & e)
+    {
+        result.m_status = property_status_t::PROPERTY_FAILED;
+        result.m_key = std::string(e.m_file) + ':' + std::to_string(e.m_line);
+        result.m_message = result.m_key + ": " + e.m_expression;
+    }
+    catch(std::exception const & e)
+    {
+        result.m_status = property_status_t::PROPERTY_FAILED;
+        result.m_key = demangle(typeid(e).name());
+        result.m_message = "unexpected exception " + result.m_key + ": " + e.what();
+    }
+    result.m_consumed = input.consumed();
+    return result;
+}
+
+
+/** \brief Shrink a failing input.
+ *
+ * The shrinker tries smaller versions of the input: it deletes chunks
+ * of bytes, sets chunks to zero and lowers each byte. An input is
+ * smaller when it is shorter or, with the same length, when it comes
+ * first in lexical order. The first candidate which fails the same way
+ * becomes the new input and the passes restart until none of them
+ * finds a smaller input.
+ *
+ * The candidates of a pass are run in batches on several threads, the
+ * first failing candidate of a batch wins so the result does not depend
+ * on the number of threads.
+ */
+class property_shrinker
+{
+public:
+    property_shrinker(property_t body, std::string const & key, std::size_t threads)
+        : m_body(body)
+        , m_key(key)
+    {
+        if(threads == 0)
+        {
+            threads = std::max(1U, std::thread::hardware_concurrency());
+        }
+        for(std::size_t idx(1); idx < threads; ++idx)
+        {
+            m_threads.emplace_back(&property_shrinker::worker, this);
+        }
+    }
+
+    property_shrinker(property_shrinker const &) = delete;
+    property_shrinker & operator = (property_shrinker const &) = delete;
+
+    ~property_shrinker()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_start.notify_all();
+        for(auto & t : m_threads)
+        {
+            t.join();
+        }
+    }
+
+    std::vector<std::uint8_t> shrink(std::vector<std::uint8_t> data)
+    {
+        bool improved(true);
+        while(improved && m_runs < MAX_RUNS)
+        {
+            improved = false;
+            for(std::size_t chunk(8); chunk > 0; chunk /= 2)
+            {
+                while(try_candidates(data, [chunk](std::vector<std::uint8_t> const & d, std::size_t pos, std::vector<std::uint8_t> & c)
+                    {
+                        if(pos + chunk > d.size())
+                        {
+                            return false;
+                        }
+                        c.assign(d.begin(), d.begin() + pos);
+                        c.insert(c.end(), d.begin() + pos + chunk, d.end());
+                        return true;
+                    }))
+                {
+                    improved = true;
+                }
+            }
+            for(std::size_t chunk(8); chunk > 0; chunk /= 2)
+            {
+                while(try_candidates(data, [chunk](std::vector<std::uint8_t> const & d, std::size_t pos, std::vector<std::uint8_t> & c)
+                    {
+                        if(pos + chunk > d.size()
+                        || std::all_of(d.begin() + pos, d.begin() + pos + chunk, [](std::uint8_t b) { return b == 0; }))
+                        {
+                            return false;
+                        }
+                        c = d;
+                        std::fill(c.begin() + pos, c.begin() + pos + chunk, 0);
+                        return true;
+                    }))
+                {
+                    improved = true;
+                }
+            }
+            for(int step : { 2, 1 })
+            {
+                while(try_candidates(data, [step](std::vector<std::uint8_t> const & d, std::size_t pos, std::vector<std::uint8_t> & c)
+                    {
+                        if(d[pos] == 0)
+                        {
+                            return false;
+                        }
+                        c = d;
+                        c[pos] = static_cast<std::uint8_t>(step == 2 ? c[pos] / 2 : c[pos] - 1);
+                        return true;
+                    }))
+                {
+                    improved = true;
+                }
+            }
+        }
+        return data;
+    }
+
+    std::size_t runs() const
+    {
+        return m_runs;
+    }
+
+    std::size_t steps() const
+    {
+        return m_steps;
+    }
+
+private:
+    static constexpr std::size_t MAX_RUNS = 100000;
+    static constexpr std::size_t BATCH_PER_THREAD = 8;
+
+    struct candidate_result
+    {
+        bool            m_failed = false;
+        std::size_t     m_consumed = 0;
+    };
+
+    /** \brief Try the candidates created by \p make at each position.
+     *
+     * \return true if \p data was replaced by a smaller failing input.
+     */
+    template<typename F>
+    bool try_candidates(std::vector<std::uint8_t> & data, F make)
+    {
+        std::size_t const batch_size((m_threads.size() + 1) * BATCH_PER_THREAD);
+        std::size_t pos(0);
+        while(pos < data.size() && m_runs < MAX_RUNS)
+        {
+            m_candidates.clear();
+            std::vector<std::uint8_t> c;
+            for(; pos < data.size() && m_candidates.size() < batch_size; ++pos)
+            {
+                if(make(data, pos, c))
+                {
+                    m_candidates.push_back(c);
+                }
+            }
+            if(m_candidates.empty())
+            {
+                continue;
+            }
+            run_batch();
+            for(std::size_t idx(0); idx < m_candidates.size(); ++idx)
+            {
+                if(m_results[idx].m_failed)
+                {
+                    m_candidates[idx].resize(m_results[idx].m_consumed);
+                    data.swap(m_candidates[idx]);
+                    ++m_steps;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void run_batch()
+    {
+        m_results.assign(m_candidates.size(), candidate_result());
+        m_runs += m_candidates.size();
+        m_next = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending = m_threads.size();
+            ++m_batch;
+        }
+        m_start.notify_all();
+        run_candidates();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]() { return m_pending == 0; });
+    }
+
+    void run_candidates()
+    {
+        for(;;)
+        {
+            std::size_t const idx(m_next++);
+            if(idx >= m_candidates.size())
+            {
+                return;
+            }
+            property_input input(m_candidates[idx].data(), m_candidates[idx].size());
+            try
+            {
+                property_outcome const r(run_property(m_body, input));
+                if(r.m_status == property_status_t::PROPERTY_FAILED
+                && r.m_key == m_key)
+                {
+                    m_results[idx].m_failed = true;
+                    m_results[idx].m_consumed = r.m_consumed;
+                }
+            }
+            catch(...)
+            {
+                // a different failure, ignore that candidate
+            }
+        }
+    }
+
+    void worker()
+    {
+        std::uint64_t batch(0);
+        for(;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_start.wait(lock, [this, batch]() { return m_stop || m_batch != batch; });
+                if(m_stop)
+                {
+                    return;
+                }
+                batch = m_batch;
+            }
+            run_candidates();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                --m_pending;
+            }
+            m_done.notify_one();
+        }
+    }
+
+    property_t                              m_body;
+    std::string                             m_key;
+    std::vector<std::thread>                m_threads = std::vector<std::thread>();
+    std::mutex                              m_mutex = {};
+    std::condition_variable                 m_start = {};
+    std::condition_variable                 m_done = {};
+    bool                                    m_stop = false;
+    std::uint64_t                           m_batch = 0;
+    std::size_t                             m_pending = 0;
+    std::atomic<std::size_t>                m_next = { 0 };
+    std::vector<std::vector<std::uint8_t>>  m_candidates = std::vector<std::vector<std::uint8_t>>();
+    std::vector<candidate_result>           m_results = std::vector<candidate_result>();
+    std::size_t                             m_runs = 0;
+    std::size_t                             m_steps = 0;
+};
+
+
+/** \brief Check a property.
+ *
+ * This function is used by the CATCH_PROPERTY() macro. It runs the
+ * property with g_property_examples() random inputs taken from rng()
+ * (so `--seed` reproduces them) or with the `--property-input` file.
+ * The first failing input gets shrunk and replayed once more to list
+ * the values it draws. That input is also saved in the temporary
+ * directory of the test case so it can be replayed with
+ * `--property-input` or added to the corpus of a fuzzer.
+ *
+ * \param[in] name  The name of the property.
+ * \param[in] body  The property.
+ * \param[in] line  The location of the property.
+ */
+inline void check_property(
+      char const * name
+    , property_t body
+    , Catch::SourceLineInfo const & line)
+{
+    std::stringstream ss;
+    ss << "property \"" << name << "\" ";
+
+    std::vector<std::uint8_t> data;
+    property_outcome failure;
+    if(g_property_input().empty())
+    {
+        random_generator & generator(rng());
+        std::size_t const examples(g_property_examples());
+        std::size_t passed(0);
+        std::size_t rejected(0);
+        while(passed < examples)
+        {
+            property_input input(generator, PROPERTY_MAX_INPUT_SIZE);
+            failure = run_property(body, input);
+            if(failure.m_status == property_status_t::PROPERTY_FAILED)
+            {
+                data = input.generated();
+                break;
+            }
+            if(failure.m_status == property_status_t::PROPERTY_PASSED)
+            {
+                ++passed;
+            }
+            else if(++rejected > examples * 10)
+            {
+                break;
+            }
+        }
+        if(failure.m_status != property_status_t::PROPERTY_FAILED)
+        {
+            bool const ok(passed >= examples);
+            ss << (ok ? "passed " : "gave up after ")
+               << passed
+               << " example"
+               << (passed == 1 ? "" : "s");
+            if(rejected > 0)
+            {
+                ss << " (" << rejected << " rejected)";
+            }
+            ss << '.';
+            Catch::AssertionHandler handler(
+                      "CATCH_PROPERTY"_catch_sr
+                    , line
+                    , Catch::StringRef(name)
+                    , Catch::ResultDisposition::Normal);
+            handler.handleMessage(
+                      ok
+                            ? Catch::ResultWas::Ok
+                            : Catch::ResultWas::ExplicitFailure
+                    , ss.str());
+            handler.complete();
+            return;
+        }
+        ss << "failed on example " << passed + rejected + 1;
+    }
+    else
+    {
+        std::ifstream in(g_property_input(), std::ios::binary);
+        if(!in)
+        {
+            throw std::runtime_error("could not read property input \"" + g_property_input() + "\".");
+        }
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        property_input input(data.data(), data.size());
+        failure = run_property(body, input);
+        if(failure.m_status != property_status_t::PROPERTY_FAILED)
+        {
+            ss << "passed with \"" << g_property_input() << "\".";
+            Catch::AssertionHandler handler(
+                      "CATCH_PROPERTY"_catch_sr
+                    , line
+                    , Catch::StringRef(name)
+                    , Catch::ResultDisposition::Normal);
+            handler.handleMessage(Catch::ResultWas::Ok, ss.str());
+            handler.complete();
+            return;
+        }
+        ss << "failed with \"" << g_property_input() << "\"";
+    }
+    data.resize(failure.m_consumed);
+
+    std::size_t const original_size(data.size());
+    property_shrinker shrinker(body, failure.m_key, g_property_threads());
+    data = shrinker.shrink(data);
+
+    std::vector<std::string> notes;
+    property_input input(data.data(), data.size());
+    input.record(&notes);
+    failure = run_property(body, input);
+
+    ss << ":\n  " << failure.m_message
+       << "\nshrunk from " << original_size
+       << " to " << data.size()
+       << " bytes in " << shrinker.steps()
+       << " steps (" << shrinker.runs()
+       << " runs), smallest example:\n";
+    for(std::size_t idx(0); idx < notes.size(); ++idx)
+    {
+        ss << "  draw " << idx + 1 << ": " << notes[idx] << '\n';
+    }
+    if(notes.empty())
+    {
+        ss << "  (no values drawn)\n";
+    }
+
+    std::string const filename(g_test_tmp_dir() + "/property.input");
+    std::ofstream out(filename, std::ios::binary);
+    out.write(reinterpret_cast<char const *>(data.data()), data.size());
+    if(out)
+    {
+        ss << "saved to \"" << filename << "\" (copy it before the next run"
+              " resets the temporary directory, then replay it with"
+              " --property-input)";
+    }
+
+    Catch::AssertionHandler handler(
+              "CATCH_PROPERTY"_catch_sr
+            , line
+            , Catch::StringRef(name)
+            , Catch::ResultDisposition::Normal);
+    handler.handleMessage(Catch::ResultWas::ExplicitFailure, ss.str());
+    handler.complete();
+}
+
+
+#ifdef SNAP_CATCH2_FUZZER
+struct fuzz_property
+{
+    char const *        m_name = nullptr;
+    property_t          m_body = nullptr;
+};
+
+
+inline std::vector<fuzz_property> & g_fuzz_properties()
+{
+    static std::vector<fuzz_property> properties;
+
+    return properties;
+}
+
+
+class fuzz_property_registrar
+{
+public:
+    fuzz_property_registrar(char const * name, property_t body)
+    {
+        g_fuzz_properties().push_back(fuzz_property{ name, body });
+    }
+};
+
+
+/** \brief Select the property run by the fuzzer.
+ *
+ * This is the property named in the SNAP_CATCH2_PROPERTY environment
+ * variable or the first one.
+ *
+ * \return The property to fuzz.
+ */
+inline fuzz_property const & selected_fuzz_property()
+{
+    static fuzz_property const * selected(nullptr);
+
+    if(selected == nullptr)
+    {
+        std::vector<fuzz_property> const & properties(g_fuzz_properties());
+        char const * name(getenv("SNAP_CATCH2_PROPERTY"));
+        for(auto const & p : properties)
+        {
+            if(name == nullptr
+            || strcmp(name, p.m_name) == 0)
+            {
+                selected = &p;
+                break;
+            }
+        }
+        if(selected == nullptr)
+        {
+            std::cerr << "fatal error: property \""
+                      << (name == nullptr ? "" : name)
+                      << "\" not found; available properties:\n";
+            for(auto const & p : properties)
+            {
+                std::cerr << "  " << p.m_name << '\n';
+            }
+            std::cerr << std::flush;
+            abort();
+        }
+    }
+
+    return *selected;
+}
+#endif
+
+
+} // detail namespace
+
+
+#ifdef CATCH_CONFIG_RUNNER
+namespace detail
+{
+
+
+/** \brief Create a reporter the same way the Catch::Session does.
+ *
+ * When we run the tests ourselves (i.e. in a `--jobs` worker) we need a
+ * reporter which is created exactly like the one the session creates,
+ * which includes all the registered listeners.
+ *
+ * \param[in] config  The configuration used to create the reporter.
+ *
+ * \return The new reporter.
+ */
+inline Catch::IStreamingReporterPtr make_reporter(std::shared_ptr<Catch::Config> const & config)
+{
+    Catch::IReporterRegistry const & registry(Catch::getRegistryHub().getReporterRegistry());
+    Catch::IStreamingReporterPtr reporter(registry.create(config->getReporterName(), config));
+    if(reporter == nullptr)
+    {
+        throw std::runtime_error(
+                  "no reporter registered with name: \""
+                + config->getReporterName()
+                + "\".");
+    }
+    if(registry.getListeners().empty())
+    {
+        return reporter;
+    }
+
+    std::unique_ptr<Catch::ListeningReporter> multi(new Catch::ListeningReporter);
+    for(auto const & listener : registry.getListeners())
+    {
+        multi->addListener(listener->create(Catch::ReporterConfig(config)));
+    }
+    multi->addReporter(std::move(reporter));
+    return Catch::IStreamingReporterPtr(multi.release());
+}
+
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+/** \brief The result of one benchmark.
+ *
+ * The durations are in nanoseconds. The lower and upper bounds are the
+ * bounds of the confidence interval of the mean as computed by catch2
+ * (see the `--benchmark-confidence-interval` command line option).
+ */
+struct benchmark_result
+{
+    std::string     m_test_case = std::string();
+    std::string     m_name = std::string();
+    double          m_mean = 0.0;
+    double          m_mean_lower = 0.0;
+    double          m_mean_upper = 0.0;
+    double          m_standard_deviation = 0.0;
+    int             m_samples = 0;
+    int             m_iterations = 0;
+
+    std::string key() const
+    {
+        return m_test_case + "/" + m_name;
+    }
+};
+
+
+inline std::vector<benchmark_result> & g_benchmark_results()
+{
+    static std::vector<benchmark_result> results;
+
+    return results;
+}
+
+
+/** \brief Save benchmark results in a JSON file.
+ *
+ * \param[in] filename  The name of the output file.
+ * \param[in] results  The results to save.
+ * \param[in] project_name  The name of the project.
+ * \param[in] project_version  The version of the project.
+ */
+inline void save_benchmark_results(
+      std::string const & filename
+    , std::vector<benchmark_result> const & results
+    , std::string const & project_name
+    , std::string const & project_version)
+{
+    std::ofstream out(filename);
+    out << "{\n"
+        << "  \"project\": " << json_string(project_name) << ",\n"
+        << "  \"version\": " << json_string(project_version) << ",\n"
+        << "  \"benchmarks\": [";
+    char const * sep("\n");
+    for(auto const & r : results)
+    {
+        out << sep
+            << "    {\n"
+            << "      \"test_case\": " << json_string(r.m_test_case) << ",\n"
+            << "      \"name\": " << json_string(r.m_name) << ",\n"
+            << "      \"mean\": " << r.m_mean << ",\n"
+            << "      \"mean_lower\": " << r.m_mean_lower << ",\n"
+            << "      \"mean_upper\": " << r.m_mean_upper << ",\n"
+            << "      \"standard_deviation\": " << r.m_standard_deviation << ",\n"
+            << "      \"samples\": " << r.m_samples << ",\n"
+            << "      \"iterations\": " << r.m_iterations << "\n"
+            << "    }";
+        sep = ",\n";
+    }
+    out << "\n  ]\n}\n";
+    if(!out)
+    {
+        throw std::runtime_error("could not write benchmark results to \"" + filename + "\".");
+    }
+}
+
+
+/** \brief Load benchmark results from a JSON file.
+ *
+ * \param[in] filename  The name of the file to load.
+ *
+ * \return The list of results found in that file.
+ */
+inline std::vector<benchmark_result> load_benchmark_results(std::string const & filename)
+{
+    std::vector<benchmark_result> results;
+    json_value const root(load_json(filename));
+    json_value const * benchmarks(root.member("benchmarks"));
+    if(benchmarks != nullptr)
+    {
+        for(auto const & b : benchmarks->m_items)
+        {
+            benchmark_result r;
+            r.m_test_case = b.string("test_case");
+            r.m_name = b.string("name");
+            r.m_mean = b.number("mean");
+            r.m_mean_lower = b.number("mean_lower", r.m_mean);
+            r.m_mean_upper = b.number("mean_upper", r.m_mean);
+            r.m_standard_deviation = b.number("standard_deviation");
+            r.m_samples = static_cast<int>(b.number("samples"));
+            r.m_iterations = static_cast<int>(b.number("iterations"));
+            results.push_back(r);
+        }
+    }
+    return results;
+}
+
+
+/** \brief Compare the benchmark results against a baseline.
+ *
+ * A benchmark is considered to have regressed when its mean is more
+ * than \p threshold percent slower than the baseline mean and the
+ * confidence intervals of both means do not overlap (i.e. the
+ * difference is statistically significant). When the analysis is
+ * turned off (`--benchmark-no-analysis`), only the threshold is used.
+ *
+ * \param[in] results  The results of this run.
+ * \param[in] baseline_filename  The name of the baseline file.
+ * \param[in] threshold  The threshold in percent.
+ * \param[in] out  The stream where the comparison gets printed.
+ *
+ * \return The number of benchmarks which regressed.
+ */
+inline std::size_t compare_benchmark_results(
+      std::vector<benchmark_result> const & results
+    , std::string const & baseline_filename
+    , double threshold
+    , std::ostream & out)
+{
+    std::vector<benchmark_result> const baseline(load_benchmark_results(baseline_filename));
+
+    out << "benchmark comparison against \"" << baseline_filename << "\":\n";
+    std::size_t regressions(0);
+    for(auto const & r : results)
+    {
+        auto const it(std::find_if(
+                  baseline.begin()
+                , baseline.end()
+                , [&r](benchmark_result const & b) { return b.key() == r.key(); }));
+        if(it == baseline.end())
+        {
+            out << "  [new]         " << r.key() << ": " << r.m_mean << " ns\n";
+            continue;
+        }
+
+        double const change(it->m_mean > 0.0
+                    ? (r.m_mean - it->m_mean) * 100.0 / it->m_mean
+                    : 0.0);
+        char const * status("[ok]          ");
+        if(change > threshold
+        && r.m_mean_lower > it->m_mean_upper)
+        {
+            status = "[REGRESSION]  ";
+            ++regressions;
+        }
+        else if(change < -threshold
+             && r.m_mean_upper < it->m_mean_lower)
+        {
+            status = "[improved]    ";
+        }
+        out << "  "
+            << status
+            << r.key()
+            << ": "
+            << it->m_mean
+            << " ns -> "
+            << r.m_mean
+            << " ns ("
+            << (change >= 0.0 ? "+" : "")
+            << change
+            << "%)\n";
+    }
+    out << regressions << " benchmark" << (regressions == 1 ? "" : "s") << " regressed.\n";
+    out.flush();
+
+    return regressions;
+}
+#endif
+
+
+/** \brief The order in which the tests get run.
+ *
+ * The ORDER_DEFAULT means that catch2 decides. ORDER_CATCH2 means
+ * that an order was specified with the catch2 `--order` command line
+ * option (decl, lex or rand) and must be kept. The other two orders
+ * make use of the history of the previous runs.
+ */
+enum class order_t
+{
+    ORDER_DEFAULT,
+    ORDER_CATCH2,
+    ORDER_FAILED_FIRST,
+    ORDER_LONGEST_FIRST,
+};
+
+
+/** \brief The history of one test case.
+ *
+ * The history file keeps the duration and result of the last run of
+ * each test case along the build ID of the binary which ran it. A test
+ * case has one such entry for each of the last few builds which ran it
+ * (see TEST_HISTORY_BUILDS).
+ */
+struct test_history
+{
+    std::string         m_build_id = std::string();
+    std::int64_t        m_duration_us = 0;
+    bool                m_failed = false;
+    bool                m_updated = false;      // ran in this process (not saved)
+};
+
+
+/** \brief The number of builds for which the history of a test is kept. */
+constexpr std::size_t TEST_HISTORY_BUILDS = 4;
+
+
+/** \brief The history of all the test cases, by name.
+ *
+ * Each test case has a list of entries, the most recent first, with at
+ * most one entry per build ID. This map is loaded from the history file
+ * before the tests run and updated as each test case ends.
+ */
+typedef std::map<std::string, std::vector<test_history>>  test_history_map;
+
+
+inline test_history_map & g_test_history()
+{
+    static test_history_map history;
+
+    return history;
+}
+
+
+/** \brief Add an entry in front of the history of a test case.
+ *
+ * An older entry with the same build ID gets replaced and the list is
+ * truncated to TEST_HISTORY_BUILDS entries.
+ *
+ * \param[in,out] entries  The history of the test case, most recent first.
+ * \param[in] h  The new entry.
+ */
+inline void add_test_history(std::vector<test_history> & entries, test_history const & h)
+{
+    entries.erase(
+          std::remove_if(
+                  entries.begin()
+                , entries.end()
+                , [&h](test_history const & e)
+                  {
+                      return e.m_build_id == h.m_build_id;
+                  })
+        , entries.end());
+    entries.insert(entries.begin(), h);
+    if(entries.size() > TEST_HISTORY_BUILDS)
+    {
+        entries.resize(TEST_HISTORY_BUILDS);
+    }
+}
+
+
+inline int build_id_callback(dl_phdr_info * info, std::size_t, void * data)
+{
+    // the first object is the executable itself
+    //
+    std::string & id(*static_cast<std::string *>(data));
+    for(ElfW(Half) idx(0); idx < info->dlpi_phnum; ++idx)
+    {
+        ElfW(Phdr) const & phdr(info->dlpi_phdr[idx]);
+        if(phdr.p_type != PT_NOTE)
+        {
+            continue;
+        }
+        char const * note(reinterpret_cast<char const *>(info->dlpi_addr + phdr.p_vaddr));
+        char const * const end(note + phdr.p_memsz);
+        while(note + sizeof(ElfW(Nhdr)) <= end)
+        {
+            ElfW(Nhdr) const * nhdr(reinterpret_cast<ElfW(Nhdr) const *>(note));
+            char const * name(note + sizeof(ElfW(Nhdr)));
+            unsigned char const * desc(reinterpret_cast<unsigned char const *>(name + ((nhdr->n_namesz + 3) & ~3U)));
+            if(nhdr->n_type == NT_GNU_BUILD_ID
+            && nhdr->n_namesz == 4
+            && memcmp(name, "GNU", 4) == 0)
+            {
+                static char const hex[] = "0123456789abcdef";
+                for(ElfW(Word) i(0); i < nhdr->n_descsz; ++i)
+                {
+                    id += hex[desc[i] >> 4];
+                    id += hex[desc[i] & 15];
+                }
+                return 1;
+            }
+            note = reinterpret_cast<char const *>(desc) + ((nhdr->n_descsz + 3) & ~3U);
+        }
+    }
+    return 1;
+}
+
+
+/** \brief Get the build ID of the running executable.
+ *
+ * The linker saves a unique identifier in a GNU note (`--build-id`,
+ * which is the default with gcc on most distributions). That identifier
+ * changes each time the binary changes.
+ *
+ * \return The build ID in hexadecimal or "unknown".
+ */
+inline std::string const & build_id()
+{
+    static std::string const id([]()
+        {
+            std::string result;
+            dl_iterate_phdr(build_id_callback, &result);
+            return result.empty() ? std::string("unknown") : result;
+        }());
+
+    return id;
+}
+
+
+/** \brief Load the test history.
+ *
+ * The file is a text file with one line per test case and build:
+ *
+ * \code
+ *     <build-id> <duration in microseconds> <pass|fail> <test case name>
+ * \endcode
+ *
+ * The name is last since it may include spaces. The lines of one test
+ * case are saved from the most recent to the oldest. Lines starting with
+ * a '#' are comments. A missing file is not an error (i.e. first run).
+ *
+ * \param[in] filename  The name of the history file.
+ * \param[in,out] history  The map where the history gets loaded.
+ */
+inline void load_test_history(
+      std::string const & filename
+    , test_history_map & history = g_test_history())
+{
+    std::ifstream in(filename);
+    std::string line;
+    while(std::getline(in, line))
+    {
+        if(line.empty()
+        || line[0] == '#')
+        {
+            continue;
+        }
+        std::stringstream ss(line);
+        test_history h;
+        std::string result;
+        std::string name;
+        ss >> h.m_build_id >> h.m_duration_us >> result;
+        std::getline(ss, name);
+        if(!ss.fail()
+        && name.length() > 1)
+        {
+            h.m_failed = result != "pass";
+            std::vector<test_history> & entries(history[name.substr(1)]);
+            if(entries.size() < TEST_HISTORY_BUILDS
+            && std::none_of(
+                      entries.begin()
+                    , entries.end()
+                    , [&h](test_history const & e)
+                      {
+                          return e.m_build_id == h.m_build_id;
+                      }))
+            {
+                entries.push_back(h);
+            }
+        }
+    }
+}
+
+
+/** \brief Hold an exclusive lock on a file.
+ *
+ * The lock file gets created if it does not exist yet. It is not deleted
+ * since another process may be waiting on it.
+ */
+class file_lock
+{
+public:
+    file_lock(std::string const & filename)
+        : m_fd(open(filename.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644))
+    {
+        if(m_fd < 0
+        || flock(m_fd, LOCK_EX) != 0)
+        {
+            int const e(errno);
+            if(m_fd >= 0)
+            {
+                close(m_fd);
+            }
+            throw std::runtime_error("could not lock \"" + filename + "\": " + strerror(e) + ".");
+        }
+    }
+
+    file_lock(file_lock const &) = delete;
+    file_lock & operator = (file_lock const &) = delete;
+
+    ~file_lock()
+    {
+        close(m_fd);
+    }
+
+private:
+    int             m_fd = -1;
+};
+
+
+/** \brief Save the test history.
+ *
+ * The file is first saved under a temporary name and then renamed so
+ * a concurrent run never reads a partial file.
+ *
+ * Several processes may share the same history file (i.e. the shards
+ * of snapcatch2_add_tests() run by `ctest -j`). So while holding a lock
+ * on `<filename>.lock`, the file gets loaded again and only the test
+ * cases which ran in this process get added to the entries found in
+ * the file.
+ *
+ * \param[in] filename  The name of the history file.
+ */
+inline void save_test_history(std::string const & filename)
+{
+    file_lock const lock(filename + ".lock");
+
+    test_history_map merged;
+    load_test_history(filename, merged);
+    for(auto const & h : g_test_history())
+    {
+        auto const it(merged.find(h.first));
+        if(it == merged.end())
+        {
+            merged[h.first] = h.second;
+            continue;
+        }
+        for(auto const & e : h.second)
+        {
+            if(e.m_updated)
+            {
+                add_test_history(it->second, e);
+            }
+        }
+    }
+
+    std::string const tmp(filename + ".tmp-" + std::to_string(getpid()));
+    {
+        std::ofstream out(tmp);
+        out << "# snapcatch2 test history: <build-id> <duration-us> <pass|fail> <test case name>\n";
+        for(auto const & h : merged)
+        {
+            for(auto const & e : h.second)
+            {
+                out << e.m_build_id
+                    << ' '
+                    << e.m_duration_us
+                    << ' '
+                    << (e.m_failed ? "fail" : "pass")
+                    << ' '
+                    << h.first
+                    << '\n';
+            }
+        }
+        if(!out)
+        {
+            throw std::runtime_error("could not save test history to \"" + tmp + "\".");
+        }
+    }
+    if(rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        unlink(tmp.c_str());
+        throw std::runtime_error("could not rename \"" + tmp + "\" to \"" + filename + "\".");
+    }
+}
+
+
+/** \brief Record the result of one test case in the history.
+ *
+ * \param[in] name  The name of the test case.
+ * \param[in] duration  How long the test case ran.
+ * \param[in] failed  Whether the test case failed.
+ */
+inline void record_test_history(
+      std::string const & name
+    , std::chrono::steady_clock::duration duration
+    , bool failed)
+{
+    test_history h;
+    h.m_build_id = build_id();
+    h.m_duration_us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    h.m_failed = failed;
+    h.m_updated = true;
+    add_test_history(g_test_history()[name], h);
+}
+
+
+/** \brief Find the history of a test case.
+ *
+ * The entry saved by the running binary is preferred. When this build
+ * did not run the test case yet (i.e. after a fix and a rebuild), the
+ * most recent entry of another build gets used so `--order failed-first`
+ * still runs the failed tests first and the durations still balance
+ * the `--jobs` workers and the shards.
+ *
+ * \param[in] name  The name of the test case.
+ *
+ * \return The history of that test case or nullptr.
+ */
+inline test_history const * find_test_history(std::string const & name)
+{
+    test_history_map const & history(g_test_history());
+    auto const it(history.find(name));
+    if(it == history.end()
+    || it->second.empty())
+    {
+        return nullptr;
+    }
+    for(auto const & e : it->second)
+    {
+        if(e.m_build_id == build_id())
+        {
+            return &e;
+        }
+    }
+    return &it->second.front();
+}
+
+
+/** \brief Sort the test cases using the history.
+ *
+ * With ORDER_FAILED_FIRST, the test cases which failed last time come
+ * first, fastest first, then the test cases without history (i.e. new
+ * tests), then the others in their current order.
+ *
+ * With ORDER_LONGEST_FIRST, the test cases are sorted by decreasing
+ * duration. Test cases without history are considered the longest.
+ * When the tests are handed out one at a time to `--jobs` workers,
+ * this is the LPT (longest processing time first) schedule which keeps
+ * the workers busy until the very end.
+ *
+ * \param[in,out] tests  The test cases to sort.
+ * \param[in] order  The order to use.
+ */
+inline void order_tests(std::vector<Catch::TestCase> & tests, order_t order)
+{
+    auto key = [order](Catch::TestCase const & t)
+        {
+            test_history const * h(find_test_history(t.name));
+            if(h == nullptr)
+            {
+                return std::make_pair(order == order_t::ORDER_FAILED_FIRST ? 1 : 0, std::int64_t());
+            }
+            switch(order)
+            {
+            case order_t::ORDER_FAILED_FIRST:
+                return h->m_failed
+                        ? std::make_pair(0, h->m_duration_us)
+                        : std::make_pair(2, std::int64_t());
+
+            case order_t::ORDER_LONGEST_FIRST:
+                return std::make_pair(1, -h->m_duration_us);
+
+            default:
+                return std::make_pair(0, std::int64_t());
+
+            }
+        };
+    std::stable_sort(
+              tests.begin()
+            , tests.end()
+            , [&key](Catch::TestCase const & a, Catch::TestCase const & b)
+              {
+                  return key(a) < key(b);
+              });
+}
+
+
+/** \brief Extract our `--order` values from the command line.
+ *
+ * Catch2 already has an `--order` option (decl, lex, rand). We add the
+ * `failed-first` and `longest-first` values. These are removed from
+ * \p args so catch2 does not see them.
+ *
+ * \param[in,out] args  The command line arguments.
+ *
+ * \return The order found on the command line or ORDER_DEFAULT.
+ */
+inline order_t extract_order(std::vector<char *> & args)
+{
+    order_t result(order_t::ORDER_DEFAULT);
+    for(std::size_t idx(1); idx < args.size(); ++idx)
+    {
+        std::string const arg(args[idx]);
+        std::size_t count(0);
+        std::string value;
+        if(arg == "--order"
+        && idx + 1 < args.size())
+        {
+            count = 2;
+            value = args[idx + 1];
+        }
+        else if(arg.compare(0, 8, "--order=") == 0)
+        {
+            count = 1;
+            value = arg.substr(8);
+        }
+        if(value == "failed-first")
+        {
+            result = order_t::ORDER_FAILED_FIRST;
+        }
+        else if(value == "longest-first")
+        {
+            result = order_t::ORDER_LONGEST_FIRST;
+        }
+        else
+        {
+            // a catch2 order, leave it for catch2
+            //
+            if(count > 0)
+            {
+                result = order_t::ORDER_CATCH2;
+            }
+            continue;
+        }
+        args.erase(args.begin() + idx, args.begin() + idx + count);
+        --idx;
+    }
+    return result;
+}
+
+
+/** \brief The snapcatch2 listener.
+ *
+ * This listener gets registered with catch2 so we can gather data about
+ * the tests as they run (i.e. test durations and benchmark results).
+ */
+class snapcatch2_listener
+    : public Catch::TestEventListenerBase
+{
+public:
+    using TestEventListenerBase::TestEventListenerBase;
+
+    void testCaseStarting(Catch::TestCaseInfo const & info) override
+    {
+        TestEventListenerBase::testCaseStarting(info);
+        start_random_stream(info.name);
+        start_test_tmp_dir(info.name);
+        g_progress_reporter().post(progress_event_t::PROGRESS_EVENT_TEST_STARTED, info.name);
+        g_watchdog().test_started(info.name, test_budget(info));
+        start_calibration(info);
+        m_start = std::chrono::steady_clock::now();
+    }
+
+    void testCaseEnded(Catch::TestCaseStats const & stats) override
+    {
+        g_watchdog().test_ended();
+        record_test_history(
+                  stats.testInfo.name
+                , std::chrono::steady_clock::now() - m_start
+                , !stats.totals.assertions.allOk());
+        g_progress_reporter().post(progress_event_t::PROGRESS_EVENT_TEST_ENDED, stats.testInfo.name);
+        TestEventListenerBase::testCaseEnded(stats);
+    }
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+    void benchmarkEnded(Catch::BenchmarkStats<> const & stats) override
+    {
+        benchmark_result r;
+        r.m_test_case = currentTestCaseInfo->name;
+        r.m_name = stats.info.name;
+        r.m_mean = stats.mean.point.count();
+        r.m_mean_lower = stats.mean.lower_bound.count();
+        r.m_mean_upper = stats.mean.upper_bound.count();
+        r.m_standard_deviation = stats.standardDeviation.point.count();
+        r.m_samples = stats.info.samples;
+        r.m_iterations = stats.info.iterations;
+        g_benchmark_results().push_back(r);
+    }
+#endif
+
+private:
+    std::chrono::steady_clock::time_point   m_start = std::chrono::steady_clock::time_point();
+};
+
+
+CATCH_REGISTER_LISTENER(snapcatch2_listener)
+
+
+/** \brief Write a complete buffer to a file descriptor.
+ *
+ * This function makes sure that the entire buffer gets written, even
+ * if the write() call gets interrupted or only writes part of the data.
+ *
+ * \param[in] fd  The file descriptor to write to.
+ * \param[in] data  The data to write.
+ *
+ * \return true if all the data was written.
+ */
+inline bool write_all(int fd, std::string const & data)
+{
+    char const * s(data.c_str());
+    std::size_t size(data.length());
+    while(size > 0)
+    {
+        ssize_t const r(write(fd, s, size));
+        if(r < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        s += r;
+        size -= static_cast<std::size_t>(r);
+    }
+    return true;
+}
+
+
+/** \brief Extract one line from a pipe.
+ *
+ * The jobs protocol exchanges lines of text between the parent and its
+ * workers. This function reads from \p fd until \p buffer includes a
+ * complete line and then returns that line.
+ *
+ * When \p blocking is false, at most one read() is attempted, which is
+ * what the parent wants after poll() said data was available.
+ *
+ * \param[in] fd  The file descriptor to read from.
+ * \param[in,out] buffer  The data read so far.
+ * \param[out] line  The line, without the '\\n'.
+ * \param[in,out] eof  Set to true once the other side closed the pipe.
+ * \param[in] blocking  Whether to keep reading until a line is available.
+ *
+ * \return true if \p line was set.
+ */
+inline bool read_line(int fd, std::string & buffer, std::string & line, bool & eof, bool blocking)
+{
+    bool read_once(false);
+    for(;;)
+    {
+        std::string::size_type const pos(buffer.find('\n'));
+        if(pos != std::string::npos)
+        {
+            line = buffer.substr(0, pos);
+            buffer.erase(0, pos + 1);
+            return true;
+        }
+        if(eof
+        || (read_once && !blocking))
+        {
+            return false;
+        }
+
+        char buf[256];
+        ssize_t const r(read(fd, buf, sizeof(buf)));
+        if(r < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            eof = true;
+            return false;
+        }
+        if(r == 0)
+        {
+            eof = true;
+            return false;
+        }
+        buffer.append(buf, static_cast<std::size_t>(r));
+        read_once = true;
+    }
+}
+
+
+/** \brief Retrieve the current size of a file.
+ *
+ * \param[in] filename  The name of the file to check.
+ *
+ * \return The size of the file or 0 if it does not exist.
+ */
+inline std::size_t file_size(std::string const & filename)
+{
+    struct stat st = {};
+    if(stat(filename.c_str(), &st) != 0)
+    {
+        return 0;
+    }
+    return static_cast<std::size_t>(st.st_size);
+}
+
+
+/** \brief Copy part of a file to a stream.
+ *
+ * The workers save their report in a file. After each test case, the
+ * parent copies the new part of that report to its own output stream.
+ *
+ * \param[in] filename  The name of the worker report.
+ * \param[in] start  The offset where the data starts.
+ * \param[in] end  The offset where the data ends.
+ * \param[in] out  The output stream.
+ */
+inline void copy_file_slice(std::string const & filename, std::size_t start, std::size_t end, std::ostream & out)
+{
+    if(start >= end)
+    {
+        return;
+    }
+    int const fd(open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+    if(fd < 0)
+    {
+        return;
+    }
+    char buf[64 * 1024];
+    while(start < end)
+    {
+        ssize_t const r(pread(
+                  fd
+                , buf
+                , std::min(sizeof(buf), end - start)
+                , static_cast<off_t>(start)));
+        if(r <= 0)
+        {
+            break;
+        }
+        out.write(buf, r);
+        start += static_cast<std::size_t>(r);
+    }
+    close(fd);
+    out.flush();
+}
+
+
+/** \brief Information about one `--jobs` worker.
+ *
+ * The parent keeps one of these objects per worker it forked. The
+ * pipes are used to send the index of the next test case to run
+ * (m_command) and to receive the results (m_result).
+ */
+struct job_worker
+{
+    pid_t           m_pid = -1;
+    int             m_command = -1;
+    int             m_result = -1;
+    int             m_current = -1;
+    bool            m_eof = false;
+    unsigned int    m_seed = 0;
+    std::chrono::steady_clock::time_point
+                    m_started = std::chrono::steady_clock::time_point();
+    std::string     m_buffer = std::string();
+    std::string     m_report = std::string();
+};
+
+
+/** \brief Convert totals to a string sent through a pipe.
+ *
+ * \param[in] totals  The totals to serialize.
+ *
+ * \return The totals as a space separated list of numbers.
+ */
+inline std::string totals_to_string(Catch::Totals const & totals)
+{
+    std::stringstream ss;
+    ss << totals.assertions.passed
+       << ' ' << totals.assertions.failed
+       << ' ' << totals.assertions.failedButOk
+       << ' ' << totals.testCases.passed
+       << ' ' << totals.testCases.failed
+       << ' ' << totals.testCases.failedButOk;
+    return ss.str();
+}
+
+
+/** \brief Save the results a worker gathered besides its report.
+ *
+ * The section timings, budget overruns and benchmark results are saved
+ * in files named after \p base so the parent can merge them with
+ * load_worker_results().
+ *
+ * \param[in] base  The base name of the files.
+ */
+inline void save_worker_results(std::string const & base)
+{
+    if(!g_section_timings().empty())
+    {
+        save_section_timings(base + ".timings");
+    }
+
+    if(!g_watchdog().overruns().empty())
+    {
+        save_budget_overruns(base + ".budgets");
+    }
+
+    if(!g_histogram_summaries().empty())
+    {
+        save_histogram_summaries(base + ".histograms");
+    }
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+    if(!g_benchmark_results().empty())
+    {
+        save_benchmark_results(
+                  base + ".benchmarks"
+                , g_benchmark_results()
+                , std::string()
+                , std::string());
+    }
+#endif
+}
+
+
+/** \brief Merge the results saved by save_worker_results().
+ *
+ * \param[in] base  The base name of the files.
+ */
+inline void load_worker_results(std::string const & base)
+{
+    std::string const budgets(base + ".budgets");
+    if(access(budgets.c_str(), R_OK) == 0)
+    {
+        load_budget_overruns(budgets);
+    }
+
+    std::string const histograms(base + ".histograms");
+    if(access(histograms.c_str(), R_OK) == 0)
+    {
+        load_histogram_summaries(histograms);
+    }
+
+    std::string const timings(base + ".timings");
+    if(access(timings.c_str(), R_OK) == 0)
+    {
+        json_value const root(load_json(timings));
+        json_value const * sections(root.member("sections"));
+        if(sections != nullptr)
+        {
+            for(auto const & item : sections->m_items)
+            {
+                section_timing t;
+                t.m_test_case = item.string("test_case");
+                t.m_section = item.string("section");
+                t.m_count = static_cast<std::size_t>(item.number("count"));
+                t.m_wall = item.number("wall_ms") / 1000.0;
+                t.m_cpu = item.number("cpu_ms") / 1000.0;
+                t.m_max_wall = item.number("max_wall_ms") / 1000.0;
+                t.m_counters = read_perf_values(item.member("counters"));
+                merge_section_timing(t);
+            }
+        }
+    }
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+    std::string const benchmarks(base + ".benchmarks");
+    if(access(benchmarks.c_str(), R_OK) == 0)
+    {
+        std::vector<benchmark_result> const results(load_benchmark_results(benchmarks));
+        g_benchmark_results().insert(g_benchmark_results().end(), results.begin(), results.end());
+    }
+#endif
+}
+
+
+/** \brief A child forked by an `--isolate` worker.
+ *
+ * The child waits for the index of the test case to run on m_command and
+ * sends back its totals on m_result.
+ */
+struct isolated_child
+{
+    pid_t           m_pid = -1;
+    int             m_command = -1;
+    int             m_result = -1;
+};
+
+
+/** \brief Fork a child ready to run one test case.
+ *
+ * With `--isolate`, each `--jobs` worker acts as a zygote: it never runs
+ * a test itself. Instead, it forks one child per test case. The children
+ * start from the state of the worker, which already ran the
+ * `init_callback` and `callback` functions, so they are ready right away.
+ *
+ * The worker always keeps one spare child forked in advance so the cost
+ * of fork() overlaps the previous test case. One spare is enough: the
+ * worker runs one test case at a time and forks the next spare as soon
+ * as the previous one starts running a test, so it is ready long before
+ * it is needed. More spares would only use more memory (each child
+ * holds a copy of the worker pages it touches).
+ *
+ * The child writes its report to the same file as the worker. It saves
+ * its other results with save_worker_results() under
+ * `<report>.<test index>` before sending its totals.
+ *
+ * \param[in] context  The run context of the worker.
+ * \param[in] config  The configuration of the worker.
+ * \param[in] tests  The list of test cases.
+ * \param[in] worker  The worker information.
+ * \param[in] running  A child which is still running, its pipes get closed.
+ *
+ * \return The new child.
+ */
+inline isolated_child fork_isolated_child(
+      Catch::RunContext & context
+    , std::shared_ptr<Catch::Config> const & config
+    , std::vector<Catch::TestCase> const & tests
+    , job_worker const & worker
+    , isolated_child const & running)
+{
+    int command[2];
+    int result[2];
+    if(pipe2(command, O_CLOEXEC) != 0
+    || pipe2(result, O_CLOEXEC) != 0)
+    {
+        throw std::runtime_error("could not create the pipes of an --isolate child.");
+    }
+
+    isolated_child child;
+    child.m_pid = fork();
+    if(child.m_pid < 0)
+    {
+        throw std::runtime_error("could not fork an --isolate child.");
+    }
+    if(child.m_pid == 0)
+    {
+        int exit_code(0);
+        try
+        {
+            close(worker.m_command);
+            close(worker.m_result);
+            if(running.m_pid > 0)
+            {
+                // the command pipe may already be closed, in which case
+                // its number may have been reused by pipe2() above
+                //
+                if(running.m_command >= 0)
+                {
+                    close(running.m_command);
+                }
+                close(running.m_result);
+            }
+            close(command[1]);
+            close(result[0]);
+
+            std::string buffer;
+            std::string line;
+            bool eof(false);
+            if(read_line(command[0], buffer, line, eof, true))
+            {
+                int const idx(std::stoi(line));
+                if(idx >= 0
+                && static_cast<std::size_t>(idx) < tests.size())
+                {
+                    Catch::Totals const t(context.runTest(tests[idx]));
+                    config->stream().flush();
+                    save_worker_results(worker.m_report + '.' + std::to_string(idx));
+                    write_all(result[1], totals_to_string(t) + '\n');
+                }
+            }
+        }
+        catch(std::exception const & e)
+        {
+            std::cerr << "fatal error: --isolate child failed: "
+                      << e.what()
+                      << std::endl;
+            exit_code = 1;
+        }
+
+        std::cout.flush();
+        std::cerr.flush();
+        _exit(exit_code);
+    }
+
+    close(command[0]);
+    close(result[1]);
+    child.m_command = command[1];
+    child.m_result = result[0];
+
+    return child;
+}
+
+
+/** \brief Stop a spare child.
+ *
+ * Closing the command pipe lets the child exit without running a test.
+ *
+ * \param[in] child  The child to stop.
+ */
+inline void stop_isolated_child(isolated_child const & child)
+{
+    if(child.m_pid > 0)
+    {
+        close(child.m_command);
+        close(child.m_result);
+        int status(0);
+        waitpid(child.m_pid, &status, 0);
+    }
+}
+
+
+/** \brief Run one test case in a child process.
+ *
+ * The test case runs in \p child. A spare child gets forked while it
+ * runs. If \p child crashes, is killed by a signal or exits early, the
+ * test case is reported as failed and the run goes on.
+ *
+ * \param[in] idx  The index of the test case to run.
+ * \param[in,out] child  The child to use, replaced by the new spare child.
+ * \param[in] context  The run context of the worker.
+ * \param[in] config  The configuration of the worker.
+ * \param[in] tests  The list of test cases.
+ * \param[in] worker  The worker information.
+ *
+ * \return The totals of the test case.
+ */
+inline Catch::Totals run_isolated_test(
+      int idx
+    , isolated_child & child
+    , Catch::RunContext & context
+    , std::shared_ptr<Catch::Config> const & config
+    , std::vector<Catch::TestCase> const & tests
+    , job_worker const & worker)
+{
+    isolated_child running(child);
+    write_all(running.m_command, std::to_string(idx) + '\n');
+    close(running.m_command);
+    running.m_command = -1;
+
+    child = fork_isolated_child(context, config, tests, worker, running);
+
+    std::string buffer;
+    std::string line;
+    bool eof(false);
+    bool const got_totals(read_line(running.m_result, buffer, line, eof, true));
+    close(running.m_result);
+    int status(0);
+    while(waitpid(running.m_pid, &status, 0) < 0
+       && errno == EINTR);
+
+    Catch::Totals t;
+    if(got_totals
+    && WIFEXITED(status)
+    && WEXITSTATUS(status) == 0)
+    {
+        std::stringstream ss(line);
+        ss >> t.assertions.passed
+           >> t.assertions.failed
+           >> t.assertions.failedButOk
+           >> t.testCases.passed
+           >> t.testCases.failed
+           >> t.testCases.failedButOk;
+        return t;
+    }
+
+    config->stream()
+        << "error: test case \""
+        << tests[idx].name
+        << "\" crashed in child ["
+        << running.m_pid
+        << "] ("
+        << (WIFSIGNALED(status) ? "signal " : "exit code ")
+        << (WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status));
+    if(WIFSIGNALED(status))
+    {
+        config->stream() << ": " << strsignal(WTERMSIG(status));
+    }
+    config->stream() << ").\n";
+    config->stream().flush();
+
+    t.assertions.failed = 1;
+    t.testCases.failed = 1;
+    return t;
+}
+
+
+/** \brief Run tests as requested by the parent.
+ *
+ * This function is the body of a `--jobs` worker. It waits for the
+ * parent to send the index of a test case, runs it, and sends back
+ * the totals along with the position of that test case report in
+ * the worker report file.
+ *
+ * With `--isolate`, the worker runs each test case in a child process
+ * (see fork_isolated_child()).
+ *
+ * The function never returns. It calls `_exit()` once the parent
+ * sends -1 or closes the command pipe.
+ *
+ * \param[in] data  The configuration data of the session.
+ * \param[in] tests  The list of test cases to run.
+ * \param[in] worker  The worker information.
+ * \param[in] index  The index of this worker.
+ * \param[in] isolate  Whether each test case runs in its own process.
+ */
+[[noreturn]] inline void run_job_worker(
+      Catch::ConfigData const & data
+    , std::vector<Catch::TestCase> const & tests
+    , job_worker const & worker
+    , int index
+    , bool isolate)
+{
+    int exit_code(0);
+    try
+    {
+        // with --progress-async, the parent shows the progress
+        //
+        if(g_progress_reporter().active())
+        {
+            g_progress_reporter().detach_after_fork();
+            g_progress() = false;
+        }
+
+        g_tmp_dir() += "/worker-" + std::to_string(index);
+        if(mkdir(g_tmp_dir().c_str(), 0700) != 0
+        && errno != EEXIST)
+        {
+            throw std::runtime_error("could not create worker temporary directory \"" + g_tmp_dir() + "\".");
+        }
+        srand(worker.m_seed);
+
+        Catch::ConfigData worker_data(data);
+        worker_data.outputFilename = worker.m_report;
+        std::shared_ptr<Catch::Config> config(std::make_shared<Catch::Config>(worker_data));
+        Catch::seedRng(*config);
+
+        Catch::RunContext context(config, make_reporter(config));
+        context.testGroupStarting(config->name(), 1, 1);
+        config->stream().flush();
+        std::size_t offset(file_size(worker.m_report));
+
+        isolated_child spare;
+        if(isolate)
+        {
+            spare = fork_isolated_child(context, config, tests, worker, spare);
+        }
+
+        std::string line("R -1 " + totals_to_string(Catch::Totals()) + " 0 0\n");
+        std::string buffer;
+        bool eof(false);
+        Catch::Totals totals;
+        for(;;)
+        {
+            if(!write_all(worker.m_result, line)
+            || !read_line(worker.m_command, buffer, line, eof, true))
+            {
+                break;
+            }
+            int const idx(std::stoi(line));
+            if(idx < 0
+            || static_cast<std::size_t>(idx) >= tests.size())
+            {
+                break;
+            }
+
+            Catch::Totals const t(isolate
+                        ? run_isolated_test(idx, spare, context, config, tests, worker)
+                        : (context.aborting()
+                            ? Catch::Totals()
+                            : context.runTest(tests[idx])));
+            totals += t;
+
+            config->stream().flush();
+            std::size_t const end(file_size(worker.m_report));
+            line = "R "
+                 + std::to_string(idx)
+                 + ' '
+                 + totals_to_string(t)
+                 + ' '
+                 + std::to_string(offset)
+                 + ' '
+                 + std::to_string(end)
+                 + '\n';
+            offset = end;
+        }
+
+        if(isolate)
+        {
+            stop_isolated_child(spare);
+        }
+
+        context.testGroupEnded(config->name(), totals, 1, 1);
+
+        save_worker_results(worker.m_report);
+    }
+    catch(std::exception const & e)
+    {
+        std::cerr << "fatal error: worker #"
+                  << index
+                  << " failed: "
+                  << e.what()
+                  << std::endl;
+        exit_code = 1;
+    }
+
+    std::cout.flush();
+    std::cerr.flush();
+    _exit(exit_code);
+}
+
+
+/** \brief Run the tests in parallel.
+ *
+ * This function forks \p jobs workers and hands out the test cases to
+ * them one at a time. As soon as a worker is done with one test case,
+ * it receives the next one, so slow test cases do not hold up the
+ * other workers.
+ *
+ * Each worker gets its own sub-directory under g_tmp_dir() and its own
+ * seed, derived from \p seed.
+ *
+ * Unless another order is requested, the test cases are handed out
+ * longest first according to the history of the previous runs. This
+ * way the longest test cases do not end up running alone at the end.
+ *
+ * The reports of each test case are copied to the output of the parent
+ * in the order in which the test cases end and the totals are merged
+ * so only one summary gets printed.
+ *
+ * With \p isolate, the workers run each test case in a child process
+ * so a crash only fails that one test case.
+ *
+ * \param[in] data  The session configuration data.
+ * \param[in] jobs  The number of workers to create.
+ * \param[in] seed  The seed used to derive the seed of each worker.
+ * \param[in] order  The order in which the test cases get handed out.
+ * \param[in] isolate  Whether each test case runs in its own process.
+ *
+ * \return The exit code, computed the same way as Catch::Session::run().
+ */
+inline int run_jobs(
+      Catch::ConfigData const & data
+    , int jobs
+    , unsigned int seed
+    , order_t order
+    , bool isolate)
+{
+    std::shared_ptr<Catch::Config> config(std::make_shared<Catch::Config>(data));
+    Catch::getCurrentMutableContext().setConfig(config);
+    std::vector<Catch::TestCase> tests(Catch::filterTests(
+                  Catch::getAllTestCasesSorted(*config)
+                , config->testSpec()
+                , *config));
+    if(order == order_t::ORDER_DEFAULT)
+    {
+        order = order_t::ORDER_LONGEST_FIRST;
+    }
+    order_tests(tests, order);
+
+    // a worker which dies would otherwise kill us on the next write()
+    //
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<job_worker> workers(static_cast<std::size_t>(jobs));
+    for(std::size_t idx(0); idx < workers.size(); ++idx)
+    {
+        job_worker & w(workers[idx]);
+        w.m_seed = seed + static_cast<unsigned int>((idx + 1) * 0x9E3779B9ULL);
+        w.m_report = g_tmp_dir() + "/worker-" + std::to_string(idx) + ".report";
+
+        int command[2];
+        int result[2];
+        if(pipe2(command, O_CLOEXEC) != 0
+        || pipe2(result, O_CLOEXEC) != 0)
+        {
+            throw std::runtime_error("could not create the pipes of a --jobs worker.");
+        }
+
+        std::cout.flush();
+        std::cerr.flush();
+        w.m_pid = fork();
+        if(w.m_pid < 0)
+        {
+            throw std::runtime_error("could not fork a --jobs worker.");
+        }
+        if(w.m_pid == 0)
+        {
+            for(std::size_t j(0); j < idx; ++j)
+            {
+                close(workers[j].m_command);
+                close(workers[j].m_result);
+            }
+            close(command[1]);
+            close(result[0]);
+            w.m_command = command[0];
+            w.m_result = result[1];
+            run_job_worker(data, tests, w, static_cast<int>(idx), isolate);
+        }
+        close(command[0]);
+        close(result[1]);
+        w.m_command = command[1];
+        w.m_result = result[0];
+
+        std::cout << "worker #"
+                  << idx
+                  << " ["
+                  << w.m_pid
+                  << "]: seed is "
+                  << w.m_seed
+                  << std::endl;
+    }
+
+    Catch::IStreamingReporterPtr reporter(make_reporter(config));
+    Catch::TestRunInfo const run_info(config->name());
+    Catch::GroupInfo const group_info(config->name(), 1, 1);
+    reporter->testRunStarting(run_info);
+    reporter->testGroupStarting(group_info);
+
+    Catch::Totals totals;
+    std::size_t next(0);
+    std::vector<pollfd> fds;
+    for(;;)
+    {
+        fds.clear();
+        for(auto const & w : workers)
+        {
+            if(!w.m_eof)
+            {
+                fds.push_back(pollfd{ w.m_result, POLLIN, 0 });
+            }
+        }
+        if(fds.empty())
+        {
+            break;
+        }
+        if(poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error("poll() failed while waiting on the --jobs workers.");
+        }
+
+        for(auto & w : workers)
+        {
+            if(w.m_eof)
+            {
+                continue;
+            }
+            auto const it(std::find_if(
+                      fds.begin()
+                    , fds.end()
+                    , [&w](pollfd const & p) { return p.fd == w.m_result; }));
+            if(it == fds.end()
+            || it->revents == 0)
+            {
+                continue;
+            }
+
+            std::string line;
+            while(read_line(w.m_result, w.m_buffer, line, w.m_eof, false))
+            {
+                std::stringstream ss(line);
+                char tag('\0');
+                int idx(-1);
+                Catch::Totals t;
+                std::size_t start(0);
+                std::size_t end(0);
+                ss >> tag
+                   >> idx
+                   >> t.assertions.passed
+                   >> t.assertions.failed
+                   >> t.assertions.failedButOk
+                   >> t.testCases.passed
+                   >> t.testCases.failed
+                   >> t.testCases.failedButOk
+                   >> start
+                   >> end;
+                if(tag != 'R')
+                {
+                    continue;
+                }
+                if(idx >= 0)
+                {
+                    totals += t;
+                    copy_file_slice(w.m_report, start, end, config->stream());
+                    if(isolate)
+                    {
+                        load_worker_results(w.m_report + '.' + std::to_string(idx));
+                    }
+                    record_test_history(
+                              tests[idx].name
+                            , std::chrono::steady_clock::now() - w.m_started
+                            , t.assertions.failed != 0);
+                    g_progress_reporter().post(progress_event_t::PROGRESS_EVENT_TEST_ENDED, tests[idx].name);
+                }
+
+                if(next < tests.size()
+                && (config->abortAfter() <= 0
+                    || totals.assertions.failed < static_cast<std::size_t>(config->abortAfter())))
+                {
+                    w.m_current = static_cast<int>(next);
+                    w.m_started = std::chrono::steady_clock::now();
+                    g_progress_reporter().post(progress_event_t::PROGRESS_EVENT_TEST_STARTED, tests[next].name);
+                    ++next;
+                }
+                else
+                {
+                    w.m_current = -1;
+                }
+                write_all(w.m_command, std::to_string(w.m_current) + '\n');
+            }
+
+            if(w.m_eof)
+            {
+                close(w.m_command);
+                close(w.m_result);
+                int status(0);
+                waitpid(w.m_pid, &status, 0);
+                if(w.m_current >= 0)
+                {
+                    // the worker died while running a test
+                    //
+                    config->stream()
+                        << "error: worker ["
+                        << w.m_pid
+                        << "] died while running test case \""
+                        << tests[w.m_current].name
+                        << "\" ("
+                        << (WIFSIGNALED(status) ? "signal " : "exit code ")
+                        << (WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status))
+                        << ").\n";
+                    record_test_history(
+                              tests[w.m_current].name
+                            , std::chrono::steady_clock::now() - w.m_started
+                            , true);
+                    g_progress_reporter().post(progress_event_t::PROGRESS_EVENT_TEST_ENDED, tests[w.m_current].name);
+                    ++totals.assertions.failed;
+                    ++totals.testCases.failed;
+                    w.m_current = -1;
+                }
+            }
+        }
+    }
+
+    if(next < tests.size()
+    && (config->abortAfter() <= 0
+        || totals.assertions.failed < static_cast<std::size_t>(config->abortAfter())))
+    {
+        config->stream()
+            << "error: all the workers died before all the tests ran ("
+            << tests.size() - next
+            << " test cases were not run).\n";
+        totals.error = 1;
+    }
+
+    reporter->testGroupEnded(Catch::TestGroupStats(group_info, totals, false));
+    reporter->testRunEnded(Catch::TestRunStats(run_info, totals, false));
+
+    for(auto const & w : workers)
+    {
+        load_worker_results(w.m_report);
+    }
+
+    if(tests.empty()
+    && config->warnAboutNoTests())
+    {
+        return 2;
+    }
+
+    return std::min(255, std::max(totals.error, static_cast<int>(totals.assertions.failed)));
+}
+
+
+/** \brief Start the `--progress-async` reporter.
+ *
+ * The reporter needs the number of tests to run and, to compute an ETA,
+ * their duration in the previous run. Tests without history are expected
+ * to take the average duration of the others.
+ *
+ * \param[in] data  The session configuration data.
+ */
+inline void start_progress_reporter(Catch::ConfigData const & data)
+{
+    std::shared_ptr<Catch::Config> config(std::make_shared<Catch::Config>(data));
+    std::vector<Catch::TestCase> const tests(Catch::filterTests(
+                  Catch::getAllTestCasesSorted(*config)
+                , config->testSpec()
+                , *config));
+
+    std::map<std::string, double> expected;
+    double total(0.0);
+    for(auto const & t : tests)
+    {
+        test_history const * h(find_test_history(t.name));
+        if(h != nullptr)
+        {
+            expected[t.name] = static_cast<double>(h->m_duration_us) / 1.0e6;
+            total += expected[t.name];
+        }
+    }
+    if(!expected.empty())
+    {
+        double const average(total / static_cast<double>(expected.size()));
+        for(auto const & t : tests)
+        {
+            expected.emplace(t.name, average);
+        }
+    }
+
+    g_progress() = true;
+    g_progress_reporter().start(expected, tests.size());
+}
+
+
+/** \brief Run the tests in the specified order.
+ *
+ * This function replaces Catch::Session::run() when the tests have to
+ * be run in an order catch2 does not support (i.e. `--order failed-first`).
+ * It runs the tests in this process, one after the other.
+ *
+ * \param[in] data  The session configuration data.
+ * \param[in] order  The order in which the test cases run.
+ *
+ * \return The exit code, computed the same way as Catch::Session::run().
+ */
+inline int run_tests(Catch::ConfigData const & data, order_t order)
+{
+    std::shared_ptr<Catch::Config> config(std::make_shared<Catch::Config>(data));
+    Catch::getCurrentMutableContext().setConfig(config);
+    Catch::seedRng(*config);
+    std::vector<Catch::TestCase> tests(Catch::filterTests(
+                  Catch::getAllTestCasesSorted(*config)
+                , config->testSpec()
+                , *config));
+    order_tests(tests, order);
+
+    Catch::Totals totals;
+    {
+        Catch::RunContext context(config, make_reporter(config));
+        context.testGroupStarting(config->name(), 1, 1);
+        for(auto const & t : tests)
+        {
+            if(context.aborting())
+            {
+                context.reporter().skipTest(t);
+            }
+            else
+            {
+                totals += context.runTest(t);
+            }
+        }
+        context.testGroupEnded(config->name(), totals, 1, 1);
+    }
+
+    if(tests.empty()
+    && config->warnAboutNoTests())
+    {
+        return 2;
+    }
+
+    return std::min(255, std::max(totals.error, static_cast<int>(totals.assertions.failed)));
+}
+
+
+/** \brief Split the test cases in shards of about the same duration.
+ *
+ * This function implements the `--list-shards <count>` command line
+ * option used by the snapcatch2_add_tests() cmake function. The test
+ * cases selected by the command line get distributed between \p count
+ * shards using the longest processing time first rule: the test cases
+ * are sorted by duration, longest first, and each one is added to the
+ * shard with the smallest total so far. The durations come from the
+ * test history, looked up by test case name: this function runs right
+ * after the link, when the new binary has a build ID which ran nothing
+ * yet, so the most recent duration saved by any build gets used (see
+ * find_test_history()). Test cases without history are expected to take
+ * the average duration of the others.
+ *
+ * The first line gives the number of test cases found in the history
+ * and the total number of test cases, then one line is printed per test
+ * case:
+ *
+ * \code
+ *     history <known> <count>
+ *     shard <index> <test case name>
+ * \endcode
+ *
+ * \param[in] data  The session configuration data.
+ * \param[in] count  The number of shards.
+ * \param[in] out  The stream where the shards get printed.
+ */
+inline void list_shards(Catch::ConfigData const & data, std::size_t count, std::ostream & out)
+{
+    std::shared_ptr<Catch::Config> config(std::make_shared<Catch::Config>(data));
+    std::vector<Catch::TestCase> const tests(Catch::filterTests(
+                  Catch::getAllTestCasesSorted(*config)
+                , config->testSpec()
+                , *config));
+
+    std::int64_t total(0);
+    std::size_t known(0);
+    for(auto const & t : tests)
+    {
+        test_history const * h(find_test_history(t.name));
+        if(h != nullptr)
+        {
+            total += h->m_duration_us;
+            ++known;
+        }
+    }
+    std::int64_t const average(known == 0 ? 1 : total / static_cast<std::int64_t>(known));
+    out << "history " << known << ' ' << tests.size() << '\n';
+
+    std::vector<std::pair<std::int64_t, std::string>> durations;
+    for(auto const & t : tests)
+    {
+        test_history const * h(find_test_history(t.name));
+        durations.emplace_back(
+                  h == nullptr ? average : h->m_duration_us
+                , t.name);
+    }
+    std::sort(
+          durations.begin()
+        , durations.end()
+        , [](std::pair<std::int64_t, std::string> const & a, std::pair<std::int64_t, std::string> const & b)
+        {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+
+    std::vector<std::int64_t> loads(count);
+    for(auto const & d : durations)
+    {
+        std::size_t const shard(std::min_element(loads.begin(), loads.end()) - loads.begin());
+        loads[shard] += d.first;
+        out << "shard " << shard << ' ' << d.second << '\n';
+    }
+    out << std::flush;
+}
+
+
+} // detail namespace
+
+
+/** \brief The main function to initialize and run the unit tests.
+ *
+ * This inline function initializes and runs the snapcatch2 tests.
+ *
+ * The \p init_callback parameter is used to initialize your test before
+ * we parse the command line. Use the \p callback function to do further
+ * initialization after the command line is parsed and basic functions
+ * run (i.e. the `--version` command line option will run and the
+ * function exit before \p callback gets called. So when the user uses
+ * that command line option, you do not get \p callback called, however,
+ * \p init_callback will always be called.)
+ *
+ * We do it this way because the function will try/catch std::exception
+ * so if an exception occurs in your \p init_callback, it will always
+ * be captured and a message printed out before the application
+ * exits cleanly with an error code (i.e. `exit(1)`).
+ *
+ * The \p init_callback can be set to a nullptr if you do not need to
+ * initialize anything futher early on.
+ *
+ * One thing we use the \p init_callback for is to prevent our
+ * libexcept exceptions from generating a stack trace because that's
+ * very slow and in a test which generate thousands if not million
+ * of exception cases, it makes it really very slow.
+ *
+ * \code
+ *     snap_catch2_main(
+ *           "libutf8"
+ *         , "1.2.3"
+ *         , argc
+ *         , argv
+ *         , []() { libexcept::set_collect_stack(libexcept::collect_stack_t::COLLECT_STACK_NO); }
+ *     );
+ * \endcode
+ *
+ * The \p add_user_options parameter is a pointer to a function which
+ * adds command line options supported by your test. This pointer can
+ * be set to nullptr, For example, if you wanted to support a path to
+ * a temporary directory, you would write:
+ *
+ * \code
+ *     namespace SNAP_CATCH2_NAMESPACE
+ *     {
+ *
+ *     std::string g_tmpdir= std::string("/tmp");
+ *
+ *     Catch::clara::Parser add_command_line_options(Catch::clara::Parser const & cli)
+ *     {
+ *         return cli
+ *              | Catch::clara::Opt(g_tmpdir, "tmpdir")
+ *                   ["--tmpdir"]
+ *                   ("a path to a temporary directory used by the test.");
+ *     }
+ *
+ *     }
+ *
+ *     ...snip...
+ *
+ *     snap_catch2_main(
+ *           "libutf8"
+ *         , "1.2.3"
+ *         , argc
+ *         , argv
+ *         , nullptr
+ *         , &add_command_line_options
+ *     );
+ * \endcode
+ *
+ * \warning
+ * It is possible to add a one letter command line option such as ["-t"],
+ * however, catch2 already uses most of these options. The `-t` is used
+ * to list tags, for example.
+ *
+ * The \p callback function gets called just before the tests get run.
+ * In other words, we give you one more chance to verify command line
+ * parameters or do additional initilalizations, now that you have access
+ * to the user defined command line parameters. We pass the session to
+ * the function, although in many cases you will not use it because your
+ * parameters are already set as expected.
+ *
+ * \code
+ *     namespace SNAP_CATCH2_NAMESPACE
+ *     {
+ *
+ *     int finish_init(Catch::Session & session)
+ *     {
+ *         std::string cmd("rm -rf ");
+ *         cmd += g_tmpdir;
+ *         cmd += "/my-project";
+ *         if(system(cmd.c_str()) != 0)
+ *         {
+ *             perror(cmd.c_str());
+ *             return 1;
+ *         }
+ *
+ *         return 0;
+ *     }
+ *
+ *     }
+ *
+ *     ...snip...
+ *
+ *     snap_catch2_main(
+ *           "libutf8"
+ *         , "1.2.3"
+ *         , argc
+ *         , argv
+ *         , nullptr
+ *         , nullptr
+ *         , &finish_init
+ *     );
+ * \endcode
+ *
+ * When the `--jobs <N>` command line option is used with N larger than
+ * one, the tests are run in N worker processes. The workers are forked
+ * once all the initialization is done (i.e. after \p init_callback and
+ * \p callback returned). Each worker gets its own sub-directory in
+ * g_tmp_dir() (`worker-<index>`) and its own seed derived from `--seed`.
+ * The test cases are handed to the workers one at a time, as they become
+ * available, and the results are merged in a single report by the parent
+ * process. Note that only the console and compact reporters produce a
+ * clean merged output; the other reporters still work but their output
+ * includes one fragment per test case.
+ *
+ * The duration and result of each test case get saved in a history file
+ * (`--history`, by default `<tmp-dir>.history`). The next run can use
+ * it with `--order failed-first`, to run the test cases which failed
+ * last time first, or `--order longest-first`. The `--jobs` workers
+ * also get the longest test cases first so the load stays balanced.
+ * The same durations are used by `--list-shards <count>` which prints
+ * the test cases split in shards of about the same duration, without
+ * running them (see snapcatch2_add_tests() in SnapCatch2Config.cmake).
+ *
+ * Once the tests ran, we call the \p finished_callback as well. This gives
+ * you the ability to test futher things such as making sure that everything
+ * was cleaned up, resources released, etc. For example, in our advgetopt
+ * we use a FIFO to handle error messages. If an error never occurs that
+ * FIFO will not be empty on exit. This is actually an error in the test.
+ * Only errors that do occur have to be added to the FIFO. So on exit we
+ * want to verify that the FIFO is indeed empty.
+ *
+ * \param[in] project_name  The name of the project (i.e. "libutf8").
+ * \param[in] project_version  The version string of the project
+ *                     (i.e. "LIBUTF8_VERSION_STRING").
+ * \param[in] argc  The number of arguments on the command line.
+ * \param[in] argv  An array of strings with the command line arguments.
+ * \param[in] init_callback  Callback called before anything else.
+ * \param[in] add_user_options  A callback giving you the opportunity to add
+ *                              command line options before argv gets parsed.
+ * \param[in] callback  A callback called just before we run the tests.
+ * \param[in] finished_callback  The callback called just after all the tests
+ *                               ran.
+ *
+ * \return The exit code, usually 0 on success and 1 on an error.
+ */
+#ifndef SNAP_CATCH2_BUILDING_LIBRARY
+inline
+#endif
+int snap_catch2_main(
+          char const * project_name
+        , char const * project_version
+        , int argc
+        , char * argv[]
+        , void (*init_callback)() = nullptr
+        , Catch::clara::Parser (*add_user_options)(Catch::clara::Parser const & cli) = nullptr
+        , int (*callback)(Catch::Session & session) = nullptr
+        , void (*finished_callback)() = nullptr)
+{
+    typedef unsigned int seed_t; // see `man srand(3)` for type
+
+    try
+    {
+        if(init_callback != nullptr)
+        {
+            init_callback();
+        }
+
+        Catch::Session session;
+
+        bool version(false);
+        seed_t seed(static_cast<seed_t>(time(NULL)));
+        int jobs(1);
+        int list_shards(0);
+        bool isolate(false);
+        bool async_cleanup(false);
+        bool tmp_dir_in_memory(false);
+        std::string history;
+        bool no_history(false);
+        bool progress_async(false);
+        std::string max_duration;
+        std::string scale;
+        std::string stress_threads;
+        std::string stress_duration;
+        std::string stress_warmup;
+        std::string time_budget;
+        std::string timings_json;
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+        std::string benchmark_out;
+        std::string benchmark_baseline;
+        double benchmark_threshold(5.0);
+#endif
+
+        auto cli = session.cli()
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+                 | Catch::clara::Opt(benchmark_out, "file.json")
+                    ["--benchmark-out"]
+                    ("save the benchmark results to this JSON file")
+                 | Catch::clara::Opt(benchmark_baseline, "file.json")
+                    ["--benchmark-baseline"]
+                    ("compare the benchmark results against this JSON file")
+                 | Catch::clara::Opt(benchmark_threshold, "percent")
+                    ["--benchmark-threshold"]
+                    ("a benchmark slower than its baseline by more than this is a regression (default: 5)")
+#endif
+                 | Catch::clara::Opt(g_bulk_failures(), "count")
+                    ["--bulk-failures"]
+                    ("number of failures shown by a CATCH_REQUIRE_ALL() scope")
+                 | Catch::clara::Opt(seed, "seed")
+                    ["-S"]["--seed"]
+                    ("value to seed the randomizer, if not specified, randomize")
+                 | Catch::clara::Opt(g_diff_context(), "lines")
+                    ["--diff-context"]
+                    ("number of lines shown around differences in long strings")
+                 | Catch::clara::Opt(g_golden_dir(), "path")
+                    ["--golden-dir"]
+                    ("directory of the golden files used by CATCH_REQUIRE_MATCHES_GOLDEN()")
+                 | Catch::clara::Opt(detail::g_histograms_json(), "file.json")
+                    ["--histograms-json"]
+                    ("save the percentiles of the latency histograms to this JSON file")
+                 | Catch::clara::Opt(history, "filename")
+                    ["--history"]
+                    ("file with the duration and result of the last run of each test (default: <tmp-dir>.history)")
+                 | Catch::clara::Opt(isolate)
+                    ["--isolate"]
+                    ("run each test case in its own process so a crash only fails that test case")
+                 | Catch::clara::Opt(jobs, "jobs")
+                    ["--jobs"]
+                    ("run the tests in that many worker processes")
+                 | Catch::clara::Opt(list_shards, "count")
+                    ["--list-shards"]
+                    ("split the test cases in that many shards of about the same duration and list them")
+                 | Catch::clara::Opt(max_duration, "duration")
+                    ["--max-duration"]
+                    ("report test cases running longer than this (e.g. 200ms, 5s, 1m)")
+                 | Catch::clara::Opt(detail::g_watchdog().abort_on_overrun())
+                    ["--max-duration-abort"]
+                    ("abort the process when a test case exceeds its time budget")
+                 | Catch::clara::Opt(no_history)
+                    ["--no-history"]
+                    ("do not load nor save the test history")
+                 | Catch::clara::Opt(detail::g_perf_counters())
+                    ["--perf-counters"]
+                    ("collect the performance counters (cycles, cache misses...) of the timed sections")
+                 | Catch::clara::Opt(g_progress())
+                    ["-p"]["--progress"]
+                    ("print name of test section being run")
+                 | Catch::clara::Opt(progress_async)
+                    ["--progress-async"]
+                    ("show the progress in a status line updated by a background thread")
+                 | Catch::clara::Opt(g_property_examples(), "count")
+                    ["--property-examples"]
+                    ("number of random examples tried by each property (default 100)")
+                 | Catch::clara::Opt(detail::g_property_input(), "file")
+                    ["--property-input"]
+                    ("run the properties with this input instead of random ones")
+                 | Catch::clara::Opt(g_property_threads(), "count")
+                    ["--property-threads"]
+                    ("number of threads used to shrink a failing property (default: one per CPU)")
+                 | Catch::clara::Opt(scale, "factor")
+                    ["--scale"]
+                    ("multiply the iterations of the heavy tests by this factor (default: 1, lower under valgrind or sanitizers)")
+                 | Catch::clara::Opt(stress_duration, "duration")
+                    ["--stress-duration"]
+                    ("duration of each round of the stress tests (e.g. 500ms, 10s)")
+                 | Catch::clara::Opt(detail::g_stress_settings().m_pin)
+                    ["--stress-pin"]
+                    ("pin the threads of the stress tests to one CPU each")
+                 | Catch::clara::Opt(stress_threads, "counts")
+                    ["--stress-threads"]
+                    ("comma separated thread counts of the stress test rounds (e.g. 1,2,4,max)")
+                 | Catch::clara::Opt(stress_warmup, "duration")
+                    ["--stress-warmup"]
+                    ("duration of the warmup of each round of the stress tests")
+                 | Catch::clara::Opt(time_budget, "duration")
+                    ["--time-budget"]
+                    ("calibrate the loops of each test case so it runs for about this long (e.g. 2s)")
+                 | Catch::clara::Opt(g_timings(), "count")
+                    ["--timings"]
+                    ("time each section and list the <count> slowest ones")
+                 | Catch::clara::Opt(timings_json, "file.json")
+                    ["--timings-json"]
+                    ("time each section and save the results to this JSON file")
+                 | Catch::clara::Opt(g_tmp_dir(), "tmp_dir")
+                    ["-T"]["--tmp-dir"]
+                    ("specify a temporary directory")
+                 | Catch::clara::Opt(async_cleanup)
+                    ["--tmp-dir-async-cleanup"]
+                    ("rename the old temporary directory and delete it in the background")
+                 | Catch::clara::Opt(tmp_dir_in_memory)
+                    ["--tmp-dir-in-memory"]
+                    ("use /dev/shm/<project-name> as the default temporary directory when it is a tmpfs")
+                 | Catch::clara::Opt(g_update_golden())
+                    ["--update-golden"]
+                    ("replace the golden files which do not match with the new data")
+                 | Catch::clara::Opt(g_verbose())
+                    ["--verbose"]
+                    ("print additional information from within our own tests")
+                 | Catch::clara::Opt(version)
+                    ["-V"]["--version"]
+                    ("print out the libutf8 library version these unit tests pertain to");
+
+        if(add_user_options != nullptr)
+        {
+            cli = add_user_options(cli);
+        }
+
+        session.cli(cli);
+
+        std::vector<char *> args(argv, argv + argc);
+        detail::order_t const order(detail::extract_order(args));
+        bool const history_order(order == detail::order_t::ORDER_FAILED_FIRST
+                              || order == detail::order_t::ORDER_LONGEST_FIRST);
+        if(session.applyCommandLine(static_cast<int>(args.size()), args.data()) != 0)
+        {
+            std::cerr << "fatal error: invalid command line." << std::endl;
+            return 1;
+        }
+
+        if(version)
+        {
+            std::cout << project_version << std::endl;
+            return 0;
+        }
+
+        if(jobs < 1)
+        {
+            std::cerr << "fatal error: --jobs must be at least 1." << std::endl;
+            return 1;
+        }
+
+        if(list_shards < 0)
+        {
+            std::cerr << "fatal error: --list-shards must be at least 1." << std::endl;
+            return 1;
+        }
+
+        if(g_property_examples() < 1)
+        {
+            std::cerr << "fatal error: --property-examples must be at least 1." << std::endl;
+            return 1;
+        }
+
+        if(!max_duration.empty())
+        {
+            detail::g_max_duration() = detail::parse_duration(max_duration);
+        }
+        if(!detail::verify_budget_tags(std::cerr))
+        {
+            return 1;
+        }
+
+        std::string scale_reason;
+        if(scale.empty())
+        {
+            g_scale() = detail::detect_scale(scale_reason);
+        }
+        else
+        {
+            std::size_t end(0);
+            try
+            {
+                g_scale() = std::stod(scale, &end);
+            }
+            catch(std::logic_error const &)
+            {
+                end = 0;
+            }
+            if(end == 0
+            || end != scale.length()
+            || !(g_scale() > 0.0))
+            {
+                std::cerr << "fatal error: --scale expects a number larger than 0." << std::endl;
+                return 1;
+            }
+            scale_reason = "--scale";
+        }
+        if(!time_budget.empty())
+        {
+            detail::g_time_budget() = detail::parse_duration(time_budget);
+        }
+
+        if(!stress_threads.empty())
+        {
+            detail::g_stress_settings().m_threads = detail::parse_thread_counts(stress_threads);
+        }
+        if(!stress_duration.empty())
+        {
+            detail::g_stress_settings().m_duration = detail::parse_duration(stress_duration);
+        }
+        if(!stress_warmup.empty())
+        {
+            detail::g_stress_settings().m_warmup = detail::parse_duration(stress_warmup);
+            detail::g_stress_settings().m_has_warmup = true;
+        }
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+        if(!benchmark_baseline.empty()
+        && access(benchmark_baseline.c_str(), R_OK) != 0)
+        {
+            std::cerr << "fatal error: cannot read benchmark baseline \""
+                      << benchmark_baseline
+                      << "\"."
+                      << std::endl;
+            return 1;
+        }
+#endif
+
+        detail::init_tmp_dir(project_name, async_cleanup, tmp_dir_in_memory);
+
+        if(no_history)
+        {
+            if(history_order)
+            {
+                std::cerr << "fatal error: --order failed-first and --order longest-first require the test history." << std::endl;
+                return 1;
+            }
+        }
+        else
+        {
+            if(history.empty())
+            {
+                history = g_tmp_dir() + ".history";
+            }
+            detail::load_test_history(history);
+        }
+
+        detail::g_section_timing_enabled() = g_timings() > 0 || !timings_json.empty();
+
+        // by default we get a different seed each time; that really helps
+        // in detecting errors! At least it helped me many times.
+        //
+        srand(seed);
+        g_random_seed() = seed;
+
+        if(callback != nullptr)
+        {
+            int const e(callback(session));
+            if(e != 0)
+            {
+                return e;
+            }
+        }
+
+        if(list_shards > 0)
+        {
+            detail::list_shards(session.configData(), static_cast<std::size_t>(list_shards), std::cout);
+            return 0;
+        }
+
+        std::cout << project_name
+                  << " v"
+                  << project_version
+                  << " ["
+                  << getpid()
+                  << "]:unittest: seed is "
+                  << seed
+                  << "\n"
+                  << "temporary directory: \""
+                  << g_tmp_dir()
+                  << "\""
+                  << std::endl;
+        if(!scale_reason.empty())
+        {
+            std::cout << "workload scale: "
+                      << g_scale()
+                      << " ("
+                      << scale_reason
+                      << ")"
+                      << std::endl;
+        }
+
+        Catch::ConfigData const & data(session.configData());
+        bool const listing(data.listTests
+                        || data.listTestNamesOnly
+                        || data.listTags
+                        || data.listReporters
+                        || data.showHelp
+                        || data.libIdentify);
+        if(progress_async
+        && !listing)
+        {
+            detail::start_progress_reporter(data);
+        }
+
+        auto r(listing
+                ? session.run()
+                : (jobs > 1 || isolate
+                    ? detail::run_jobs(data, jobs, seed, order, isolate)
+                    : (history_order
+                        ? detail::run_tests(data, order)
+                        : session.run())));
+
+        detail::g_progress_reporter().stop();
+        detail::g_watchdog().stop();
+
+        if(!listing
+        && !no_history)
+        {
+            detail::save_test_history(history);
+        }
+
+        if(g_timings() > 0)
+        {
+            detail::print_section_timings(g_timings(), std::cout);
+        }
+        if(!timings_json.empty())
+        {
+            detail::save_section_timings(timings_json);
+        }
+        if(!listing
+        && !detail::g_histograms_json().empty())
+        {
+            detail::save_histogram_summaries(detail::g_histograms_json());
+        }
+
+        if(!detail::g_watchdog().overruns().empty())
+        {
+            std::cout << "\nTest cases over their time budget:\n";
+            for(auto const & o : detail::g_watchdog().overruns())
+            {
+                std::cout << "  " << o.m_test_case
+                          << ": " << o.m_duration.count() / 1000
+                          << "ms (budget: " << o.m_budget.count() / 1000
+                          << "ms)\n";
+            }
+            std::cout << std::flush;
+            if(r == 0)
+            {
+                r = 1;
+            }
+        }
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+        if(!listing)
+        {
+            if(!benchmark_out.empty())
+            {
+                detail::save_benchmark_results(
+                          benchmark_out
+                        , detail::g_benchmark_results()
+                        , project_name
+                        , project_version);
+            }
+            if(!benchmark_baseline.empty()
+            && detail::compare_benchmark_results(
+                      detail::g_benchmark_results()
+                    , benchmark_baseline
+                    , benchmark_threshold
+                    , std::cout) != 0
+            && r == 0)
+            {
+                r = 1;
+            }
+        }
+#endif
+
+        if(finished_callback != nullptr)
+        {
+            finished_callback();
+        }
+
+        return r;
+    }
+    catch(std::logic_error const & e)
+    {
+        std::cerr << "fatal error: caught a logic error in "
+                  << project_name
+                  << " unit tests: "
+                  << e.what()
+                  << "\n";
+        return 1;
+    }
+    catch(std::runtime_error const & e)
+    {
+        std::cerr << "fatal error: caught a run-time error in "
+                  << project_name
+                  << " unit tests: "
+                  << e.what()
+                  << "\n";
+        return 1;
+    }
+    catch(std::exception const & e)
+    {
+        std::cerr << "fatal error: caught a standard exception in "
+                  << project_name
+                  << " unit tests: "
+                  << e.what()
+                  << "\n";
+        return 1;
+    }
+}
+#elif defined(SNAP_CATCH2_USE_LIBRARY)
+/** \brief The prebuilt snap_catch2_main() function.
+ *
+ * When SNAP_CATCH2_USE_LIBRARY is defined (the SnapCatch2::SnapCatch2
+ * cmake target does so), the main() function of your tests calls the
+ * snap_catch2_main() function found in libsnapcatch2.a instead of
+ * compiling it along the whole catch2 implementation.
+ *
+ * See the inline version for details about the parameters.
+ */
+int snap_catch2_main(
+          char const * project_name
+        , char const * project_version
+        , int argc
+        , char * argv[]
+        , void (*init_callback)() = nullptr
+        , Catch::clara::Parser (*add_user_options)(Catch::clara::Parser const & cli) = nullptr
+        , int (*callback)(Catch::Session & session) = nullptr
+        , void (*finished_callback)() = nullptr);
+#endif
+
+
+
+namespace detail
+{
+
+
+/** \brief Search for the first byte which differs between two buffers.
+ *
+ * The function compares 64 bytes at a time using SSE2 when available
+ * and 8 bytes at a time otherwise. Only the block which includes the
+ * first difference gets compared byte by byte.
+ *
+ * \param[in] a  The first buffer.
+ * \param[in] b  The second buffer.
+ * \param[in] size  The number of bytes to compare.
+ *
+ * \return The offset of the first mismatch or \p size if both are equal.
+ */
+inline std::size_t find_first_mismatch(void const * a, void const * b, std::size_t size)
+{
+    unsigned char const * pa(static_cast<unsigned char const *>(a));
+    unsigned char const * pb(static_cast<unsigned char const *>(b));
+    std::size_t idx(0);
+
+#ifdef __SSE2__
+    for(; idx + 64 <= size; idx += 64)
+    {
+        __m128i const m0(_mm_cmpeq_epi8(
+                  _mm_loadu_si128(reinterpret_cast<__m128i const *>(pa + idx))
+                , _mm_loadu_si128(reinterpret_cast<__m128i const *>(pb + idx))));
+        __m128i const m1(_mm_cmpeq_epi8(
+                  _mm_loadu_si128(reinterpret_cast<__m128i const *>(pa + idx + 16))
+                , _mm_loadu_si128(reinterpret_cast<__m128i const *>(pb + idx + 16))));
+        __m128i const m2(_mm_cmpeq_epi8(
+                  _mm_loadu_si128(reinterpret_cast<__m128i const *>(pa + idx + 32))
+                , _mm_loadu_si128(reinterpret_cast<__m128i const *>(pb + idx + 32))));
+        __m128i const m3(_mm_cmpeq_epi8(
+                  _mm_loadu_si128(reinterpret_cast<__m128i const *>(pa + idx + 48))
+                , _mm_loadu_si128(reinterpret_cast<__m128i const *>(pb + idx + 48))));
+        __m128i const all(_mm_and_si128(_mm_and_si128(m0, m1), _mm_and_si128(m2, m3)));
+        if(_mm_movemask_epi8(all) != 0xFFFF)
+        {
+            break;
+        }
+    }
+    for(; idx + 16 <= size; idx += 16)
+    {
+        int const mask(_mm_movemask_epi8(_mm_cmpeq_epi8(
+                  _mm_loadu_si128(reinterpret_cast<__m128i const *>(pa + idx))
+                , _mm_loadu_si128(reinterpret_cast<__m128i const *>(pb + idx)))));
+        if(mask != 0xFFFF)
+        {
+            return idx + static_cast<std::size_t>(__builtin_ctz(~mask & 0xFFFF));
+        }
+    }
+#else
+    for(; idx + 8 <= size; idx += 8)
+    {
+        std::uint64_t wa(0);
+        std::uint64_t wb(0);
+        memcpy(&wa, pa + idx, sizeof(wa));
+        memcpy(&wb, pb + idx, sizeof(wb));
+        if(wa != wb)
+        {
+            break;
+        }
+    }
+#endif
+
+    for(; idx < size; ++idx)
+    {
+        if(pa[idx] != pb[idx])
+        {
+            return idx;
+        }
+    }
+
+    return size;
+}
+
+
+/** \brief The type of one step of an edit script.
+ *
+ * The diff functions return a list of these steps. Applying them in
+ * order to the first sequence transforms it in the second sequence.
+ */
+enum class edit_t : char
+{
+    EDIT_EQUAL,
+    EDIT_DELETE,
+    EDIT_INSERT,
+};
+
+
+/** \brief Compute the shortest edit script between two sequences.
+ *
+ * This function implements the O(ND) algorithm by Eugene W. Myers ("An
+ * O(ND) Difference Algorithm and Its Variations", 1986). \p n and \p m
+ * are the sizes of the two sequences and \p equal is called with one
+ * index in each sequence to know whether the two elements are equal.
+ *
+ * The algorithm keeps the furthest reaching paths of each step so the
+ * memory used is O(D^2). The \p max_d parameter limits the number of
+ * differences we accept to search. When that limit is reached, the
+ * function returns false and the caller is expected to fall back to
+ * a simpler output.
+ *
+ * \param[in] n  The number of elements in the first sequence.
+ * \param[in] m  The number of elements in the second sequence.
+ * \param[in] equal  A function returning true if a[x] == b[y].
+ * \param[in] max_d  The maximum number of differences to search for.
+ * \param[out] script  The resulting edit script.
+ *
+ * \return true if the script was computed.
+ */
+template<typename E>
+bool myers_diff(
+      std::size_t n
+    , std::size_t m
+    , E equal
+    , std::size_t max_d
+    , std::vector<edit_t> & script)
+{
+    typedef std::ptrdiff_t index_t;
+
+    script.clear();
+
+    index_t const en(static_cast<index_t>(n));
+    index_t const em(static_cast<index_t>(m));
+    index_t const limit(static_cast<index_t>(std::min(max_d, n + m)));
+    index_t const offset(limit + 1);
+    std::vector<index_t> v(static_cast<std::size_t>(2 * limit + 3), 0);
+    std::vector<std::vector<index_t>> trace;
+
+    auto at = [offset](std::vector<index_t> & vec, index_t k) -> index_t &
+    {
+        return vec[static_cast<std::size_t>(offset + k)];
+    };
+
+    for(index_t d(0); d <= limit; ++d)
+    {
+        for(index_t k(-d); k <= d; k += 2)
+        {
+            index_t x(k == -d || (k != d && at(v, k - 1) < at(v, k + 1))
+                        ? at(v, k + 1)
+                        : at(v, k - 1) + 1);
+            index_t y(x - k);
+            while(x < en
+               && y < em
+               && equal(static_cast<std::size_t>(x), static_cast<std::size_t>(y)))
+            {
+                ++x;
+                ++y;
+            }
+            at(v, k) = x;
+
+            if(x >= en && y >= em)
+            {
+                // found the end, backtrack to generate the script
+                //
+                x = en;
+                y = em;
+                for(index_t bd(d); bd > 0; --bd)
+                {
+                    std::vector<index_t> const & prev(trace[static_cast<std::size_t>(bd - 1)]);
+                    auto prev_at = [&prev, bd](index_t pk) -> index_t
+                    {
+                        return prev[static_cast<std::size_t>(pk + bd - 1)];
+                    };
+                    index_t const bk(x - y);
+                    bool const down(bk == -bd || (bk != bd && prev_at(bk - 1) < prev_at(bk + 1)));
+                    index_t const prev_k(down ? bk + 1 : bk - 1);
+                    index_t const prev_x(prev_at(prev_k));
+                    index_t const prev_y(prev_x - prev_k);
+                    while(x > prev_x && y > prev_y)
+                    {
+                        script.push_back(edit_t::EDIT_EQUAL);
+                        --x;
+                        --y;
+                    }
+                    script.push_back(down ? edit_t::EDIT_INSERT : edit_t::EDIT_DELETE);
+                    x = prev_x;
+                    y = prev_y;
+                }
+                for(; x > 0; --x)
+                {
+                    script.push_back(edit_t::EDIT_EQUAL);
+                }
+                std::reverse(script.begin(), script.end());
+                return true;
+            }
+        }
+
+        trace.emplace_back(
+                  v.begin() + (offset - d)
+                , v.begin() + (offset + d + 1));
+    }
+
+    return false;
+}
+
+
+/** \brief One line of a string being compared.
+ *
+ * The line does not include the '\\n' character. The hash is used to
+ * speed up the comparisons.
+ */
+struct diff_line
+{
+    char const *    m_start = nullptr;
+    std::size_t     m_size = 0;
+    std::uint64_t   m_hash = 0;
+};
+
+
+inline bool operator == (diff_line const & lhs, diff_line const & rhs)
+{
+    return lhs.m_hash == rhs.m_hash
+        && lhs.m_size == rhs.m_size
+        && memcmp(lhs.m_start, rhs.m_start, lhs.m_size) == 0;
+}
+
+
+/** \brief Break a string in lines.
+ *
+ * \param[in] s  The string to break up.
+ * \param[in] size  The size of the string in bytes.
+ *
+ * \return The list of lines.
+ */
+inline std::vector<diff_line> split_lines(char const * s, std::size_t size)
+{
+    std::vector<diff_line> lines;
+    char const * end(s + size);
+    for(;;)
+    {
+        char const * eol(static_cast<char const *>(memchr(s, '\n', static_cast<std::size_t>(end - s))));
+        diff_line l;
+        l.m_start = s;
+        l.m_size = static_cast<std::size_t>((eol == nullptr ? end : eol) - s);
+        l.m_hash = 14695981039346656037ULL;     // FNV-1a
+        for(std::size_t idx(0); idx < l.m_size; ++idx)
+        {
+            l.m_hash = (l.m_hash ^ static_cast<unsigned char>(s[idx])) * 1099511628211ULL;
+        }
+        lines.push_back(l);
+        if(eol == nullptr)
+        {
+            break;
+        }
+        s = eol + 1;
+    }
+    return lines;
+}
+
+
+/** \brief One UTF-8 character.
+ *
+ * The character diff works on characters, not bytes, so a multi-byte
+ * character never gets cut in half. A byte which is not valid UTF-8
+ * is kept as is with a code point of -1.
+ */
+struct diff_char
+{
+    char const *    m_start = nullptr;
+    std::size_t     m_size = 0;
+    std::int32_t    m_code = 0;
+};
+
+
+inline std::vector<diff_char> split_utf8(char const * s, std::size_t size)
+{
+    std::vector<diff_char> chars;
+    chars.reserve(size);
+    std::size_t idx(0);
+    while(idx < size)
+    {
+        unsigned char const c(static_cast<unsigned char>(s[idx]));
+        diff_char ch;
+        ch.m_start = s + idx;
+        ch.m_size = 1;
+        ch.m_code = c;
+        std::size_t len(0);
+        std::int32_t code(0);
+        if(c >= 0xC2 && c <= 0xDF)
+        {
+            len = 2;
+            code = c & 0x1F;
+        }
+        else if(c >= 0xE0 && c <= 0xEF)
+        {
+            len = 3;
+            code = c & 0x0F;
+        }
+        else if(c >= 0xF0 && c <= 0xF4)
+        {
+            len = 4;
+            code = c & 0x07;
+        }
+        else if(c >= 0x80)
+        {
+            ch.m_code = -1;
+        }
+        if(len > 0)
+        {
+            std::size_t j(1);
+            for(; j < len && idx + j < size; ++j)
+            {
+                unsigned char const n(static_cast<unsigned char>(s[idx + j]));
+                if((n & 0xC0) != 0x80)
+                {
+                    break;
+                }
+                code = (code << 6) | (n & 0x3F);
+            }
+            if(j == len)
+            {
+                ch.m_size = len;
+                ch.m_code = code;
+            }
+            else
+            {
+                ch.m_code = -1;
+            }
+        }
+        chars.push_back(ch);
+        idx += ch.m_size;
+    }
+    return chars;
+}
+
+
+/** \brief Append one character in a visible form.
+ *
+ * Control characters are shown as ^\<letter>, graphical controls as
+ * @\<letter> and invalid UTF-8 bytes as \\x\<hex>. Spaces are only made
+ * visible when part of a difference (\p highlight is true).
+ *
+ * \param[in,out] out  The output buffer.
+ * \param[in] c  The character to append.
+ * \param[in] highlight  Whether the character is part of a difference.
+ */
+inline void append_char(std::string & out, diff_char const & c, bool highlight)
+{
+    if(c.m_code == 0x20 && highlight)
+    {
+        // Possible characters to make spaces visible are:
+        //      U+23B5      BOTTOM SQUARE BRACKET
+        //      U+2420      SYMBOL FOR SPACE
+        //      U+2423      OPEN BOX
+        //
+        out += "\xE2\x90\xA3";
+    }
+    else if(c.m_code < 0)
+    {
+        static char const hex[] = "0123456789ABCDEF";
+        unsigned char const b(static_cast<unsigned char>(*c.m_start));
+        out += "\\x";
+        out += hex[b >> 4];
+        out += hex[b & 15];
+    }
+    else if(c.m_code < 0x20 || c.m_code == 0x7F)
+    {
+        // control character
+        //
+        out += '^';
+        out += static_cast<char>(c.m_code ^ 0x40);
+    }
+    else if(c.m_code >= 0x80 && c.m_code <= 0x9F)
+    {
+        // graphical control
+        //
+        out += '@';
+        out += static_cast<char>(c.m_code - 0x40);
+    }
+    else
+    {
+        // standard character
+        //
+        out.append(c.m_start, c.m_size);
+    }
+}
+
+
+/** \brief Append a line with its differences highlighted.
+ *
+ * The \p script is the character edit script of the line pair. Only the
+ * characters of \p side (EDIT_DELETE for the left hand side, EDIT_INSERT
+ * for the right hand side) and the equal ones get printed. Long runs of
+ * equal characters get shortened so a single difference in a very long
+ * line does not print the entire line. Since the runs are computed on
+ * the script, both lines of a pair get shortened the same way.
+ *
+ * \param[in,out] out  The output buffer.
+ * \param[in] chars  The characters of the line.
+ * \param[in] script  The character edit script.
+ * \param[in] side  The edit type which represents this line.
+ */
+inline void append_highlighted_line(
+      std::string & out
+    , std::vector<diff_char> const & chars
+    , std::vector<edit_t> const & script
+    , edit_t side)
+{
+    std::size_t constexpr char_context(40);
+
+    bool highlight(false);
+    std::size_t idx(0);
+    std::size_t pos(0);
+    while(pos < script.size())
+    {
+        if(script[pos] == edit_t::EDIT_EQUAL)
+        {
+            std::size_t end(pos);
+            while(end < script.size() && script[end] == edit_t::EDIT_EQUAL)
+            {
+                ++end;
+            }
+            if(highlight)
+            {
+                out += "\033[0m";
+                highlight = false;
+            }
+            std::size_t count(end - pos);
+            std::size_t const keep_before(pos == 0 ? 0 : char_context);
+            std::size_t const keep_after(end == script.size() ? 0 : char_context);
+            if(count > keep_before + keep_after + 1)
+            {
+                for(std::size_t j(0); j < keep_before; ++j, ++idx)
+                {
+                    append_char(out, chars[idx], false);
+                }
+                out += "\xE2\x80\xA6";      // U+2026 HORIZONTAL ELLIPSIS
+                idx += count - keep_before - keep_after;
+                count = keep_after;
+            }
+            for(; count > 0; --count, ++idx)
+            {
+                append_char(out, chars[idx], false);
+            }
+            pos = end;
+        }
+        else
+        {
+            if(script[pos] == side)
+            {
+                if(!highlight)
+                {
+                    out += "\033[7m";
+                    highlight = true;
+                }
+                append_char(out, chars[idx], true);
+                ++idx;
+            }
+            ++pos;
+        }
+    }
+    if(highlight)
+    {
+        out += "\033[0m";
+    }
+}
+
+
+/** \brief Append a line which has no counterpart on the other side.
+ *
+ * \param[in,out] out  The output buffer.
+ * \param[in] line  The line to append.
+ */
+inline void append_plain_line(std::string & out, diff_line const & line)
+{
+    std::vector<diff_char> const chars(split_utf8(line.m_start, line.m_size));
+    for(auto const & c : chars)
+    {
+        append_char(out, c, false);
+    }
+}
+
+
+/** \brief Append a pair of lines with the differing characters highlighted.
+ *
+ * \param[in,out] out  The output buffer.
+ * \param[in] a  The line from the left hand side.
+ * \param[in] b  The line from the right hand side.
+ */
+inline void append_line_pair(std::string & out, diff_line const & a, diff_line const & b)
+{
+    std::vector<diff_char> const ca(split_utf8(a.m_start, a.m_size));
+    std::vector<diff_char> const cb(split_utf8(b.m_start, b.m_size));
+
+    // remove the common prefix and suffix before running the O(ND)
+    // algorithm on what is left
+    //
+    auto same = [&ca, &cb](std::size_t x, std::size_t y)
+    {
+        return ca[x].m_size == cb[y].m_size
+            && memcmp(ca[x].m_start, cb[y].m_start, ca[x].m_size) == 0;
+    };
+    std::size_t prefix(0);
+    while(prefix < ca.size() && prefix < cb.size() && same(prefix, prefix))
+    {
+        ++prefix;
+    }
+    std::size_t suffix(0);
+    while(suffix < ca.size() - prefix
+       && suffix < cb.size() - prefix
+       && same(ca.size() - suffix - 1, cb.size() - suffix - 1))
+    {
+        ++suffix;
+    }
+
+    std::size_t const na(ca.size() - prefix - suffix);
+    std::size_t const nb(cb.size() - prefix - suffix);
+    std::vector<edit_t> middle;
+    if(!myers_diff(
+              na
+            , nb
+            , [&same, prefix](std::size_t x, std::size_t y) { return same(prefix + x, prefix + y); }
+            , 1000
+            , middle))
+    {
+        middle.assign(na, edit_t::EDIT_DELETE);
+        middle.insert(middle.end(), nb, edit_t::EDIT_INSERT);
+    }
+
+    std::vector<edit_t> script(prefix, edit_t::EDIT_EQUAL);
+    script.insert(script.end(), middle.begin(), middle.end());
+    script.insert(script.end(), suffix, edit_t::EDIT_EQUAL);
+
+    out += "-";
+    append_highlighted_line(out, ca, script, edit_t::EDIT_DELETE);
+    out += "\n+";
+    append_highlighted_line(out, cb, script, edit_t::EDIT_INSERT);
+    out += "\n";
+}
+
+
+/** \brief Print the differences between two long strings.
+ *
+ * The strings are first compared line by line using the Myers algorithm.
+ * Lines which were replaced are then compared character by character
+ * (UTF-8 characters, not bytes) so the exact differences can be
+ * highlighted.
+ *
+ * The output looks like a unified diff. Each hunk includes up to
+ * \p context lines before and after the differences. Each hunk is
+ * written to \p out with a single write() call.
+ *
+ * \param[in] a  The left hand side string.
+ * \param[in] a_size  The size of the left hand side string.
+ * \param[in] b  The right hand side string.
+ * \param[in] b_size  The size of the right hand side string.
+ * \param[in] context  The number of lines of context.
+ * \param[in] out  The stream where the diff gets printed.
+ */
+inline void print_diff(
+      char const * a
+    , std::size_t a_size
+    , char const * b
+    , std::size_t b_size
+    , std::size_t context
+    , std::ostream & out)
+{
+    std::vector<diff_line> const la(split_lines(a, a_size));
+    std::vector<diff_line> const lb(split_lines(b, b_size));
+
+    // the first difference is found with a vectorized scan and it tells
+    // us how many lines are equal at the start
+    //
+    std::size_t const mismatch(find_first_mismatch(a, b, std::min(a_size, b_size)));
+    std::size_t prefix(0);
+    while(prefix + 1 < la.size()
+       && prefix + 1 < lb.size()
+       && static_cast<std::size_t>(la[prefix + 1].m_start - a) <= mismatch)
+    {
+        ++prefix;
+    }
+    std::size_t suffix(0);
+    while(suffix < la.size() - prefix
+       && suffix < lb.size() - prefix
+       && la[la.size() - suffix - 1] == lb[lb.size() - suffix - 1])
+    {
+        ++suffix;
+    }
+
+    std::size_t const na(la.size() - prefix - suffix);
+    std::size_t const nb(lb.size() - prefix - suffix);
+    std::vector<edit_t> middle;
+    if(!myers_diff(
+              na
+            , nb
+            , [&la, &lb, prefix](std::size_t x, std::size_t y) { return la[prefix + x] == lb[prefix + y]; }
+            , 2000
+            , middle))
+    {
+        middle.assign(na, edit_t::EDIT_DELETE);
+        middle.insert(middle.end(), nb, edit_t::EDIT_INSERT);
+    }
+    std::vector<edit_t> script(prefix, edit_t::EDIT_EQUAL);
+    script.insert(script.end(), middle.begin(), middle.end());
+    script.insert(script.end(), suffix, edit_t::EDIT_EQUAL);
+
+    // go through the script and generate one hunk per group of changes
+    // which are less than 2 * context lines apart
+    //
+    std::size_t pos(0);
+    std::size_t ia(0);
+    std::size_t ib(0);
+    while(pos < script.size())
+    {
+        if(script[pos] == edit_t::EDIT_EQUAL)
+        {
+            ++pos;
+            ++ia;
+            ++ib;
+            continue;
+        }
+
+        std::size_t const before(std::min(context, std::min(ia, ib)));
+        std::size_t start_pos(pos - before);
+        std::size_t xa(ia - before);
+        std::size_t xb(ib - before);
+        std::size_t const hunk_a(xa);
+        std::size_t const hunk_b(xb);
+
+        // find the end of the hunk
+        //
+        std::size_t end_pos(pos);
+        std::size_t equal_run(0);
+        for(std::size_t p(pos); p < script.size(); ++p)
+        {
+            if(script[p] == edit_t::EDIT_EQUAL)
+            {
+                ++equal_run;
+                if(equal_run > context * 2)
+                {
+                    break;
+                }
+            }
+            else
+            {
+                equal_run = 0;
+                end_pos = p + 1;
+            }
+        }
+        end_pos = std::min(script.size(), end_pos + context);
+
+        std::string hunk;
+        std::size_t count_a(0);
+        std::size_t count_b(0);
+        for(std::size_t p(start_pos); p < end_pos; ++p)
+        {
+            if(script[p] != edit_t::EDIT_INSERT)
+            {
+                ++count_a;
+            }
+            if(script[p] != edit_t::EDIT_DELETE)
+            {
+                ++count_b;
+            }
+        }
+        hunk += "@@ -"
+              + std::to_string(hunk_a + 1)
+              + ","
+              + std::to_string(count_a)
+              + " +"
+              + std::to_string(hunk_b + 1)
+              + ","
+              + std::to_string(count_b)
+              + " @@\n";
+
+        while(start_pos < end_pos)
+        {
+            if(script[start_pos] == edit_t::EDIT_EQUAL)
+            {
+                hunk += ' ';
+                append_plain_line(hunk, la[xa]);
+                hunk += '\n';
+                ++start_pos;
+                ++xa;
+                ++xb;
+                continue;
+            }
+
+            // a block of changes; pair the deleted & inserted lines
+            //
+            std::size_t deleted(0);
+            std::size_t inserted(0);
+            while(start_pos < end_pos && script[start_pos] != edit_t::EDIT_EQUAL)
+            {
+                if(script[start_pos] == edit_t::EDIT_DELETE)
+                {
+                    ++deleted;
+                }
+                else
+                {
+                    ++inserted;
+                }
+                ++start_pos;
+            }
+            std::size_t const pairs(std::min(deleted, inserted));
+            for(std::size_t idx(0); idx < pairs; ++idx)
+            {
+                append_line_pair(hunk, la[xa + idx], lb[xb + idx]);
+            }
+            for(std::size_t idx(pairs); idx < deleted; ++idx)
+            {
+                hunk += '-';
+                append_plain_line(hunk, la[xa + idx]);
+                hunk += '\n';
+            }
+            for(std::size_t idx(pairs); idx < inserted; ++idx)
+            {
+                hunk += '+';
+                append_plain_line(hunk, lb[xb + idx]);
+                hunk += '\n';
+            }
+            xa += deleted;
+            xb += inserted;
+        }
+
+        out.write(hunk.data(), static_cast<std::streamsize>(hunk.length()));
+        out.flush();
+
+        pos = end_pos;
+        ia = xa;
+        ib = xb;
+    }
+}
+
+
+} // detail namespace
+
+
+
+/** \brief Compare two long strings and print the differences.
+ *
+ * When the two strings are not equal, this function prints a diff of
+ * the two strings (see the `--diff-context` command line option and
+ * g_diff_context() for the number of lines shown around the changes)
+ * and then fails with a CATCH_REQUIRE().
+ *
+ * \param[in] a  The left hand side string.
+ * \param[in] b  The right hand side string.
+ */
+inline void catch_compare_long_strings(std::string const & a, std::string const & b)
+{
+    if(a == b)
+    {
+        return;
+    }
+
+    std::cout << "error: long strings do not match.\n"
+              << "---------------------------------------------------\n";
+
+    detail::print_diff(a.c_str(), a.length(), b.c_str(), b.length(), g_diff_context(), std::cout);
+
+    std::cout << "---------------------------------------------------" << std::endl;
+
+    if(a.length() > b.length())
+    {
+        std::cout << "Left hand side string is longer ("
+                  << a.length()
+                  << " versus "
+                  << b.length()
+                  << ")."
+                  << std::endl;
+    }
+    else if(b.length() > a.length())
+    {
+        std::cout << "Right hand side string is longer ("
+                  << a.length()
+                  << " versus "
+                  << b.length()
+                  << ")."
+                  << std::endl;
+    }
+
+    // to generate the standard error too (we do not use a == b because
+    // catch2 would print both strings in full)
+    //
+    CATCH_FAIL("long strings do not match; the first difference is at offset "
+            << detail::find_first_mismatch(a.c_str(), b.c_str(), std::min(a.length(), b.length()))
+            << ".");
+}
+
+
+namespace detail
+{
+
+
+/** \brief Map a file in memory, read-only.
+ *
+ * This class is used to compare data against a golden file without
+ * reading it in a buffer. An empty file is not mapped; data() then
+ * returns nullptr.
+ */
+class mapped_file
+{
+public:
+    mapped_file(std::string const & filename)
+    {
+        int const fd(open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+        if(fd < 0)
+        {
+            return;
+        }
+        struct stat st = {};
+        if(fstat(fd, &st) == 0)
+        {
+            m_exists = true;
+            m_size = static_cast<std::size_t>(st.st_size);
+            if(m_size > 0)
+            {
+                void * ptr(mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0));
+                if(ptr == MAP_FAILED)
+                {
+                    m_exists = false;
+                    m_size = 0;
+                }
+                else
+                {
+                    m_data = ptr;
+                }
+            }
+        }
+        close(fd);
+    }
+
+    mapped_file(mapped_file const &) = delete;
+    mapped_file & operator = (mapped_file const &) = delete;
+
+    ~mapped_file()
+    {
+        if(m_data != nullptr)
+        {
+            munmap(m_data, m_size);
+        }
+    }
+
+    bool exists() const
+    {
+        return m_exists;
+    }
+
+    char const * data() const
+    {
+        return static_cast<char const *>(m_data);
+    }
+
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    void *          m_data = nullptr;
+    std::size_t     m_size = 0;
+    bool            m_exists = false;
+};
+
+
+/** \brief Atomically replace a golden file.
+ *
+ * The data is written to a temporary file in the same directory which
+ * then gets renamed so a reader never sees a partial golden file.
+ *
+ * \param[in] filename  The name of the golden file.
+ * \param[in] data  The new content.
+ * \param[in] size  The size of \p data in bytes.
+ *
+ * \return true if the file was saved.
+ */
+inline bool save_golden_file(std::string const & filename, char const * data, std::size_t size)
+{
+    std::string::size_type const pos(filename.rfind('/'));
+    if(pos != std::string::npos
+    && pos != 0
+    && !make_directories(filename.substr(0, pos)))
+    {
+        return false;
+    }
+
+    std::string const tmp(filename + ".tmp-" + std::to_string(getpid()));
+    int const fd(open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666));
+    if(fd < 0)
+    {
+        return false;
+    }
+    while(size > 0)
+    {
+        ssize_t const r(write(fd, data, size));
+        if(r < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            close(fd);
+            unlink(tmp.c_str());
+            return false;
+        }
+        data += r;
+        size -= static_cast<std::size_t>(r);
+    }
+    if(close(fd) != 0
+    || rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+/** \brief Compare data against a golden file.
+ *
+ * This function is used by the CATCH_REQUIRE_MATCHES_GOLDEN() macro.
+ * The golden file is mapped in memory and compared with the data as is.
+ * On a mismatch, the differences are printed like with
+ * CATCH_REQUIRE_LONG_STRING().
+ *
+ * With `--update-golden`, a golden file which is missing or does not
+ * match gets replaced by \p data and the assertion passes.
+ *
+ * \param[in] handler  The catch2 assertion handler.
+ * \param[in] name  The name of the golden file, relative to g_golden_dir().
+ * \param[in] data  The data to compare.
+ * \param[in] size  The size of \p data in bytes.
+ */
+inline void compare_golden(
+      Catch::AssertionHandler & handler
+    , std::string const & name
+    , char const * data
+    , std::size_t size)
+{
+    std::string const filename(g_golden_dir().empty() || (!name.empty() && name[0] == '/')
+                ? name
+                : g_golden_dir() + '/' + name);
+    bool matches(false);
+    std::size_t mismatch(0);
+    std::size_t golden_size(0);
+    {
+        mapped_file const golden(filename);
+        golden_size = golden.size();
+        if(golden.exists())
+        {
+            mismatch = find_first_mismatch(golden.data(), data, std::min(golden_size, size));
+            matches = golden_size == size && mismatch == size;
+            if(!matches
+            && !g_update_golden())
+            {
+                std::cout << "error: data does not match golden file \""
+                          << filename
+                          << "\".\n"
+                          << "---------------------------------------------------\n";
+                print_diff(golden.data(), golden_size, data, size, g_diff_context(), std::cout);
+                std::cout << "---------------------------------------------------" << std::endl;
+            }
+        }
+    }
+
+    if(matches)
+    {
+        handler.handleMessage(Catch::ResultWas::Ok, "data matches golden file \"" + filename + "\".");
+        return;
+    }
+
+    if(g_update_golden())
+    {
+        if(!save_golden_file(filename, data, size))
+        {
+            handler.handleMessage(
+                      Catch::ResultWas::ExplicitFailure
+                    , "could not update golden file \"" + filename + "\".");
+            return;
+        }
+        handler.handleMessage(Catch::ResultWas::Ok, "updated golden file \"" + filename + "\".");
+        return;
+    }
+
+    std::stringstream ss;
+    if(mismatch == 0
+    && golden_size == 0
+    && access(filename.c_str(), F_OK) != 0)
+    {
+        ss << "golden file \""
+           << filename
+           << "\" not found";
+    }
+    else
+    {
+        ss << "data does not match golden file \""
+           << filename
+           << "\" ("
+           << size
+           << " bytes versus "
+           << golden_size
+           << " bytes in the golden file); the first difference is at offset "
+           << mismatch;
+    }
+    ss << "; use --update-golden to save the new data.";
+    handler.handleMessage(Catch::ResultWas::ExplicitFailure, ss.str());
+}
+
+
+/** \brief Compare a contiguous container against a golden file.
+ *
+ * \p data can be any container with a data() and a size() function,
+ * such as an std::string or an std::vector<std::uint8_t>.
+ *
+ * \param[in] handler  The catch2 assertion handler.
+ * \param[in] name  The name of the golden file.
+ * \param[in] data  The data to compare.
+ */
+template<typename T>
+void compare_golden(
+      Catch::AssertionHandler & handler
+    , std::string const & name
+    , T const & data)
+{
+    compare_golden(
+              handler
+            , name
+            , reinterpret_cast<char const *>(data.data())
+            , data.size() * sizeof(*data.data()));
+}
+
+
+/** \brief Compare a C string against a golden file.
+ *
+ * \param[in] handler  The catch2 assertion handler.
+ * \param[in] name  The name of the golden file.
+ * \param[in] data  The null terminated string to compare.
+ */
+inline void compare_golden(
+      Catch::AssertionHandler & handler
+    , std::string const & name
+    , char const * data)
+{
+    compare_golden(handler, name, data, strlen(data));
+}
+
+
+} // detail namespace
+
+
+
+/** \brief A view of a contiguous buffer of bytes.
+ *
+ * This is what CATCH_REQUIRE_LONG_BUFFER() compares. It gets created
+ * from any container with a data() and a size() function, such as an
+ * std::vector<std::uint8_t>, an std::string or a span, or from a pointer
+ * and a size, for example to compare a memory mapped file.
+ */
+class buffer_view
+{
+public:
+    buffer_view(void const * data, std::size_t size)
+        : m_data(static_cast<std::uint8_t const *>(data))
+        , m_size(size)
+    {
+    }
+
+    template<typename T
+           , typename = decltype(std::declval<T const &>().data())
+           , typename = decltype(std::declval<T const &>().size())>
+    buffer_view(T const & container)
+        : m_data(reinterpret_cast<std::uint8_t const *>(container.data()))
+        , m_size(container.size() * sizeof(*container.data()))
+    {
+    }
+
+    std::uint8_t const * data() const
+    {
+        return m_data;
+    }
+
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    std::uint8_t const *    m_data = nullptr;
+    std::size_t             m_size = 0;
+};
+
+
+namespace detail
+{
+
+
+/** \brief The number of bytes compared at once by CATCH_REQUIRE_LONG_BUFFER(). */
+constexpr std::size_t BUFFER_CHUNK_SIZE = 1024 * 1024;
+
+/** \brief The number of bytes shown per line of the hexdump. */
+constexpr std::size_t BUFFER_ROW_SIZE = 16;
+
+/** \brief The maximum number of lines with differences in the hexdump.
+ *
+ * The comparison goes on after that to count the differences, but the
+ * other lines are not printed.
+ */
+constexpr std::size_t BUFFER_MAX_DIFF_ROWS = 64;
+
+
+/** \brief Read the bytes of a buffer in chunks.
+ *
+ * A buffer in memory is used as is. A stream is read in chunks of
+ * BUFFER_CHUNK_SIZE bytes and the reader keeps a few bytes from the
+ * previous chunk so the lines of context shown before a difference
+ * are still available. The memory used does not depend on the size
+ * of the stream.
+ */
+class buffer_reader
+{
+public:
+    buffer_reader(buffer_view const & view)
+        : m_data(view.data())
+        , m_size(view.size())
+        , m_eof(true)
+    {
+    }
+
+    buffer_reader(std::istream & in)
+        : m_stream(&in)
+    {
+    }
+
+    buffer_reader(buffer_reader const &) = delete;
+    buffer_reader & operator = (buffer_reader const &) = delete;
+
+    /** \brief Make the bytes from \p offset to \p offset + \p size available.
+     *
+     * The \p keep bytes before \p offset remain available too.
+     *
+     * The buffer only gets refilled once the line at \p offset is not
+     * fully loaded anymore, so moving \p offset forward a few bytes at a
+     * time does not move the whole chunk each time. Until then, fewer
+     * than \p size bytes may be available after \p offset.
+     */
+    void advance(std::uint64_t offset, std::size_t size, std::size_t keep)
+    {
+        if(m_eof
+        || offset + BUFFER_ROW_SIZE <= end())
+        {
+            return;
+        }
+
+        std::uint64_t const begin(std::min(
+                  std::max(m_begin, offset > keep ? offset - keep : 0)
+                , end()));
+        std::size_t const kept(static_cast<std::size_t>(end() - begin));
+        if(m_buffer.size() < keep + size)
+        {
+            m_buffer.resize(keep + size);
+        }
+        memmove(m_buffer.data(), m_buffer.data() + (begin - m_begin), kept);
+        m_data = m_buffer.data();
+        m_begin = begin;
+        m_size = kept;
+
+        std::size_t const wanted(static_cast<std::size_t>(offset + size - begin));
+        while(m_size < wanted
+           && !m_eof)
+        {
+            m_stream->read(
+                      reinterpret_cast<char *>(m_buffer.data() + m_size)
+                    , static_cast<std::streamsize>(wanted - m_size));
+            m_size += static_cast<std::size_t>(m_stream->gcount());
+            if(!*m_stream)
+            {
+                m_eof = true;
+            }
+        }
+    }
+
+    /** \brief Get a pointer to the byte at \p offset, which must be available. */
+    std::uint8_t const * at(std::uint64_t offset) const
+    {
+        return m_data + (offset - m_begin);
+    }
+
+    /** \brief The offset after the last available byte. */
+    std::uint64_t end() const
+    {
+        return m_begin + m_size;
+    }
+
+    /** \brief Read the rest of a stream to get its total size. */
+    std::uint64_t total_size()
+    {
+        while(!m_eof)
+        {
+            advance(end(), BUFFER_CHUNK_SIZE, 0);
+        }
+        return end();
+    }
+
+private:
+    std::istream *              m_stream = nullptr;
+    std::vector<std::uint8_t>   m_buffer = std::vector<std::uint8_t>();
+    std::uint8_t const *        m_data = nullptr;
+    std::uint64_t               m_begin = 0;
+    std::size_t                 m_size = 0;
+    bool                        m_eof = false;
+};
+
+
+/** \brief Print one line of the side by side hexdump.
+ *
+ * The line shows the bytes of both buffers at \p offset in hexadecimal
+ * and as ASCII characters. When some bytes differ, the line starts with
+ * a '!' and is followed by a line with "^^" under those bytes. A byte
+ * missing in one of the buffers counts as a difference.
+ *
+ * \param[in] out  The output stream.
+ * \param[in] a  The left hand side buffer.
+ * \param[in] b  The right hand side buffer.
+ * \param[in] offset  The offset of the line, a multiple of BUFFER_ROW_SIZE.
+ * \param[in,out] differences  Incremented by the number of bytes which
+ * differ in both buffers.
+ *
+ * \return true if the line includes differences.
+ */
+inline bool print_buffer_row(
+      std::ostream & out
+    , buffer_reader const & a
+    , buffer_reader const & b
+    , std::uint64_t offset
+    , std::uint64_t & differences)
+{
+    std::size_t const size_a(a.end() > offset ? static_cast<std::size_t>(std::min<std::uint64_t>(a.end() - offset, BUFFER_ROW_SIZE)) : 0);
+    std::size_t const size_b(b.end() > offset ? static_cast<std::size_t>(std::min<std::uint64_t>(b.end() - offset, BUFFER_ROW_SIZE)) : 0);
+
+    std::array<bool, BUFFER_ROW_SIZE> differs = {};
+    bool found(false);
+    for(std::size_t idx(0); idx < BUFFER_ROW_SIZE; ++idx)
+    {
+        if(idx < size_a && idx < size_b)
+        {
+            differs[idx] = *a.at(offset + idx) != *b.at(offset + idx);
+            if(differs[idx])
+            {
+                ++differences;
+            }
+        }
+        else
+        {
+            differs[idx] = idx < size_a || idx < size_b;
+        }
+        found = found || differs[idx];
+    }
+
+    char hex[16];
+    snprintf(hex, sizeof(hex), "%08llx", static_cast<unsigned long long>(offset));
+    std::string line(found ? "!" : " ");
+    line += hex;
+    std::string marks(line.length(), ' ');
+
+    auto const side = [&](buffer_reader const & r, std::size_t size)
+    {
+        line += "  ";
+        marks += "  ";
+        for(std::size_t idx(0); idx < BUFFER_ROW_SIZE; ++idx)
+        {
+            if(idx < size)
+            {
+                snprintf(hex, sizeof(hex), "%02x ", *r.at(offset + idx));
+                line += hex;
+            }
+            else
+            {
+                line += "   ";
+            }
+            marks += differs[idx] ? "^^ " : "   ";
+        }
+        line += '|';
+        marks += ' ';
+        for(std::size_t idx(0); idx < BUFFER_ROW_SIZE; ++idx)
+        {
+            std::uint8_t const c(idx < size ? *r.at(offset + idx) : ' ');
+            line += c >= ' ' && c < 0x7F ? static_cast<char>(c) : '.';
+            marks += ' ';
+        }
+        line += '|';
+        marks += ' ';
+    };
+    side(a, size_a);
+    side(b, size_b);
+
+    out << line << '\n';
+    if(found)
+    {
+        while(!marks.empty() && marks.back() == ' ')
+        {
+            marks.pop_back();
+        }
+        out << marks << '\n';
+    }
+
+    return found;
+}
+
+
+/** \brief Compare two buffers and print a hexdump of their differences.
+ *
+ * This function is used by the CATCH_REQUIRE_LONG_BUFFER() macro. The
+ * buffers are compared one chunk at a time with find_first_mismatch(),
+ * which uses SSE2 when available. The lines with differences are printed
+ * side by side with g_diff_context() lines of context around them.
+ *
+ * \param[in] handler  The catch2 assertion handler.
+ * \param[in] a  The left hand side buffer.
+ * \param[in] b  The right hand side buffer.
+ */
+inline void compare_long_buffers(
+      Catch::AssertionHandler & handler
+    , buffer_reader & a
+    , buffer_reader & b)
+{
+    std::uint64_t const context(g_diff_context() * BUFFER_ROW_SIZE);
+    std::size_t const keep(static_cast<std::size_t>(context + BUFFER_ROW_SIZE));
+    std::uint64_t const no_mismatch(std::numeric_limits<std::uint64_t>::max());
+    std::uint64_t first(no_mismatch);
+    std::uint64_t differences(0);
+    std::uint64_t next_row(0);          // first line not printed yet
+    std::uint64_t context_end(0);       // end of the context after the last difference
+    std::size_t rows(0);                // number of lines with differences printed
+    bool longer(false);
+    std::uint64_t pos(0);
+    for(;;)
+    {
+        a.advance(pos, BUFFER_CHUNK_SIZE, keep);
+        b.advance(pos, BUFFER_CHUNK_SIZE, keep);
+
+        // lines of context after a difference
+        //
+        if(pos < context_end
+        && (pos < a.end() || pos < b.end()))
+        {
+            if(print_buffer_row(std::cout, a, b, pos, differences))
+            {
+                ++rows;
+                context_end = pos + BUFFER_ROW_SIZE + context;
+            }
+            pos += BUFFER_ROW_SIZE;
+            next_row = pos;
+            if(rows >= BUFFER_MAX_DIFF_ROWS)
+            {
+                context_end = 0;
+            }
+            continue;
+        }
+
+        std::uint64_t mismatch(0);
+        std::uint64_t const limit(std::min({ pos + BUFFER_CHUNK_SIZE, a.end(), b.end() }));
+        if(pos < limit)
+        {
+            std::size_t const size(static_cast<std::size_t>(limit - pos));
+            std::size_t const offset(find_first_mismatch(a.at(pos), b.at(pos), size));
+            if(offset == size)
+            {
+                pos = limit;
+                continue;
+            }
+            mismatch = pos + offset;
+        }
+        else if(pos >= a.end()
+             && pos >= b.end())
+        {
+            break;
+        }
+        else
+        {
+            // one buffer is longer than the other
+            //
+            mismatch = pos;
+            longer = true;
+        }
+
+        if(first == no_mismatch)
+        {
+            first = mismatch;
+            std::cout << "error: long buffers do not match.\n"
+                      << "---------------------------------------------------\n";
+        }
+
+        if(rows >= BUFFER_MAX_DIFF_ROWS)
+        {
+            // only count the remaining differences of the chunk already
+            // loaded
+            //
+            if(longer)
+            {
+                break;
+            }
+            ++differences;
+            for(pos = mismatch + 1; pos < limit; )
+            {
+                std::size_t const size(static_cast<std::size_t>(limit - pos));
+                std::size_t const offset(find_first_mismatch(a.at(pos), b.at(pos), size));
+                if(offset == size)
+                {
+                    break;
+                }
+                ++differences;
+                pos += offset + 1;
+            }
+            pos = limit;
+            continue;
+        }
+
+        std::uint64_t const row(mismatch - mismatch % BUFFER_ROW_SIZE);
+        std::uint64_t start(std::max(row >= context ? row - context : 0, next_row));
+        if(start > next_row
+        && rows > 0)
+        {
+            std::cout << "...\n";
+        }
+        for(; start < row; start += BUFFER_ROW_SIZE)
+        {
+            print_buffer_row(std::cout, a, b, start, differences);
+        }
+        print_buffer_row(std::cout, a, b, row, differences);
+        ++rows;
+        pos = row + BUFFER_ROW_SIZE;
+        next_row = pos;
+        context_end = pos + context;
+        if(longer)
+        {
+            break;
+        }
+    }
+
+    if(first == no_mismatch)
+    {
+        std::stringstream ss;
+        ss << "buffers of " << a.end() << " bytes are equal.";
+        handler.handleMessage(Catch::ResultWas::Ok, ss.str());
+        return;
+    }
+
+    std::cout << "---------------------------------------------------" << std::endl;
+    if(rows >= BUFFER_MAX_DIFF_ROWS)
+    {
+        std::cout << "Only the first "
+                  << BUFFER_MAX_DIFF_ROWS
+                  << " lines with differences are shown."
+                  << std::endl;
+    }
+
+    std::uint64_t const size_a(a.total_size());
+    std::uint64_t const size_b(b.total_size());
+    std::stringstream ss;
+    ss << "long buffers do not match ("
+       << size_a
+       << " bytes versus "
+       << size_b
+       << " bytes); the first difference is at offset "
+       << first
+       << " and "
+       << differences
+       << " of the "
+       << std::min(size_a, size_b)
+       << " common bytes differ.";
+    handler.handleMessage(Catch::ResultWas::ExplicitFailure, ss.str());
+}
+
+
+/** \brief Compare two buffers.
+ *
+ * Each buffer is an std::istream, read in chunks, or anything which
+ * converts to a buffer_view.
+ *
+ * \param[in] handler  The catch2 assertion handler.
+ * \param[in] a  The left hand side buffer.
+ * \param[in] b  The right hand side buffer.
+ */
+template<typename A, typename B>
+void compare_long_buffers(
+      Catch::AssertionHandler & handler
+    , A && a
+    , B && b)
+{
+    buffer_reader ra(a);
+    buffer_reader rb(b);
+    compare_long_buffers(handler, ra, rb);
+}
+
+
+} // detail namespace
+
+
+
+template<typename F>
+F default_epsilon()
+{
+    return static_cast<F>(0.00001);
+}
+
+
+template<typename F>
+bool nearly_equal(
+      F const lhs
+    , F const rhs
+    , F epsilon = default_epsilon<F>())
+{
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+    // already equal?
+    if(lhs == rhs)
+    {
+        return true;
+    }
+
+    F const diff(std::abs(lhs - rhs));
+    if(lhs == 0.0
+    || rhs == 0.0
+    || diff < std::numeric_limits<F>::min())
+    {
+        return diff < (epsilon * std::numeric_limits<F>::min());
+    }
+#pragma GCC diagnostic pop
+
+    return diff / (std::abs(lhs) + std::abs(rhs)) < epsilon;
+}
+
+
+/** \brief How floating point values get compared.
+ *
+ * The FLOAT_COMPARE_RELATIVE mode uses the same formula as
+ * nearly_equal(). The FLOAT_COMPARE_ULP mode counts the number of
+ * representable values between the two numbers (units in the last
+ * place).
+ */
+enum class float_compare_t
+{
+    FLOAT_COMPARE_RELATIVE,
+    FLOAT_COMPARE_ULP,
+};
+
+
+/** \brief The tolerance used by CATCH_REQUIRE_FLOATING_POINT_RANGE().
+ *
+ * Use the relative_tolerance() or ulp_tolerance() functions to create
+ * such an object.
+ */
+struct floating_point_tolerance
+{
+    float_compare_t     m_mode = float_compare_t::FLOAT_COMPARE_RELATIVE;
+    double              m_value = 0.0;
+};
+
+
+inline floating_point_tolerance relative_tolerance(double epsilon)
+{
+    return floating_point_tolerance{ float_compare_t::FLOAT_COMPARE_RELATIVE, epsilon };
+}
+
+
+inline floating_point_tolerance ulp_tolerance(std::uint64_t ulps)
+{
+    return floating_point_tolerance{ float_compare_t::FLOAT_COMPARE_ULP, static_cast<double>(ulps) };
+}
+
+
+/** \brief The result of the comparison of two floating point ranges.
+ *
+ * The error is the relative error or the number of ULPs, depending on
+ * the comparison mode. The indexes are only valid if m_count > 0.
+ */
+struct floating_point_range_result
+{
+    std::size_t         m_count = 0;
+    std::size_t         m_first = 0;
+    std::size_t         m_worst = 0;
+    double              m_max_error = 0.0;
+};
+
+
+namespace detail
+{
+
+
+/** \brief Convert the bits of a floating point to an ordered integer.
+ *
+ * Once converted, the difference between two integers is the number
+ * of floating points between the two values.
+ */
+inline std::int64_t ordered_bits(double value)
+{
+    std::int64_t i(0);
+    memcpy(&i, &value, sizeof(i));
+    return i < 0 ? std::numeric_limits<std::int64_t>::min() - i : i;
+}
+
+
+inline std::int64_t ordered_bits(float value)
+{
+    std::int32_t i(0);
+    memcpy(&i, &value, sizeof(i));
+    return i < 0 ? std::numeric_limits<std::int32_t>::min() - static_cast<std::int64_t>(i) : i;
+}
+
+
+/** \brief Compute the error between two floating points.
+ *
+ * \param[in] lhs  The first number.
+ * \param[in] rhs  The second number.
+ * \param[in] tolerance  The comparison mode and tolerance.
+ * \param[out] error  The relative error or the number of ULPs.
+ *
+ * \return true if the error is within the tolerance.
+ */
+template<typename F>
+bool floating_point_error(F lhs, F rhs, floating_point_tolerance const & tolerance, double & error)
+{
+    if(std::isnan(lhs)
+    || std::isnan(rhs))
+    {
+        error = std::numeric_limits<double>::infinity();
+        return false;
+    }
+
+    if(tolerance.m_mode == float_compare_t::FLOAT_COMPARE_ULP)
+    {
+        std::int64_t const a(ordered_bits(lhs));
+        std::int64_t const b(ordered_bits(rhs));
+        error = static_cast<double>(a > b
+                    ? static_cast<std::uint64_t>(a) - static_cast<std::uint64_t>(b)
+                    : static_cast<std::uint64_t>(b) - static_cast<std::uint64_t>(a));
+        return error <= tolerance.m_value;
+    }
+
+    F const diff(std::abs(lhs - rhs));
+    F const sum(std::abs(lhs) + std::abs(rhs));
+    error = sum > 0 ? static_cast<double>(diff / sum) : 0.0;
+    return nearly_equal(lhs, rhs, static_cast<F>(tolerance.m_value));
+}
+
+
+/** \brief Skip the values which are clearly nearly equal.
+ *
+ * This function returns the index of the first pair of values which
+ * may not be nearly equal. The values which are exactly equal or with
+ * a relative difference clearly under \p epsilon are skipped, using
+ * SSE2 when available. The caller checks the returned pair with
+ * nearly_equal().
+ */
+template<typename F>
+std::size_t skip_nearly_equal_scalar(F const * a, F const * b, std::size_t size, F epsilon)
+{
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+    std::size_t idx(0);
+    for(; idx < size; ++idx)
+    {
+        F const diff(std::abs(a[idx] - b[idx]));
+        if(a[idx] != b[idx]
+        && (diff < std::numeric_limits<F>::min()
+            || !(diff < epsilon * (std::abs(a[idx]) + std::abs(b[idx])))))
+        {
+            break;
+        }
+    }
+    return idx;
+#pragma GCC diagnostic pop
+}
+
+
+template<typename F>
+std::size_t skip_nearly_equal(F const * a, F const * b, std::size_t size, F epsilon)
+{
+    return skip_nearly_equal_scalar(a, b, size, epsilon);
+}
+
+
+#ifdef __SSE2__
+template<>
+inline std::size_t skip_nearly_equal<double>(double const * a, double const * b, std::size_t size, double epsilon)
+{
+    __m128d const sign(_mm_set1_pd(-0.0));
+    __m128d const eps(_mm_set1_pd(epsilon));
+    __m128d const min(_mm_set1_pd(std::numeric_limits<double>::min()));
+    std::size_t idx(0);
+    for(; idx + 2 <= size; idx += 2)
+    {
+        __m128d const va(_mm_loadu_pd(a + idx));
+        __m128d const vb(_mm_loadu_pd(b + idx));
+        __m128d const diff(_mm_andnot_pd(sign, _mm_sub_pd(va, vb)));
+        __m128d const sum(_mm_add_pd(_mm_andnot_pd(sign, va), _mm_andnot_pd(sign, vb)));
+        __m128d const ok(_mm_or_pd(
+                  _mm_cmpeq_pd(va, vb)
+                , _mm_and_pd(
+                          _mm_cmpge_pd(diff, min)
+                        , _mm_cmplt_pd(diff, _mm_mul_pd(eps, sum)))));
+        if(_mm_movemask_pd(ok) != 0x3)
+        {
+            break;
+        }
+    }
+    return idx + skip_nearly_equal_scalar(a + idx, b + idx, std::min<std::size_t>(size - idx, 2), epsilon);
+}
+
+
+template<>
+inline std::size_t skip_nearly_equal<float>(float const * a, float const * b, std::size_t size, float epsilon)
+{
+    __m128 const sign(_mm_set1_ps(-0.0f));
+    __m128 const eps(_mm_set1_ps(epsilon));
+    __m128 const min(_mm_set1_ps(std::numeric_limits<float>::min()));
+    std::size_t idx(0);
+    for(; idx + 4 <= size; idx += 4)
+    {
+        __m128 const va(_mm_loadu_ps(a + idx));
+        __m128 const vb(_mm_loadu_ps(b + idx));
+        __m128 const diff(_mm_andnot_ps(sign, _mm_sub_ps(va, vb)));
+        __m128 const sum(_mm_add_ps(_mm_andnot_ps(sign, va), _mm_andnot_ps(sign, vb)));
+        __m128 const ok(_mm_or_ps(
+                  _mm_cmpeq_ps(va, vb)
+                , _mm_and_ps(
+                          _mm_cmpge_ps(diff, min)
+                        , _mm_cmplt_ps(diff, _mm_mul_ps(eps, sum)))));
+        if(_mm_movemask_ps(ok) != 0xF)
+        {
+            break;
+        }
+    }
+    return idx + skip_nearly_equal_scalar(a + idx, b + idx, std::min<std::size_t>(size - idx, 4), epsilon);
+}
+#endif
+
+
+} // detail namespace
+
+
+/** \brief Compare two arrays of floating points.
+ *
+ * The common case, where all the values match, is fast: the values are
+ * checked several at a time with SSE2 (in the ULP mode, only the equal
+ * values get skipped). Only the values which differ get compared one by
+ * one.
+ *
+ * A NaN never matches, in either mode, even when both values are the
+ * same NaN. The skip uses floating point compares, not a memory compare,
+ * so identical NaNs do not go through.
+ *
+ * \param[in] a  The first array.
+ * \param[in] b  The second array.
+ * \param[in] size  The number of values in each array.
+ * \param[in] tolerance  The comparison mode and tolerance.
+ *
+ * \return The number of mismatches, the first and worst ones.
+ */
+template<typename F>
+floating_point_range_result compare_floating_point_range(
+      F const * a
+    , F const * b
+    , std::size_t size
+    , floating_point_tolerance const & tolerance)
+{
+    static_assert(std::is_floating_point<F>::value, "compare_floating_point_range() expects float or double values");
+
+    floating_point_range_result result;
+    std::size_t idx(0);
+    while(idx < size)
+    {
+        idx += detail::skip_nearly_equal(
+                  a + idx
+                , b + idx
+                , size - idx
+                , tolerance.m_mode == float_compare_t::FLOAT_COMPARE_ULP
+                        ? static_cast<F>(0)
+                        : static_cast<F>(tolerance.m_value));
+        if(idx >= size)
+        {
+            break;
+        }
+
+        double error(0.0);
+        if(!detail::floating_point_error(a[idx], b[idx], tolerance, error))
+        {
+            if(result.m_count == 0)
+            {
+                result.m_first = idx;
+                result.m_worst = idx;
+                result.m_max_error = error;
+            }
+            else if(error > result.m_max_error)
+            {
+                result.m_worst = idx;
+                result.m_max_error = error;
+            }
+            ++result.m_count;
+        }
+        ++idx;
+    }
+
+    return result;
+}
+
+
+namespace detail
+{
+
+
+/** \brief Report the comparison of two floating point ranges.
+ *
+ * This function is used by the CATCH_REQUIRE_FLOATING_POINT_RANGE()
+ * macro. The ranges can be any container with a `data()` and a `size()`
+ * function (std::vector, std::array, std::basic_string...)
+ *
+ * \param[in] handler  The catch2 assertion handler.
+ * \param[in] a  The first range.
+ * \param[in] b  The second range.
+ * \param[in] tolerance  The comparison mode and tolerance.
+ */
+template<typename A, typename B>
+void report_floating_point_range(
+      Catch::AssertionHandler & handler
+    , A const & a
+    , B const & b
+    , floating_point_tolerance const & tolerance = relative_tolerance(default_epsilon<double>()))
+{
+    std::stringstream ss;
+    if(a.size() != b.size())
+    {
+        ss << "the ranges have different sizes: "
+           << a.size()
+           << " and "
+           << b.size()
+           << '.';
+        handler.handleMessage(Catch::ResultWas::ExplicitFailure, ss.str());
+        return;
+    }
+
+    floating_point_range_result const r(compare_floating_point_range(
+              a.data()
+            , b.data()
+            , a.size()
+            , tolerance));
+    char const * const unit(tolerance.m_mode == float_compare_t::FLOAT_COMPARE_ULP
+                                ? " ULP"
+                                : " (relative)");
+    ss << r.m_count
+       << " of "
+       << a.size()
+       << " values differ by more than "
+       << tolerance.m_value
+       << unit
+       << '.';
+    if(r.m_count > 0)
+    {
+        ss.precision(std::numeric_limits<double>::max_digits10);
+        ss << "\nfirst at ["
+           << r.m_first
+           << "]: "
+           << a.data()[r.m_first]
+           << " vs "
+           << b.data()[r.m_first]
+           << "\nworst at ["
+           << r.m_worst
+           << "]: "
+           << a.data()[r.m_worst]
+           << " vs "
+           << b.data()[r.m_worst]
+           << " (error: "
+           << r.m_max_error
+           << unit
+           << ')';
+    }
+    handler.handleMessage(
+              r.m_count == 0
+                    ? Catch::ResultWas::Ok
+                    : Catch::ResultWas::ExplicitFailure
+            , ss.str());
+}
+
+
+} // detail namespace
+
+
+
+
+
+} // SNAP_CATCH2_NAMESPACE namespace
+
+
+/** \brief Start a new section.
+ *
+ * This macro is an _overload_ of the CATCH_SECTION() macro defined in
+ * catch2.hpp. It is used so we can print out the name of the section
+ * whenever it executes and g_progress is true (i.e. the `--progress`
+ * command line option was specified.)
+ *
+ * \code
+ *     CATCH_START_SECTION("my section name/description here")
+ *         break_something(1, 2, 3);
+ *     CATCH_END_SECTION()
+ * \endcode
+ *
+ * As you can see, you want to end the section with the CATCH_END_SECTION()
+ * macro.
+ *
+ * \note
+ * You do not need to add a block like you have to do with CATCH since
+ * the macros add them for you.
+ *
+ * \note
+ * The older version of Catch supported a description for a section.
+ * Now that's useless so we only offer a name here.
+ *
+ * When the `--timings` or `--timings-json` command line options are used,
+ * the macro also records the wall and CPU time spent in the section.
+ *
+ * \param[in] name  The name of the section.
+ */
+#define CATCH_START_SECTION(name) \
+    CATCH_SECTION(name) \
+    { \
+        SNAP_CATCH2_NAMESPACE::detail::section_guard const INTERNAL_CATCH_UNIQUE_NAME(snap_catch2_section_guard_)(name);
+
+/** \brief End a section.
+ *
+ * This macro ends a section. The CATCH_START_SECTION() creates a
+ * block which this macro closes.
+ */
+#define CATCH_END_SECTION() \
+    }
+
+
+/** \brief Require that two long strings be equal.
+ *
+ * When testing with really long strings, the compare failing will give
+ * you both output but it's pretty much impossible to see the errors.
+ *
+ * Here we call our own function which will highlight the problems
+ * so that way you can immediately see where the first difference occurs.
+ *
+ * \note
+ * This does not make use of the standard catch environment so it will
+ * eventually throw or break in some other ways which may not end up
+ * well.
+ *
+ * \param[in] a  The first string.
+ * \param[in] b  The second string.
+ */
+#define CATCH_REQUIRE_LONG_STRING(a, b) SNAP_CATCH2_NAMESPACE::catch_compare_long_strings(a, b)
+
+
+/** \brief Require that two long buffers of bytes be equal.
+ *
+ * This is the binary counterpart of CATCH_REQUIRE_LONG_STRING(). Each
+ * buffer is anything with a data() and a size() function, such as an
+ * std::vector<std::uint8_t>, an SNAP_CATCH2_NAMESPACE::buffer_view
+ * created from a pointer and a size (i.e. a memory mapped file) or an
+ * std::istream. A stream gets compared one chunk at a time so very
+ * large files can be compared without loading them in memory:
+ *
+ * \code
+ *     CATCH_REQUIRE_LONG_BUFFER(
+ *               std::ifstream("expected.bin", std::ios::binary)
+ *             , frame);
+ * \endcode
+ *
+ * On a mismatch, the lines with differences are printed as a side by
+ * side hexdump with `--diff-context` lines around them.
+ *
+ * \param[in] a  The first buffer.
+ * \param[in] b  The second buffer.
+ */
+#define CATCH_REQUIRE_LONG_BUFFER(a, b) \
+    do \
+    { \
+        Catch::AssertionHandler catchAssertionHandler( \
+                  "CATCH_REQUIRE_LONG_BUFFER"_catch_sr \
+                , CATCH_INTERNAL_LINEINFO \
+                , CATCH_INTERNAL_STRINGIFY(a, b) \
+                , Catch::ResultDisposition::Normal); \
+        INTERNAL_CATCH_TRY \
+        { \
+            SNAP_CATCH2_NAMESPACE::detail::compare_long_buffers( \
+                      catchAssertionHandler \
+                    , (a) \
+                    , (b)); \
+        } \
+        INTERNAL_CATCH_CATCH(catchAssertionHandler) \
+        INTERNAL_CATCH_REACT(catchAssertionHandler) \
+    } \
+    while(false)
+
+
+
+/** \brief Compare data against a golden file.
+ *
+ * The golden file \p name is searched in g_golden_dir() (see the
+ * `--golden-dir` command line option). It gets mapped in memory and
+ * compared against \p data without any copy, which is much faster than
+ * embedding a huge string literal in the test and comparing it with
+ * CATCH_REQUIRE_LONG_STRING().
+ *
+ * \p data is an std::string, a C string or any container with data()
+ * and size() functions, such as an std::vector<std::uint8_t>.
+ *
+ * On a mismatch, the differences are printed like with
+ * CATCH_REQUIRE_LONG_STRING(). Run the tests with `--update-golden`
+ * to save the new data in the golden files instead.
+ *
+ * \param[in] name  The name of the golden file.
+ * \param[in] data  The data to compare.
+ */
+#define CATCH_REQUIRE_MATCHES_GOLDEN(name, data) \
+    do \
+    { \
+        Catch::AssertionHandler catchAssertionHandler( \
+                  "CATCH_REQUIRE_MATCHES_GOLDEN"_catch_sr \
+                , CATCH_INTERNAL_LINEINFO \
+                , CATCH_INTERNAL_STRINGIFY(name, data) \
+                , Catch::ResultDisposition::Normal); \
+        INTERNAL_CATCH_TRY \
+        { \
+            SNAP_CATCH2_NAMESPACE::detail::compare_golden( \
+                      catchAssertionHandler \
+                    , (name) \
+                    , (data)); \
+        } \
+        INTERNAL_CATCH_CATCH(catchAssertionHandler) \
+        INTERNAL_CATCH_REACT(catchAssertionHandler) \
+    } \
+    while(false)
+
+
+#define CATCH_REQUIRE_FLOATING_POINT(a, b) SNAP_CATCH2_NAMESPACE::nearly_equal(a, b)
+
+
+/** \brief Require that two arrays of floating points be nearly equal.
+ *
+ * The arrays can be any container with a `data()` and a `size()`
+ * function. By default, the values are compared like nearly_equal()
+ * does, with default_epsilon(). A third parameter can be used to
+ * change the tolerance:
+ *
+ * \code
+ *     CATCH_REQUIRE_FLOATING_POINT_RANGE(expected, result);
+ *     CATCH_REQUIRE_FLOATING_POINT_RANGE(expected, result, SNAP_CATCH2_NAMESPACE::relative_tolerance(1e-9));
+ *     CATCH_REQUIRE_FLOATING_POINT_RANGE(expected, result, SNAP_CATCH2_NAMESPACE::ulp_tolerance(4));
+ * \endcode
+ *
+ * On failure, the message gives the number of values which differ,
+ * the first one and the one with the largest error.
+ *
+ * \param[in] a  The first array.
+ * \param[in] ...  The second array and optionally the tolerance.
+ */
+#define CATCH_REQUIRE_FLOATING_POINT_RANGE(a, ...) \
+    do \
+    { \
+        Catch::AssertionHandler catchAssertionHandler( \
+                  "CATCH_REQUIRE_FLOATING_POINT_RANGE"_catch_sr \
+                , CATCH_INTERNAL_LINEINFO \
+                , CATCH_INTERNAL_STRINGIFY(a, __VA_ARGS__) \
+                , Catch::ResultDisposition::Normal); \
+        INTERNAL_CATCH_TRY \
+        { \
+            SNAP_CATCH2_NAMESPACE::detail::report_floating_point_range( \
+                      catchAssertionHandler \
+                    , a \
+                    , __VA_ARGS__); \
+        } \
+        INTERNAL_CATCH_CATCH(catchAssertionHandler) \
+        INTERNAL_CATCH_REACT(catchAssertionHandler) \
+    } \
+    while(false)
+
+
+
+/** \brief Start a scope of bulk checks.
+ *
+ * Calling CATCH_REQUIRE() millions of times in a loop is very slow
+ * because catch2 handles each assertion separately. Within a
+ * CATCH_REQUIRE_ALL() scope, use CATCH_CHECK_FAST() instead. A check
+ * which passes only increments a counter. The first few failures (see
+ * `--bulk-failures`) are saved with their values and all the checks get
+ * reported to catch2 once, by CATCH_END_REQUIRE_ALL().
+ *
+ * \code
+ *     CATCH_REQUIRE_ALL("all code points round trip")
+ *         for(char32_t wc(0); wc < 0x110000; ++wc)
+ *         {
+ *             CATCH_CHECK_FAST(to_u32string(to_u8string(wc)) == std::u32string(1, wc));
+ *         }
+ *     CATCH_END_REQUIRE_ALL()
+ * \endcode
+ *
+ * As with CATCH_START_SECTION(), the macros create the block for you.
+ *
+ * \param[in] name  A name describing the checks.
+ */
+#define CATCH_REQUIRE_ALL(name) \
+    { \
+        SNAP_CATCH2_NAMESPACE::bulk_checker snap_catch2_bulk_checker(name, CATCH_INTERNAL_LINEINFO);
+
+/** \brief Check an expression within a CATCH_REQUIRE_ALL() scope.
+ *
+ * The expression is decomposed like with CATCH_CHECK() so the values
+ * can be shown on failure, but nothing is sent to catch2 until the end
+ * of the scope.
+ */
+#define CATCH_CHECK_FAST(...) \
+    do \
+    { \
+        CATCH_INTERNAL_START_WARNINGS_SUPPRESSION \
+        CATCH_INTERNAL_SUPPRESS_PARENTHESES_WARNINGS \
+        snap_catch2_bulk_checker.check( \
+                  Catch::Decomposer() <= __VA_ARGS__ \
+                , CATCH_INTERNAL_STRINGIFY(__VA_ARGS__) \
+                , CATCH_INTERNAL_LINEINFO); \
+        CATCH_INTERNAL_STOP_WARNINGS_SUPPRESSION \
+    } \
+    while(false)
+
+/** \brief End a CATCH_REQUIRE_ALL() scope.
+ *
+ * This macro reports the checks to catch2 and closes the block.
+ */
+#define CATCH_END_REQUIRE_ALL() \
+        snap_catch2_bulk_checker.report(); \
+    }
+
+
+
+/** \brief Check an expression in a thread.
+ *
+ * The result is saved in the thread buffer of \p checker and reported
+ * by CATCH_REQUIRE_THREAD_CHECKS() once the threads were joined. See
+ * the thread_checker class for details.
+ *
+ * \param[in] checker  The thread_checker object.
+ */
+#define CATCH_THREAD_CHECK(checker, ...) \
+    do \
+    { \
+        CATCH_INTERNAL_START_WARNINGS_SUPPRESSION \
+        CATCH_INTERNAL_SUPPRESS_PARENTHESES_WARNINGS \
+        (checker).check( \
+                  Catch::Decomposer() <= __VA_ARGS__ \
+                , CATCH_INTERNAL_STRINGIFY(__VA_ARGS__) \
+                , CATCH_INTERNAL_LINEINFO); \
+        CATCH_INTERNAL_STOP_WARNINGS_SUPPRESSION \
+    } \
+    while(false)
+
+/** \brief Report the checks made by the threads.
+ *
+ * Call this macro from the thread running the test once all the threads
+ * using \p checker were joined.
+ *
+ * \param[in] checker  The thread_checker object.
+ */
+#define CATCH_REQUIRE_THREAD_CHECKS(checker) \
+    (checker).replay(CATCH_INTERNAL_LINEINFO, CATCH_INTERNAL_STRINGIFY(checker))
+
+
+
+/** \brief Require that an expression does not allocate memory.
+ *
+ * This macro evaluates \p expr and verifies that the current thread
+ * did not call operator new while doing so. This is useful to verify
+ * that a hot path does not allocate anything.
+ *
+ * The assertion fails if the allocation tracking is not available. To
+ * make it available, define SNAP_CATCH2_TRACK_ALLOCATIONS in the file
+ * where you call snap_catch2_main() (i.e. where you define
+ * CATCH_CONFIG_RUNNER):
+ *
+ * \code
+ *     #define CATCH_CONFIG_RUNNER
+ *     #define SNAP_CATCH2_TRACK_ALLOCATIONS
+ *     #include <catch2/snapcatch2.hpp>
+ * \endcode
+ *
+ * \param[in] expr  The expression to evaluate.
+ */
+#define CATCH_REQUIRE_NO_ALLOCATIONS(expr) \
+    SNAP_CATCH2_INTERNAL_REQUIRE_ALLOCATIONS("CATCH_REQUIRE_NO_ALLOCATIONS", 0, expr)
+
+
+/** \brief Require that an expression allocates at most \p n blocks.
+ *
+ * This macro evaluates \p expr and verifies that the current thread
+ * called operator new at most \p n times while doing so. On failure,
+ * the message includes the number of allocations, the total number of
+ * bytes and the peak number of bytes in use.
+ *
+ * \param[in] n  The maximum number of allocations.
+ * \param[in] expr  The expression to evaluate.
+ */
+#define CATCH_REQUIRE_MAX_ALLOCATIONS(n, expr) \
+    SNAP_CATCH2_INTERNAL_REQUIRE_ALLOCATIONS("CATCH_REQUIRE_MAX_ALLOCATIONS", n, expr)
+
+#define SNAP_CATCH2_INTERNAL_REQUIRE_ALLOCATIONS(macro_name, n, expr) \
+    do \
+    { \
+        Catch::AssertionHandler catchAssertionHandler( \
+                  macro_name##_catch_sr \
+                , CATCH_INTERNAL_LINEINFO \
+                , CATCH_INTERNAL_STRINGIFY(expr) \
+                , Catch::ResultDisposition::Normal); \
+        INTERNAL_CATCH_TRY \
+        { \
+            SNAP_CATCH2_NAMESPACE::allocation_guard const snap_catch2_allocation_guard; \
+            static_cast<void>(expr); \
+            SNAP_CATCH2_NAMESPACE::detail::report_allocations( \
+                      catchAssertionHandler \
+                    , snap_catch2_allocation_guard \
+                    , (n)); \
+        } \
+        INTERNAL_CATCH_CATCH(catchAssertionHandler) \
+        INTERNAL_CATCH_REACT(catchAssertionHandler) \
+    } \
+    while(false)
+
+
+/** \brief Require that an expression runs in less than \p duration.
+ *
+ * This macro evaluates \p expr once and measures the wall clock time it
+ * takes with the steady clock. The \p duration is any std::chrono
+ * duration:
+ *
+ * \code
+ *     CATCH_REQUIRE_DURATION_BELOW(std::chrono::microseconds(50), cache.find(key));
+ * \endcode
+ *
+ * Keep in mind that the test may be running under valgrind or in a
+ * loaded machine; use generous limits.
+ *
+ * \param[in] duration  The maximum duration.
+ * \param[in] expr  The expression to evaluate.
+ */
+#define CATCH_REQUIRE_DURATION_BELOW(duration, expr) \
+    do \
+    { \
+        Catch::AssertionHandler catchAssertionHandler( \
+                  "CATCH_REQUIRE_DURATION_BELOW"_catch_sr \
+                , CATCH_INTERNAL_LINEINFO \
+                , CATCH_INTERNAL_STRINGIFY(expr) \
+                , Catch::ResultDisposition::Normal); \
+        INTERNAL_CATCH_TRY \
+        { \
+            std::chrono::steady_clock::time_point const snap_catch2_start( \
+                        std::chrono::steady_clock::now()); \
+            static_cast<void>(expr); \
+            SNAP_CATCH2_NAMESPACE::detail::report_duration( \
+                      catchAssertionHandler \
+                    , std::chrono::steady_clock::now() - snap_catch2_start \
+                    , std::chrono::duration_cast<std::chrono::nanoseconds>(duration)); \
+        } \
+        INTERNAL_CATCH_CATCH(catchAssertionHandler) \
+        INTERNAL_CATCH_REACT(catchAssertionHandler) \
+    } \
+    while(false)
+
+
+/** \brief Require a percentile of a latency histogram to be below a limit.
+ *
+ * This macro verifies that the \p percent percentile of the values
+ * recorded in \p histogram (a latency_histogram) is below \p duration,
+ * any std::chrono duration:
+ *
+ * \code
+ *     CATCH_REQUIRE_PERCENTILE_BELOW(hist, 99.9, std::chrono::microseconds(500));
+ * \endcode
+ *
+ * An empty histogram fails. With `--histograms-json`, the percentiles
+ * of the histogram also get saved in the JSON file.
+ *
+ * \param[in] histogram  The latency_histogram to check.
+ * \param[in] percent  The percentile, from 0.0 to 100.0.
+ * \param[in] duration  The maximum duration.
+ */
+#define CATCH_REQUIRE_PERCENTILE_BELOW(histogram, percent, duration) \
+    do \
+    { \
+        Catch::AssertionHandler catchAssertionHandler( \
+                  "CATCH_REQUIRE_PERCENTILE_BELOW"_catch_sr \
+                , CATCH_INTERNAL_LINEINFO \
+                , CATCH_INTERNAL_STRINGIFY(histogram, percent, duration) \
+                , Catch::ResultDisposition::Normal); \
+        INTERNAL_CATCH_TRY \
+        { \
+            SNAP_CATCH2_NAMESPACE::detail::report_percentile( \
+                      catchAssertionHandler \
+                    , CATCH_INTERNAL_STRINGIFY(histogram) \
+                    , (histogram) \
+                    , (percent) \
+                    , std::chrono::duration_cast<std::chrono::nanoseconds>(duration)); \
+        } \
+        INTERNAL_CATCH_CATCH(catchAssertionHandler) \
+        INTERNAL_CATCH_REACT(catchAssertionHandler) \
+    } \
+    while(false)
+
+
+
+/** \brief Define a property.
+ *
+ * A property is a function which gets called with many inputs and
+ * verifies that something is always true. The values come from
+ * generators drawn from `input`, a SNAP_CATCH2_NAMESPACE::property_input,
+ * and the checks are done with CATCH_PROPERTY_CHECK():
+ *
+ * \code
+ *     CATCH_PROPERTY("utf8 round trip", "[utf8][property]")
+ *     {
+ *         std::string const s(input.draw(SNAP_CATCH2_NAMESPACE::gen::string(100)));
+ *         CATCH_PROPERTY_ASSUME(!s.empty());
+ *         CATCH_PROPERTY_CHECK(libutf8::to_u8string(libutf8::to_u32string(s)) == s);
+ *     }
+ * \endcode
+ *
+ * In a unit test, the property is a test case which runs the body with
+ * `--property-examples` random inputs. When one fails, the input gets
+ * shrunk on `--property-threads` threads and the smallest failing values
+ * are printed. Since the inputs come from rng(), `--seed` reproduces them.
+ *
+ * When SNAP_CATCH2_FUZZER is defined, the same code instead defines
+ * the LLVMFuzzerTestOneInput() function and the fuzzer input becomes
+ * the bytes read by the generators:
+ *
+ * \code
+ *     clang++ -fsanitize=fuzzer,address -DSNAP_CATCH2_FUZZER \
+ *             -DCATCH_CONFIG_PREFIX_ALL utf8_properties.cpp -o fuzz_utf8
+ *     SNAP_CATCH2_PROPERTY="utf8 round trip" ./fuzz_utf8 corpus/
+ * \endcode
+ *
+ * The fuzzer runs the property named in the SNAP_CATCH2_PROPERTY
+ * environment variable, or the first one. A crash file it saves can be
+ * replayed by the unit tests with `--property-input <file>`.
+ *
+ * Because of that, the body must not use the other catch2 macros, and
+ * since the shrinker runs it in several threads, it should not change
+ * any shared state.
+ *
+ * \param[in] name  The name of the property (and its test case).
+ * \param[in] tags  The tags of the test case.
+ */
+#define CATCH_PROPERTY(name, tags) \
+    SNAP_CATCH2_INTERNAL_PROPERTY(INTERNAL_CATCH_UNIQUE_NAME(snap_catch2_property_), name, tags)
+
+#ifdef SNAP_CATCH2_FUZZER
+#define SNAP_CATCH2_INTERNAL_PROPERTY(function, name, tags) \
+    static void function(SNAP_CATCH2_NAMESPACE::property_input & input); \
+    namespace \
+    { \
+    SNAP_CATCH2_NAMESPACE::detail::fuzz_property_registrar const \
+                INTERNAL_CATCH_UNIQUE_NAME(snap_catch2_property_registrar_)(name, &function); \
+    } \
+    static void function(SNAP_CATCH2_NAMESPACE::property_input & input)
+#else
+#define SNAP_CATCH2_INTERNAL_PROPERTY(function, name, tags) \
+    static void function(SNAP_CATCH2_NAMESPACE::property_input & input); \
+    CATCH_TEST_CASE(name, tags) \
+    { \
+        SNAP_CATCH2_NAMESPACE::detail::check_property(name, &function, CATCH_INTERNAL_LINEINFO); \
+    } \
+    static void function(SNAP_CATCH2_NAMESPACE::property_input & input)
+#endif
+
+
+/** \brief Check a condition in a property.
+ *
+ * When the condition is false, the example fails and gets shrunk.
+ *
+ * \param[in] ...  The condition.
+ */
+#define CATCH_PROPERTY_CHECK(...) \
+    do \
+    { \
+        if(!(__VA_ARGS__)) \
+        { \
+            throw SNAP_CATCH2_NAMESPACE::detail::property_failure{ \
+                      __FILE__ \
+                    , __LINE__ \
+                    , "CATCH_PROPERTY_CHECK(" #__VA_ARGS__ ")" }; \
+        } \
+    } \
+    while(false)
+
+
+/** \brief Discard the examples which do not satisfy a condition.
+ *
+ * Use this for inputs the property does not apply to. A property which
+ * rejects more than ten times its number of examples fails.
+ *
+ * \param[in] ...  The condition.
+ */
+#define CATCH_PROPERTY_ASSUME(...) \
+    do \
+    { \
+        if(!(__VA_ARGS__)) \
+        { \
+            throw SNAP_CATCH2_NAMESPACE::detail::property_reject(); \
+        } \
+    } \
+    while(false)
+
+
+#ifdef SNAP_CATCH2_FUZZER
+/** \brief The libFuzzer entry point.
+ *
+ * It runs the selected CATCH_PROPERTY() with the fuzzer input. A failed
+ * check aborts so the fuzzer saves the input. Rejected inputs return -1
+ * so they do not get added to the corpus.
+ *
+ * The function is weak since each file including this header with
+ * SNAP_CATCH2_FUZZER defines it.
+ */
+extern "C" __attribute__((weak)) int LLVMFuzzerTestOneInput(std::uint8_t const * data, std::size_t size)
+{
+    SNAP_CATCH2_NAMESPACE::detail::fuzz_property const & property(
+                SNAP_CATCH2_NAMESPACE::detail::selected_fuzz_property());
+    SNAP_CATCH2_NAMESPACE::property_input input(data, size);
+    SNAP_CATCH2_NAMESPACE::detail::property_outcome const r(
+                SNAP_CATCH2_NAMESPACE::detail::run_property(property.m_body, input));
+    switch(r.m_status)
+    {
+    case SNAP_CATCH2_NAMESPACE::detail::property_status_t::PROPERTY_FAILED:
+        std::cerr << "property \"" << property.m_name << "\" failed:\n  "
+                  << r.m_message << std::endl;
+        abort();
+
+    case SNAP_CATCH2_NAMESPACE::detail::property_status_t::PROPERTY_REJECTED:
+        return -1;
+
+    default:
+        return 0;
+
+    }
+}
+#endif
+
+
+
+namespace Catch
+{
+namespace Matchers
+{
+
+
+class ExceptionWatcher
+    : public MatcherBase<std::exception>
+{
+public:
+    ExceptionWatcher(std::string const & expected_message, bool verbose)
+        : m_expected_message(expected_message)
+        , m_verbose(verbose)
+    {
+    }
+
+    /** \brief Check whether we got a match.
+     *
+     * This function compares the expected string with the actual exception
+     * what() output. In verbose mode, the differences get printed when
+     * the strings do not match.
+     */
+    bool match(std::exception const & e) const override
+    {
+        if(strcmp(e.what(), m_expected_message.c_str()) == 0)
+        {
+            return true;
+        }
+        if(m_verbose)
+        {
+            SNAP_CATCH2_NAMESPACE::catch_compare_long_strings(e.what(), m_expected_message);
+        }
+        return false;
+    }
+
+    /** \brief Describe this matcher.
+     *
+     * This function produces a string describing what this matcher does.
+     *
+     * \return The description of this matcher.
+     */
+    virtual std::string describe() const override
+    {
+        return "compare the exception what() message with \""
+             + m_expected_message
+             + "\".";
+    }
+
+private:
+    std::string     m_expected_message = std::string();
+    bool            m_verbose = false;
+};
+
+
+inline ExceptionWatcher ExceptionMessage(std::string const & expected_message, bool verbose = false)
+{
+    return ExceptionWatcher(expected_message, verbose);
+}
+
+
+/** \brief How an ExceptionMessageView compares the message.
+ */
+enum class message_match_t
+{
+    MESSAGE_MATCH_EXACT,
+    MESSAGE_MATCH_PREFIX,
+    MESSAGE_MATCH_CONTAINS,
+};
+
+
+/** \brief Compare the exception message without allocating memory.
  *
- *     snap_catch2_main(
- *           "libutf8"
- *         , "1.2.3"
- *         , argc
- *         , argv
- *         , nullptr
- *         , &add_command_line_options
- *     );
- * \endcode
+ * Unlike the ExceptionWatcher, this matcher does not copy the expected
+ * message; it keeps a reference to it (a Catch::StringRef). When the
+ * message matches, nothing gets allocated, which matters in tests which
+ * throw millions of exceptions. The expected string must outlive the
+ * matcher, which is always the case with a string literal or when the
+ * matcher is used within the CATCH_REQUIRE_THROWS_MATCHES() macro.
  *
- * \warning
- * It is possible to add a one letter command line option such as ["-t"],
- * however, catch2 already uses most of these options. The `-t` is used
- * to list tags, for example.
+ * In verbose mode, the differences between the messages get printed
+ * when they do not match (exact and prefix matches only).
  *
- * The \p callback function gets called just before the tests get run.
- * In other words, we give you one more chance to verify command line
- * parameters or do additional initilalizations, now that you have access
- * to the user defined command line parameters. We pass the session to
- * the function, although in many cases you will not use it because your
- * parameters are already set as expected.
+ * Use the ExceptionMessageEquals(), ExceptionMessageStartsWith() and
+ * ExceptionMessageContains() functions to create these matchers:
  *
  * \code
- *     namespace SNAP_CATCH2_NAMESPACE
- *     {
- *
- *     int finish_init(Catch::Session & session)
- *     {
- *         std::string cmd("rm -rf ");
- *         cmd += g_tmpdir;
- *         cmd += "/my-project";
- *         if(system(cmd.c_str()) != 0)
- *         {
- *             perror(cmd.c_str());
- *             return 1;
- *         }
- *
- *         return 0;
- *     }
- *
- *     }
- *
- *     ...snip...
- *
- *     snap_catch2_main(
- *           "libutf8"
- *         , "1.2.3"
- *         , argc
- *         , argv
- *         , nullptr
- *         , nullptr
- *         , &finish_init
- *     );
+ *     CATCH_REQUIRE_THROWS_MATCHES(
+ *               parse("1.2.3.4.5")
+ *             , invalid_address
+ *             , Catch::Matchers::ExceptionMessageStartsWith("invalid address: "));
  * \endcode
- *
- * Once the tests ran, we call the \p finished_callback as well. This gives
- * you the ability to test futher things such as making sure that everything
- * was cleaned up, resources released, etc. For example, in our advgetopt
- * we use a FIFO to handle error messages. If an error never occurs that
- * FIFO will not be empty on exit. This is actually an error in the test.
- * Only errors that do occur have to be added to the FIFO. So on exit we
- * want to verify that the FIFO is indeed empty.
- *
- * \param[in] project_name  The name of the project (i.e. "libutf8").
- * \param[in] project_version  The version string of the project
- *                     (i.e. "LIBUTF8_VERSION_STRING").
- * \param[in] argc  The number of arguments on the command line.
- * \param[in] argv  An array of strings with the command line arguments.
- * \param[in] init_callback  Callback called before anything else.
- * \param[in] add_user_options  A callback giving you the opportunity to add
- *                              command line options before argv gets parsed.
- * \param[in] callback  A callback called just before we run the tests.
- * \param[in] finished_callback  The callback called just after all the tests
- *                               ran.
- *
- * \return The exit code, usually 0 on success and 1 on an error.
  */
-inline int snap_catch2_main(
-          char const * project_name
-        , char const * project_version
-        , int argc
-        , char * argv[]
-        , void (*init_callback)() = nullptr
-        , Catch::clara::Parser (*add_user_options)(Catch::clara::Parser const & cli) = nullptr
-        , int (*callback)(Catch::Session & session) = nullptr
-        , void (*finished_callback)() = nullptr)
+class ExceptionMessageView
+    : public MatcherBase<std::exception>
 {
-    typedef unsigned int seed_t; // see `man srand(3)` for type
+public:
+    ExceptionMessageView(StringRef expected_message, message_match_t mode, bool verbose)
+        : m_expected_message(expected_message)
+        , m_mode(mode)
+        , m_verbose(verbose)
+    {
+    }
 
-    try
+    bool match(std::exception const & e) const override
     {
-        if(init_callback != nullptr)
+        return match_message(e.what());
+    }
+
+    /** \brief Check a message.
+     *
+     * \param[in] what  The message to check.
+     *
+     * \return true if the message matches.
+     */
+    bool match_message(char const * what) const
+    {
+        char const * expected(m_expected_message.data());
+        std::size_t const expected_size(m_expected_message.size());
+        std::size_t const size(strlen(what));
+        bool result(false);
+        switch(m_mode)
         {
-            init_callback();
-        }
+        case message_match_t::MESSAGE_MATCH_EXACT:
+            result = size == expected_size
+                  && memcmp(what, expected, size) == 0;
+            break;
 
-        Catch::Session session;
+        case message_match_t::MESSAGE_MATCH_PREFIX:
+            result = size >= expected_size
+                  && memcmp(what, expected, expected_size) == 0;
+            break;
 
-        bool version(false);
-        seed_t seed(static_cast<seed_t>(time(NULL)));
+        case message_match_t::MESSAGE_MATCH_CONTAINS:
+            result = expected_size == 0
+                  || memmem(what, size, expected, expected_size) != nullptr;
+            break;
 
-        auto cli = session.cli()
-                 | Catch::clara::Opt(seed, "seed")
-                    ["-S"]["--seed"]
-                    ("value to seed the randomizer, if not specified, randomize")
-                 | Catch::clara::Opt(g_progress())
-                    ["-p"]["--progress"]
-                    ("print name of test section being run")
-                 | Catch::clara::Opt(g_tmp_dir(), "tmp_dir")
-                    ["-T"]["--tmp-dir"]
-                    ("specify a temporary directory")
-                 | Catch::clara::Opt(g_verbose())
-                    ["--verbose"]
-                    ("print additional information from within our own tests")
-                 | Catch::clara::Opt(version)
-                    ["-V"]["--version"]
-                    ("print out the libutf8 library version these unit tests pertain to");
+        default:
+            break;
 
-        if(add_user_options != nullptr)
-        {
-            cli = add_user_options(cli);
         }
 
-        session.cli(cli);
-
-        if(session.applyCommandLine(argc, argv) != 0)
+        if(!result
+        && m_verbose
+        && m_mode != message_match_t::MESSAGE_MATCH_CONTAINS)
         {
-            std::cerr << "fatal error: invalid command line." << std::endl;
-            return 1;
+            std::cout << "error: exception message does not match.\n"
+                      << "---------------------------------------------------\n";
+            SNAP_CATCH2_NAMESPACE::detail::print_diff(
+                      what
+                    , m_mode == message_match_t::MESSAGE_MATCH_PREFIX ? std::min(size, expected_size) : size
+                    , expected
+                    , expected_size
+                    , SNAP_CATCH2_NAMESPACE::g_diff_context()
+                    , std::cout);
+            std::cout << "---------------------------------------------------" << std::endl;
         }
 
-        if(version)
+        return result;
+    }
+
+    virtual std::string describe() const override
+    {
+        return "exception " + describe_message();
+    }
+
+    /** \brief Describe the message check.
+     *
+     * \return The description of the check without the "exception" subject.
+     */
+    std::string describe_message() const
+    {
+        char const * verb("equals");
+        switch(m_mode)
         {
-            std::cout << project_version << std::endl;
-            return 0;
+        case message_match_t::MESSAGE_MATCH_PREFIX:
+            verb = "starts with";
+            break;
+
+        case message_match_t::MESSAGE_MATCH_CONTAINS:
+            verb = "contains";
+            break;
+
+        default:
+            break;
+
         }
+        return std::string("what() message ")
+             + verb
+             + " \""
+             + std::string(m_expected_message.data(), m_expected_message.size())
+             + "\".";
+    }
+
+private:
+    StringRef           m_expected_message = StringRef();
+    message_match_t     m_mode = message_match_t::MESSAGE_MATCH_EXACT;
+    bool                m_verbose = false;
+};
 
-        detail::init_tmp_dir(project_name);
 
-        // by default we get a different seed each time; that really helps
-        // in detecting errors! At least it helped me many times.
-        //
-        srand(seed);
+inline ExceptionMessageView ExceptionMessageEquals(StringRef expected_message, bool verbose = false)
+{
+    return ExceptionMessageView(expected_message, message_match_t::MESSAGE_MATCH_EXACT, verbose);
+}
 
-        if(callback != nullptr)
+
+inline ExceptionMessageView ExceptionMessageStartsWith(StringRef expected_prefix, bool verbose = false)
+{
+    return ExceptionMessageView(expected_prefix, message_match_t::MESSAGE_MATCH_PREFIX, verbose);
+}
+
+
+inline ExceptionMessageView ExceptionMessageContains(StringRef expected_part, bool verbose = false)
+{
+    return ExceptionMessageView(expected_part, message_match_t::MESSAGE_MATCH_CONTAINS, verbose);
+}
+
+
+/** \brief Match the exception message against a regular expression.
+ *
+ * The regular expression (a POSIX extended regular expression) is
+ * compiled once, by the constructor. Catch2's own Matches() matcher
+ * compiles its std::regex each time it gets used. To compile it only
+ * once, create the matcher outside of the loop:
+ *
+ * \code
+ *     auto const invalid_port(Catch::Matchers::ExceptionMessageMatches("^invalid port [0-9]+$"));
+ *     for(auto const & port : ports)
+ *     {
+ *         CATCH_REQUIRE_THROWS_MATCHES(connect(port), invalid_argument, invalid_port);
+ *     }
+ * \endcode
+ *
+ * catch2 keeps a copy of the matcher in its expression. The compiled
+ * regular expression and the pattern are shared between the copies so
+ * that copy does not allocate memory. The search is done with regexec()
+ * which may allocate memory internally.
+ *
+ * \exception std::invalid_argument
+ * The constructor raises this exception if the pattern is not valid.
+ */
+class ExceptionMessageRegex
+    : public MatcherBase<std::exception>
+{
+public:
+    ExceptionMessageRegex(std::string const & pattern)
+        : m_regex(std::make_shared<compiled_regex>(pattern))
+    {
+    }
+
+    bool match(std::exception const & e) const override
+    {
+        return regexec(&m_regex->m_regex, e.what(), 0, nullptr, 0) == 0;
+    }
+
+    virtual std::string describe() const override
+    {
+        return "exception what() message matches /" + m_regex->m_pattern + "/.";
+    }
+
+private:
+    struct compiled_regex
+    {
+        compiled_regex(std::string const & pattern)
+            : m_pattern(pattern)
         {
-            int const e(callback(session));
-            if(e != 0)
+            int const r(regcomp(&m_regex, pattern.c_str(), REG_EXTENDED | REG_NOSUB));
+            if(r != 0)
             {
-                return e;
+                char msg[256];
+                regerror(r, &m_regex, msg, sizeof(msg));
+                throw std::invalid_argument("invalid regular expression \"" + pattern + "\": " + msg + ".");
             }
         }
 
-        std::cout << project_name
-                  << " v"
-                  << project_version
-                  << " ["
-                  << getpid()
-                  << "]:unittest: seed is "
-                  << seed
-                  << "\n"
-                  << "temporary directory: \""
-                  << g_tmp_dir()
-                  << "\""
-                  << std::endl;
-
-        auto const r(session.run());
+        compiled_regex(compiled_regex const &) = delete;
+        compiled_regex & operator = (compiled_regex const &) = delete;
 
-        if(finished_callback != nullptr)
+        ~compiled_regex()
         {
-            finished_callback();
+            regfree(&m_regex);
         }
 
-        return r;
-    }
-    catch(std::logic_error const & e)
+        std::string     m_pattern = std::string();
+        regex_t         m_regex = regex_t();
+    };
+
+    std::shared_ptr<compiled_regex>     m_regex = std::shared_ptr<compiled_regex>();
+};
+
+
+inline ExceptionMessageRegex ExceptionMessageMatches(std::string const & pattern)
+{
+    return ExceptionMessageRegex(pattern);
+}
+
+
+/** \brief Check the exact type and the message of an exception.
+ *
+ * The CATCH_REQUIRE_THROWS_MATCHES() macro catches the exception by
+ * reference to its base type so an exception derived from the expected
+ * type also passes. This matcher verifies that the exception is exactly
+ * of type \p T and that its message matches (see ExceptionMessageView).
+ *
+ * \code
+ *     CATCH_REQUIRE_THROWS_MATCHES(
+ *               f()
+ *             , std::exception
+ *             , Catch::Matchers::ExceptionTypeAndMessage<std::out_of_range>("index out of range"));
+ * \endcode
+ */
+template<typename T>
+class ExceptionTypeAndMessageMatcher
+    : public MatcherBase<std::exception>
+{
+public:
+    ExceptionTypeAndMessageMatcher(StringRef expected_message, message_match_t mode, bool verbose)
+        : m_message(expected_message, mode, verbose)
     {
-        std::cerr << "fatal error: caught a logic error in "
-                  << project_name
-                  << " unit tests: "
-                  << e.what()
-                  << "\n";
-        return 1;
     }
-    catch(std::runtime_error const & e)
+
+    bool match(std::exception const & e) const override
     {
-        std::cerr << "fatal error: caught a run-time error in "
-                  << project_name
-                  << " unit tests: "
-                  << e.what()
-                  << "\n";
-        return 1;
+        m_actual_type = &typeid(e);
+        return typeid(e) == typeid(T)
+            && m_message.match_message(e.what());
     }
-    catch(std::exception const & e)
+
+    virtual std::string describe() const override
     {
-        std::cerr << "fatal error: caught a standard exception in "
-                  << project_name
-                  << " unit tests: "
-                  << e.what()
-                  << "\n";
-        return 1;
+        std::string result("exception is of type ");
+        result += SNAP_CATCH2_NAMESPACE::detail::demangle(typeid(T).name());
+        if(m_actual_type != nullptr
+        && *m_actual_type != typeid(T))
+        {
+            result += " (got ";
+            result += SNAP_CATCH2_NAMESPACE::detail::demangle(m_actual_type->name());
+            result += ')';
+        }
+        return result + " and its " + m_message.describe_message();
     }
+
+private:
+    ExceptionMessageView                m_message;
+    mutable std::type_info const *      m_actual_type = nullptr;
+};
+
+
+template<typename T>
+inline ExceptionTypeAndMessageMatcher<T> ExceptionTypeAndMessage(StringRef expected_message, bool verbose = false)
+{
+    return ExceptionTypeAndMessageMatcher<T>(expected_message, message_match_t::MESSAGE_MATCH_EXACT, verbose);
+}
+
+
+template<typename T>
+inline ExceptionTypeAndMessageMatcher<T> ExceptionTypeAndMessageStartsWith(StringRef expected_prefix, bool verbose = false)
+{
+    return ExceptionTypeAndMessageMatcher<T>(expected_prefix, message_match_t::MESSAGE_MATCH_PREFIX, verbose);
 }
-#endif
 
 
 
-inline void catch_compare_long_strings(std::string const & a, std::string const & b)
+}
+// Matchers namespace
+}
+// Catch namespace
+
+
+#if defined(SNAP_CATCH2_TRACK_ALLOCATIONS) \
+ && (defined(CATCH_CONFIG_RUNNER) || defined(SNAP_CATCH2_USE_LIBRARY))
+/** \brief The allocation tracking operators.
+ *
+ * When SNAP_CATCH2_TRACK_ALLOCATIONS is defined in the translation unit
+ * which also defines CATCH_CONFIG_RUNNER (or calls the snap_catch2_main()
+ * of the prebuilt library), the global operator new and
+ * operator delete get replaced by these functions. They use malloc()
+ * and free() and update the allocation counters of the current thread.
+ */
+namespace SNAP_CATCH2_NAMESPACE
 {
-    auto print_char = [](char c)
+namespace detail
+{
+
+
+inline void * tracked_allocate(std::size_t size, std::size_t alignment, bool nothrow)
+{
+    if(size == 0)
     {
-        if(c == 0x20)
-        {
-            // Possible characters to make spaces visible are:
-            //      U+23B5      BOTTOM SQUARE BRACKET
-            //      U+2420      SYMBOL FOR SPACE
-            //      U+2423      OPEN BOX
-            //
-            std::cout << "\xE2\x90\xA3";
-        }
-        else if(static_cast<unsigned char>(c) < 0x20)
+        size = 1;
+    }
+    for(;;)
+    {
+        void * ptr(nullptr);
+        if(alignment <= alignof(std::max_align_t))
         {
-            // control character
-            //
-            std::cout << "^" << static_cast<char>(c + 0x40);
+            ptr = malloc(size);
         }
-        else if(static_cast<unsigned char>(c) < 0x80 || static_cast<unsigned char>(c) > 0x9F)
+        else if(posix_memalign(&ptr, alignment, size) != 0)
         {
-            // standard character
-            //
-            std::cout << c;
+            ptr = nullptr;
         }
-        else
+        if(ptr != nullptr)
         {
-            // graphical control
-            //
-            std::cout << "@" << static_cast<char>(c - 0x40);
+            allocation_counters & counters(thread_allocation_counters());
+            std::uint64_t const usable(malloc_usable_size(ptr));
+            ++counters.m_allocations;
+            counters.m_bytes += usable;
+            counters.m_live_bytes += usable;
+            counters.m_peak_live_bytes = std::max(counters.m_peak_live_bytes, counters.m_live_bytes);
+            return ptr;
         }
-    };
-
-    if(a == b)
-    {
-        return;
-    }
 
-    std::cout << "error: long strings do not match.\n"
-              << "---------------------------------------------------\n";
-
-    // TODO: we may want to look into supporting UTF-8 properly
-    //
-    size_t const max(std::min(a.length(), b.length()));
-    bool err(false);
-    for(size_t idx(0); idx < max; ++idx)
-    {
-        if(a[idx] == b[idx])
+        std::new_handler const handler(std::get_new_handler());
+        if(handler == nullptr)
         {
-            if(err)
+            if(nothrow)
             {
-                err = false;
-                std::cout << "\033[0m";
+                return nullptr;
             }
-            std::cout << a[idx];
+            throw std::bad_alloc();
         }
-        else
+        if(nothrow)
         {
-            if(!err)
+            // the nothrow operators are noexcept, a handler throwing
+            // std::bad_alloc would terminate the program
+            //
+            try
+            {
+                handler();
+            }
+            catch(...)
             {
-                err = true;
-                std::cout << "\033[7m";
+                return nullptr;
             }
-            std::cout << "[";
-            print_char(a[idx]);
-            std::cout << "/";
-            print_char(b[idx]);
-            std::cout << "]";
+        }
+        else
+        {
+            handler();
         }
     }
-    if(err)
-    {
-        err = false;
-        std::cout << "\033[0m";
-    }
-
-    std::cout << std::endl
-              << "---------------------------------------------------" << std::endl;
-
-    if(a.length() > b.length())
-    {
-        std::cout << "Left hand side string is longer ("
-                  << a.length()
-                  << " versus "
-                  << b.length()
-                  << ")."
-                  << std::endl;
-    }
-    else if(b.length() > a.length())
-    {
-        std::cout << "Right hand side string is longer ("
-                  << a.length()
-                  << " versus "
-                  << b.length()
-                  << ")."
-                  << std::endl;
-    }
-
-    // to generate the standard error too
-    //
-    CATCH_REQUIRE(a == b);
 }
 
 
-template<typename F>
-F default_epsilon()
+inline void tracked_free(void * ptr) noexcept
 {
-    return static_cast<F>(0.00001);
+    if(ptr != nullptr)
+    {
+        allocation_counters & counters(thread_allocation_counters());
+        ++counters.m_deallocations;
+        std::uint64_t const size(malloc_usable_size(ptr));
+
+        // the memory may have been allocated by another thread
+        //
+        counters.m_live_bytes = counters.m_live_bytes > size
+                                    ? counters.m_live_bytes - size
+                                    : 0;
+        free(ptr);
+    }
 }
 
 
-template<typename F>
-bool nearly_equal(
-      F const lhs
-    , F const rhs
-    , F epsilon = default_epsilon<F>())
+struct allocation_tracking_init
 {
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wfloat-equal"
-    // already equal?
-    if(lhs == rhs)
-    {
-        return true;
-    }
-
-    F const diff(std::abs(lhs - rhs));
-    if(lhs == 0.0
-    || rhs == 0.0
-    || diff < std::numeric_limits<F>::min())
+    allocation_tracking_init()
     {
-        return diff < (epsilon * std::numeric_limits<F>::min());
+        g_allocation_tracking() = true;
     }
-#pragma GCC diagnostic pop
-
-    return diff / (std::abs(lhs) + std::abs(rhs)) < epsilon;
-}
-
+};
 
 
+allocation_tracking_init const g_allocation_tracking_init = allocation_tracking_init();
 
 
+} // detail namespace
 } // SNAP_CATCH2_NAMESPACE namespace
 
 
-/** \brief Start a new section.
- *
- * This macro is an _overload_ of the CATCH_SECTION() macro defined in
- * catch2.hpp. It is used so we can print out the name of the section
- * whenever it executes and g_progress is true (i.e. the `--progress`
- * command line option was specified.)
- *
- * \code
- *     CATCH_START_SECTION("my section name/description here")
- *         break_something(1, 2, 3);
- *     CATCH_END_SECTION()
- * \endcode
- *
- * As you can see, you want to end the section with the CATCH_END_SECTION()
- * macro.
- *
- * \note
- * You do not need to add a block like you have to do with CATCH since
- * the macros add them for you.
- *
- * \note
- * The older version of Catch supported a description for a section.
- * Now that's useless so we only offer a name here.
- *
- * \param[in] name  The name of the section.
- */
-#define CATCH_START_SECTION(name) \
-    CATCH_SECTION(name) \
-    { \
-        if(SNAP_CATCH2_NAMESPACE::g_progress()) \
-        { \
-            std::cout << "SECTION: " << name << std::endl; \
-        }
-
-/** \brief End a section.
- *
- * This macro ends a section. The CATCH_START_SECTION() creates a
- * block which this macro closes.
- */
-#define CATCH_END_SECTION() \
-    }
-
+void * operator new (std::size_t size)
+{
+    return SNAP_CATCH2_NAMESPACE::detail::tracked_allocate(size, 0, false);
+}
 
-/** \brief Require that two long strings be equal.
- *
- * When testing with really long strings, the compare failing will give
- * you both output but it's pretty much impossible to see the errors.
- *
- * Here we call our own function which will highlight the problems
- * so that way you can immediately see where the first difference occurs.
- *
- * \note
- * This does not make use of the standard catch environment so it will
- * eventually throw or break in some other ways which may not end up
- * well.
- *
- * \param[in] a  The first string.
- * \param[in] b  The second string.
- */
-#define CATCH_REQUIRE_LONG_STRING(a, b) SNAP_CATCH2_NAMESPACE::catch_compare_long_strings(a, b)
+void * operator new [] (std::size_t size)
+{
+    return SNAP_CATCH2_NAMESPACE::detail::tracked_allocate(size, 0, false);
+}
 
+void * operator new (std::size_t size, std::nothrow_t const &) noexcept
+{
+    return SNAP_CATCH2_NAMESPACE::detail::tracked_allocate(size, 0, true);
+}
 
+void * operator new [] (std::size_t size, std::nothrow_t const &) noexcept
+{
+    return SNAP_CATCH2_NAMESPACE::detail::tracked_allocate(size, 0, true);
+}
 
-#define CATCH_REQUIRE_FLOATING_POINT(a, b) SNAP_CATCH2_NAMESPACE::nearly_equal(a, b)
+void operator delete (void * ptr) noexcept
+{
+    SNAP_CATCH2_NAMESPACE::detail::tracked_free(ptr);
+}
 
+void operator delete [] (void * ptr) noexcept
+{
+    SNAP_CATCH2_NAMESPACE::detail::tracked_free(ptr);
+}
 
+void operator delete (void * ptr, std::size_t) noexcept
+{
+    SNAP_CATCH2_NAMESPACE::detail::tracked_free(ptr);
+}
 
-namespace Catch
+void operator delete [] (void * ptr, std::size_t) noexcept
 {
-namespace Matchers
+    SNAP_CATCH2_NAMESPACE::detail::tracked_free(ptr);
+}
+
+void operator delete (void * ptr, std::nothrow_t const &) noexcept
 {
+    SNAP_CATCH2_NAMESPACE::detail::tracked_free(ptr);
+}
 
+void operator delete [] (void * ptr, std::nothrow_t const &) noexcept
+{
+    SNAP_CATCH2_NAMESPACE::detail::tracked_free(ptr);
+}
 
-class ExceptionWatcher
-    : public MatcherBase<std::exception>
+#ifdef __cpp_aligned_new
+void * operator new (std::size_t size, std::align_val_t alignment)
 {
-public:
-    ExceptionWatcher(std::string const & expected_message, bool verbose)
-        : m_expected_message(expected_message)
-        , m_verbose(verbose)
-    {
-    }
+    return SNAP_CATCH2_NAMESPACE::detail::tracked_allocate(size, static_cast<std::size_t>(alignment), false);
+}
 
-    /** \brief Check whether we got a match.
-     *
-     * This function compares the expected string with the actual exception
-     * what() output.
-     */
-    bool match(std::exception const & e) const override
-    {
-        if(m_verbose)
-        {
-            SNAP_CATCH2_NAMESPACE::catch_compare_long_strings(e.what(), m_expected_message);
-        }
-        return e.what() == m_expected_message;
-    }
+void * operator new [] (std::size_t size, std::align_val_t alignment)
+{
+    return SNAP_CATCH2_NAMESPACE::detail::tracked_allocate(size, static_cast<std::size_t>(alignment), false);
+}
 
-    /** \brief Describe this matcher.
-     *
-     * This function produces a string describing what this matcher does.
-     *
-     * \return The description of this matcher.
-     */
-    virtual std::string describe() const override
-    {
-        return "compare the exception what() message with \""
-             + m_expected_message
-             + "\".";
-    }
+void * operator new (std::size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept
+{
+    return SNAP_CATCH2_NAMESPACE::detail::tracked_allocate(size, static_cast<std::size_t>(alignment), true);
+}
 
-private:
-    std::string     m_expected_message = std::string();
-    bool            m_verbose = false;
-};
+void * operator new [] (std::size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept
+{
+    return SNAP_CATCH2_NAMESPACE::detail::tracked_allocate(size, static_cast<std::size_t>(alignment), true);
+}
 
+void operator delete (void * ptr, std::align_val_t) noexcept
+{
+    SNAP_CATCH2_NAMESPACE::detail::tracked_free(ptr);
+}
 
-inline ExceptionWatcher ExceptionMessage(std::string const & expected_message, bool verbose = false)
+void operator delete [] (void * ptr, std::align_val_t) noexcept
 {
-    return ExceptionWatcher(expected_message, verbose);
+    SNAP_CATCH2_NAMESPACE::detail::tracked_free(ptr);
 }
 
+void operator delete (void * ptr, std::size_t, std::align_val_t) noexcept
+{
+    SNAP_CATCH2_NAMESPACE::detail::tracked_free(ptr);
+}
 
+void operator delete [] (void * ptr, std::size_t, std::align_val_t) noexcept
+{
+    SNAP_CATCH2_NAMESPACE::detail::tracked_free(ptr);
+}
 
+void operator delete (void * ptr, std::align_val_t, std::nothrow_t const &) noexcept
+{
+    SNAP_CATCH2_NAMESPACE::detail::tracked_free(ptr);
 }
-// Matchers namespace
+
+void operator delete [] (void * ptr, std::align_val_t, std::nothrow_t const &) noexcept
+{
+    SNAP_CATCH2_NAMESPACE::detail::tracked_free(ptr);
 }
-// Catch namespace
+#endif
+#endif
 
 
 // vim: ts=4 sw=4 et